@@ -173,6 +173,74 @@ Supports drag and drop of images and text.</translation>
         <source>New File</source>
         <translation>New File</translation>
     </message>
+    <message>
+        <source>Embed Images in Map</source>
+        <translation>Embed Images in Map</translation>
+    </message>
+    <message>
+        <source>Import...</source>
+        <translation>Import...</translation>
+    </message>
+    <message>
+        <source>Import File</source>
+        <translation>Import File</translation>
+    </message>
+    <message>
+        <source>Outlines (*.mm *.opml);;FreeMind Maps (*.mm);;OPML Files (*.opml);;All Files (*)</source>
+        <translation>Outlines (*.mm *.opml);;FreeMind Maps (*.mm);;OPML Files (*.opml);;All Files (*)</translation>
+    </message>
+    <message>
+        <source>Import Error</source>
+        <translation>Import Error</translation>
+    </message>
+    <message>
+        <source>File is not a valid FreeMind or OPML outline.</source>
+        <translation>File is not a valid FreeMind or OPML outline.</translation>
+    </message>
+    <message>
+        <source>Export Outline...</source>
+        <translation>Export Outline...</translation>
+    </message>
+    <message>
+        <source>Export Outline</source>
+        <translation>Export Outline</translation>
+    </message>
+    <message>
+        <source>OPML Files (*.opml)</source>
+        <translation>OPML Files (*.opml)</translation>
+    </message>
+    <message>
+        <source>Markdown Files (*.md)</source>
+        <translation>Markdown Files (*.md)</translation>
+    </message>
+    <message>
+        <source>Text Files (*.txt)</source>
+        <translation>Text Files (*.txt)</translation>
+    </message>
+    <message>
+        <source>Failed to save outline to file.</source>
+        <translation>Failed to save outline to file.</translation>
+    </message>
+    <message>
+        <source>Map has been exported as an outline successfully.</source>
+        <translation>Map has been exported as an outline successfully.</translation>
+    </message>
+    <message>
+        <source>Failed to save PDF to file.</source>
+        <translation>Failed to save PDF to file.</translation>
+    </message>
+    <message>
+        <source>Find...</source>
+        <translation>Find...</translation>
+    </message>
+    <message>
+        <source>Undo</source>
+        <translation>Undo</translation>
+    </message>
+    <message>
+        <source>Redo</source>
+        <translation>Redo</translation>
+    </message>
 </context>
 <context>
     <name>QObject</name>
@@ -196,5 +264,52 @@ Supports drag and drop of images and text.</translation>
         <source>Create New Node</source>
         <translation>Create New Node</translation>
     </message>
+    <message>
+        <source>Expand</source>
+        <translation>Expand</translation>
+    </message>
+    <message>
+        <source>Collapse</source>
+        <translation>Collapse</translation>
+    </message>
+    <message>
+        <source>Move</source>
+        <translation>Move</translation>
+    </message>
+    <message>
+        <source>Edit Text</source>
+        <translation>Edit Text</translation>
+    </message>
+    <message>
+        <source>Insert Items</source>
+        <translation>Insert Items</translation>
+    </message>
+    <message>
+        <source>Detach from Parent</source>
+        <translation>Detach from Parent</translation>
+    </message>
+</context>
+<context>
+    <name>SearchBar</name>
+    <message>
+        <source>No matches</source>
+        <translation>No matches</translation>
+    </message>
+    <message>
+        <source>%1 of %2 matches</source>
+        <translation>%1 of %2 matches</translation>
+    </message>
+    <message>
+        <source>%1 matches</source>
+        <translation>%1 matches</translation>
+    </message>
+    <message>
+        <source>Find nodes, links and paths</source>
+        <translation>Find nodes, links and paths</translation>
+    </message>
+    <message>
+        <source>Close</source>
+        <translation>Close</translation>
+    </message>
 </context>
 </TS>
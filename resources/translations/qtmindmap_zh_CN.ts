@@ -173,6 +173,74 @@ Supports drag and drop of images and text.</source>
         <source>New File</source>
         <translation>新文件</translation>
     </message>
+    <message>
+        <source>Embed Images in Map</source>
+        <translation>在导图中嵌入图片</translation>
+    </message>
+    <message>
+        <source>Import...</source>
+        <translation>导入...</translation>
+    </message>
+    <message>
+        <source>Import File</source>
+        <translation>导入文件</translation>
+    </message>
+    <message>
+        <source>Outlines (*.mm *.opml);;FreeMind Maps (*.mm);;OPML Files (*.opml);;All Files (*)</source>
+        <translation>大纲 (*.mm *.opml);;FreeMind 导图 (*.mm);;OPML 文件 (*.opml);;所有文件 (*)</translation>
+    </message>
+    <message>
+        <source>Import Error</source>
+        <translation>导入错误</translation>
+    </message>
+    <message>
+        <source>File is not a valid FreeMind or OPML outline.</source>
+        <translation>文件不是有效的 FreeMind 或 OPML 大纲。</translation>
+    </message>
+    <message>
+        <source>Export Outline...</source>
+        <translation>导出大纲...</translation>
+    </message>
+    <message>
+        <source>Export Outline</source>
+        <translation>导出大纲</translation>
+    </message>
+    <message>
+        <source>OPML Files (*.opml)</source>
+        <translation>OPML 文件 (*.opml)</translation>
+    </message>
+    <message>
+        <source>Markdown Files (*.md)</source>
+        <translation>Markdown 文件 (*.md)</translation>
+    </message>
+    <message>
+        <source>Text Files (*.txt)</source>
+        <translation>文本文件 (*.txt)</translation>
+    </message>
+    <message>
+        <source>Failed to save outline to file.</source>
+        <translation>无法将大纲保存到文件。</translation>
+    </message>
+    <message>
+        <source>Map has been exported as an outline successfully.</source>
+        <translation>导图已成功导出为大纲。</translation>
+    </message>
+    <message>
+        <source>Failed to save PDF to file.</source>
+        <translation>无法将 PDF 保存到文件。</translation>
+    </message>
+    <message>
+        <source>Find...</source>
+        <translation>查找...</translation>
+    </message>
+    <message>
+        <source>Undo</source>
+        <translation>撤销</translation>
+    </message>
+    <message>
+        <source>Redo</source>
+        <translation>重做</translation>
+    </message>
 </context>
 <context>
     <name>QObject</name>
@@ -196,5 +264,52 @@ Supports drag and drop of images and text.</source>
         <source>Create New Node</source>
         <translation>创建新节点</translation>
     </message>
+    <message>
+        <source>Expand</source>
+        <translation>展开</translation>
+    </message>
+    <message>
+        <source>Collapse</source>
+        <translation>折叠</translation>
+    </message>
+    <message>
+        <source>Move</source>
+        <translation>移动</translation>
+    </message>
+    <message>
+        <source>Edit Text</source>
+        <translation>编辑文本</translation>
+    </message>
+    <message>
+        <source>Insert Items</source>
+        <translation>插入项目</translation>
+    </message>
+    <message>
+        <source>Detach from Parent</source>
+        <translation>从父节点分离</translation>
+    </message>
+</context>
+<context>
+    <name>SearchBar</name>
+    <message>
+        <source>No matches</source>
+        <translation>没有匹配项</translation>
+    </message>
+    <message>
+        <source>%1 of %2 matches</source>
+        <translation>%1 / %2 个匹配项</translation>
+    </message>
+    <message>
+        <source>%1 matches</source>
+        <translation>%1 个匹配项</translation>
+    </message>
+    <message>
+        <source>Find nodes, links and paths</source>
+        <translation>查找节点、链接和路径</translation>
+    </message>
+    <message>
+        <source>Close</source>
+        <translation>关闭</translation>
+    </message>
 </context>
 </TS>
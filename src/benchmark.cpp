@@ -0,0 +1,246 @@
+#include "pch.h"
+
+#include "benchmark.h"
+#include "infinitecanvas.h"
+#include "itempool.h"
+#include "maploader.h"
+#include "mapwriter.h"
+#include "outlineexporter.h"
+#include "sceneexporter.h"
+#include "searchindex.h"
+
+namespace {
+// Steps of the simulated node drag
+constexpr int kDragSteps = 100;
+
+// Viewport size for the render measurement
+const QSize kViewportSize(1920, 1080);
+
+// The node with the most direct children, the most expensive one to drag
+EditableTextItem *busiestNode(const QGraphicsScene *scene)
+{
+    EditableTextItem *busiest = nullptr;
+    for (QGraphicsItem *item : scene->items()) {
+        EditableTextItem *node = dynamic_cast<EditableTextItem*>(item);
+        if (node && (!busiest || node->childNodes().size() > busiest->childNodes().size())) {
+            busiest = node;
+        }
+    }
+    return busiest;
+}
+
+double median(QVector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    int middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+}
+
+Benchmark::Benchmark(const MapGenerator::Options &map_options, int iterations)
+    : m_map_options(map_options),
+      m_iterations(qMax(1, iterations))
+{
+}
+
+void Benchmark::run(int node_count)
+{
+    QTemporaryDir temp_dir;
+    if (!temp_dir.isValid()) {
+        qCritical() << "Failed to create a temporary directory:" << temp_dir.errorString();
+        return;
+    }
+
+    // Generate the map and write it as the input of the load measurement
+    MapGenerator::Options options = m_map_options;
+    options.node_count = node_count;
+    QString map_path = temp_dir.filePath("map.json");
+    QFile map_file(map_path);
+    if (!map_file.open(QIODevice::WriteOnly) ||
+        map_file.write(QJsonDocument(MapGenerator::generate(options)).toJson(QJsonDocument::Compact)) < 0) {
+        qCritical() << "Failed to write the generated map:" << map_file.errorString();
+        return;
+    }
+    map_file.close();
+
+    measure("load", node_count, [&map_path]() {
+        QGraphicsScene scene;
+        MapLoader loader(&scene);
+        bool ok = loader.loadNow(map_path);
+        EditableTextItem::clearScene(&scene);
+        return ok;
+    });
+
+    // Closing or replacing the map, on a freshly loaded copy each time
+    QGraphicsScene teardown_scene;
+    MapLoader teardown_loader(&teardown_scene);
+    measure("teardown", node_count, [&teardown_scene]() {
+        EditableTextItem::clearScene(&teardown_scene);
+        return teardown_scene.items().isEmpty();
+    }, [&teardown_loader, &map_path]() {
+        teardown_loader.loadNow(map_path);
+    });
+
+    // Opening the map again in its own place, reusing its items
+    teardown_loader.loadNow(map_path);
+    measure("reload", node_count, [&teardown_scene, &teardown_loader, &map_path]() {
+        EditableTextItem::clearScene(&teardown_scene, &ItemPool::instance());
+        bool ok = teardown_loader.loadNow(map_path);
+        ItemPool::instance().clear();
+        return ok;
+    });
+    EditableTextItem::clearScene(&teardown_scene);
+
+    // The remaining measurements share one loaded scene
+    QGraphicsScene scene;
+    MapLoader loader(&scene);
+    if (!loader.loadNow(map_path)) {
+        qCritical() << "Failed to load the generated map";
+        return;
+    }
+    recordLinkMemory(node_count);
+
+    // Typed queries, from a short prefix to several words; the first search
+    // also indexes the map
+    SearchIndex::instance().search(QString(), &scene);
+    measure("search", node_count, [&scene]() {
+        for (const char *query : {"re", "rev", "review", "plan draft", "meeting 12"}) {
+            SearchIndex::instance().search(QLatin1String(query), &scene);
+        }
+        return true;
+    });
+
+    QString save_path = temp_dir.filePath("saved.json");
+    measure("save", node_count, [&scene, &save_path]() {
+        QString error_string;
+        return MapWriter::write(&scene, save_path, 1.0, QPointF(), false, &error_string);
+    });
+
+    measure("layout", node_count, [&scene]() {
+        for (EditableTextItem *root : OutlineExporter::rootNodes(&scene)) {
+            root->organizeChildrenLayout();
+        }
+        return true;
+    });
+
+    EditableTextItem *dragged = busiestNode(&scene);
+    measure("drag", node_count, [dragged]() {
+        if (!dragged) {
+            return false;
+        }
+        QPointF start = dragged->pos();
+        for (int step = 1; step <= kDragSteps; ++step) {
+            dragged->setPos(start + QPointF(step, step));
+            dragged->updateConnections();
+        }
+        dragged->setPos(start);
+        dragged->updateConnections();
+        return true;
+    });
+
+    // One screen of the map around its first root
+    measure("render", node_count, [&scene, dragged]() {
+        QImage image(kViewportSize, QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::white);
+        QRectF source(QPointF(), QSizeF(kViewportSize));
+        if (dragged) {
+            source.moveCenter(dragged->sceneBoundingRect().center());
+        }
+        QPainter painter(&image);
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.setRenderHint(QPainter::TextAntialiasing);
+        scene.render(&painter, QRectF(), source);
+        return painter.end();
+    });
+
+    QString png_path = temp_dir.filePath("export.png");
+    measure("export_png", node_count, [&scene, &png_path]() {
+        return SceneExporter::exportToFile(&scene, png_path, SceneExporter::Format::Png);
+    });
+
+    QString pdf_path = temp_dir.filePath("export.pdf");
+    measure("export_pdf", node_count, [&scene, &pdf_path]() {
+        return SceneExporter::exportToFile(&scene, pdf_path, SceneExporter::Format::Pdf);
+    });
+
+    EditableTextItem::clearScene(&scene);
+}
+
+void Benchmark::measure(const QString &name, int node_count, const std::function<bool()> &operation,
+                        const std::function<void()> &setup)
+{
+    QVector<double> times_ms;
+    bool ok = true;
+    QElapsedTimer timer;
+
+    for (int i = 0; i < m_iterations && ok; ++i) {
+        if (setup) {
+            setup();
+        }
+        timer.start();
+        ok = operation();
+        times_ms.append(timer.nsecsElapsed() / 1e6);
+    }
+
+    double total_ms = std::accumulate(times_ms.begin(), times_ms.end(), 0.0);
+    QJsonObject result;
+    result["name"] = name;
+    result["nodes"] = node_count;
+    result["iterations"] = times_ms.size();
+    result["min_ms"] = *std::min_element(times_ms.begin(), times_ms.end());
+    result["median_ms"] = median(times_ms);
+    result["mean_ms"] = total_ms / times_ms.size();
+    result["ok"] = ok;
+    m_results.append(result);
+
+    qInfo().noquote() << QString("%1 %2 nodes: median %3 ms, min %4 ms%5")
+                             .arg(name, -10)
+                             .arg(node_count, 7)
+                             .arg(result["median_ms"].toDouble(), 0, 'f', 2)
+                             .arg(result["min_ms"].toDouble(), 0, 'f', 2)
+                             .arg(ok ? "" : " (failed)");
+}
+
+void Benchmark::recordLinkMemory(int node_count)
+{
+    NodeLinks::Stats stats = NodeLinks::stats();
+    double nodes = qMax(1, node_count);
+
+    QJsonObject result;
+    result["name"] = "links";
+    result["nodes"] = node_count;
+    result["reserved_bytes"] = stats.reserved_bytes;
+    result["used_bytes"] = stats.used_bytes;
+    result["allocations"] = stats.allocations;
+    result["bytes_per_node"] = stats.reserved_bytes / nodes;
+    result["allocations_per_node"] = stats.allocations / nodes;
+    m_results.append(result);
+
+    qInfo().noquote() << QString("%1 %2 nodes: %3 bytes, %4 allocations per node")
+                             .arg("links", -10)
+                             .arg(node_count, 7)
+                             .arg(result["bytes_per_node"].toDouble(), 0, 'f', 2)
+                             .arg(result["allocations_per_node"].toDouble(), 0, 'f', 4);
+}
+
+QJsonObject Benchmark::results() const
+{
+    QJsonObject metadata;
+    metadata["qt_version"] = QString(qVersion());
+    metadata["os"] = QSysInfo::prettyProductName();
+    metadata["cpu_architecture"] = QSysInfo::currentCpuArchitecture();
+    metadata["cores"] = QThread::idealThreadCount();
+    metadata["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+#ifdef QT_DEBUG
+    metadata["build"] = "debug";
+#else
+    metadata["build"] = "release";
+#endif
+    metadata["iterations"] = m_iterations;
+    metadata["seed"] = qint64(m_map_options.seed);
+
+    QJsonObject json_data;
+    json_data["metadata"] = metadata;
+    json_data["results"] = m_results;
+    return json_data;
+}
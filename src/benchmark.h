@@ -0,0 +1,41 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "pch.h"
+#include "mapgenerator.h"
+
+// Times the expensive map operations on generated maps of several sizes.
+//
+// For every size a map is generated, written to a temporary directory and
+// then loaded, reloaded, searched, saved, laid out, dragged, rendered,
+// exported and torn down, each a fixed number of times, and the memory
+// taken by the node links of the loaded map is recorded. Results are
+// collected as JSON (with the Qt version and machine they were taken on) so
+// runs can be compared across builds; a short summary of each measurement
+// is logged as it completes.
+class Benchmark
+{
+public:
+    Benchmark(const MapGenerator::Options &map_options, int iterations);
+
+    // Run all measurements on a map with this many text nodes
+    void run(int node_count);
+
+    // Results of all runs so far
+    QJsonObject results() const;
+
+private:
+    // Time an operation; it returns false if it failed. setup runs before
+    // each iteration and is not timed.
+    void measure(const QString &name, int node_count, const std::function<bool()> &operation,
+                 const std::function<void()> &setup = std::function<void()>());
+
+    // Record the link storage (see NodeLinks) held by the loaded map
+    void recordLinkMemory(int node_count);
+
+    MapGenerator::Options m_map_options;
+    int m_iterations;
+    QJsonArray m_results;
+};
+
+#endif // BENCHMARK_H
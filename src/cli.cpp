@@ -0,0 +1,434 @@
+#include "pch.h"
+
+#include "benchmark.h"
+#include "faviconfetcher.h"
+#include "iconcache.h"
+#include "iconloader.h"
+#include "infinitecanvas.h"
+#include "mapgenerator.h"
+#include "maploader.h"
+#include "mapwriter.h"
+#include "outlineexporter.h"
+#include "sceneexporter.h"
+#include "trace.h"
+
+// Command line tool to convert, lay out and export maps without a window.
+//
+//   qtmindmap-cli [--layout] [--format <format>] [--output <file> | --output-dir <dir>]
+//                 [--jobs <n>] <map>...
+//   qtmindmap-cli --generate <nodes> [--depth <n>] [--fan-out <n>] [--seed <n>] [--mix <mix>]
+//                 --output <file>
+//   qtmindmap-cli --bench [--bench-sizes <sizes>] [--iterations <n>] [--output <file>]
+//   qtmindmap-cli --fetch-favicons <page-url>...
+//
+// --fetch-favicons checks the favicon pipeline, e.g. against a local server
+// set up with QTMINDMAP_FAVICON_URL=http://127.0.0.1:8000/{host}.ico; it
+// exits with 0 only if every page got an icon.
+//
+// Runs on the offscreen platform. With several maps, each one is handled by
+// a child process running this tool, up to --jobs at a time: scene items
+// and the icon and image caches belong to the thread that created them, so
+// processes are the unit of parallelism.
+
+namespace {
+// Output formats, named by the suffix of the files they write
+const QStringList kFormats = {"png", "pdf", "svg", "json", "cbor", "opml", "md", "txt"};
+
+// Debug output of the map code is only shown with --verbose
+bool g_verbose = false;
+
+void messageHandler(QtMsgType type, const QMessageLogContext &, const QString &message) {
+  if ((type == QtDebugMsg || type == QtInfoMsg) && !g_verbose) {
+    return;
+  }
+  fprintf(stderr, "%s\n", qPrintable(message));
+  fflush(stderr);
+}
+
+// Output file for an input, with the format's suffix
+QString outputPath(const QString &input, const QString &output_dir, const QString &format) {
+  QFileInfo input_info(input);
+  QDir dir(output_dir.isEmpty() ? input_info.absolutePath() : output_dir);
+  return dir.filePath(input_info.completeBaseName() + "." + format);
+}
+
+// Load one map, optionally lay it out, and write it in the output's format
+bool processFile(const QString &input, const QString &output, bool layout) {
+  TRACE_SCOPE("processFile", "cli");
+
+  QGraphicsScene scene;
+  MapLoader loader(&scene);
+
+  // Keep the saved view for map outputs and report why a load failed
+  qreal scale_factor = 1.0;
+  QPointF center;
+  MapLoader::Error error = MapLoader::Error::InvalidJson;
+  QObject::connect(&loader, &MapLoader::viewStateLoaded,
+                   [&scale_factor, &center](qreal loaded_scale, const QPointF &loaded_center,
+                                            bool has_center) {
+                     scale_factor = loaded_scale;
+                     if (has_center) {
+                       center = loaded_center;
+                     }
+                   });
+  QObject::connect(&loader, &MapLoader::failed,
+                   [&error](MapLoader::Error load_error) { error = load_error; });
+
+  if (!loader.loadNow(input)) {
+    qCritical().noquote() << input << ": failed to load ("
+                          << QMetaEnum::fromType<MapLoader::Error>().valueToKey(int(error)) << ")";
+    return false;
+  }
+
+  // Organize Layout from every root node
+  if (layout) {
+    TRACE_SCOPE("layout", "cli");
+    for (EditableTextItem *root : OutlineExporter::rootNodes(&scene)) {
+      root->organizeChildrenLayout();
+    }
+  }
+
+  // The output's suffix selects the exporter
+  bool success = false;
+  SceneExporter::Format scene_format;
+  OutlineExporter::Format outline_format;
+  if (SceneExporter::formatForFile(output, &scene_format)) {
+    success = SceneExporter::exportToFile(&scene, output, scene_format);
+  } else if (OutlineExporter::formatForFile(output, &outline_format)) {
+    QSaveFile output_file(output);
+    success = output_file.open(QIODevice::WriteOnly) &&
+              OutlineExporter::write(OutlineExporter::rootNodes(&scene), outline_format,
+                                     &output_file, QFileInfo(output).completeBaseName()) &&
+              output_file.commit();
+  } else {
+    QString error_string;
+    success = MapWriter::write(&scene, output, scale_factor, center, false, &error_string);
+  }
+
+  // Drop the map with all links at once instead of node by node
+  EditableTextItem::clearScene(&scene);
+
+  if (!success) {
+    qCritical().noquote() << output << ": failed to write";
+    return false;
+  }
+  qInfo().noquote() << input << "->" << output;
+  return true;
+}
+
+// Write a generated map to a file
+bool generateMap(const MapGenerator::Options &options, const QString &output) {
+  QSaveFile output_file(output);
+  if (!output_file.open(QIODevice::WriteOnly)) {
+    qCritical().noquote() << output << ": failed to write";
+    return false;
+  }
+  QJsonObject map_data = MapGenerator::generate(options);
+  bool cbor = MapWriter::formatForFile(output) == MapWriter::Format::Cbor;
+  output_file.write(cbor ? QCborValue::fromJsonValue(map_data).toCbor()
+                         : QJsonDocument(map_data).toJson(QJsonDocument::Compact));
+  if (!output_file.commit()) {
+    qCritical().noquote() << output << ": failed to write";
+    return false;
+  }
+  qInfo().noquote() << "Generated" << options.node_count << "nodes ->" << output;
+  return true;
+}
+
+// Run the benchmarks and write their results as JSON to the output file, or stdout
+bool runBenchmarks(const MapGenerator::Options &options, const QString &sizes, int iterations,
+                   const QString &output) {
+  QVector<int> node_counts;
+  for (const QString &size : sizes.split(',', Qt::SkipEmptyParts)) {
+    bool ok = false;
+    int node_count = size.trimmed().toInt(&ok);
+    if (!ok || node_count <= 0) {
+      qCritical().noquote() << "Invalid benchmark size" << size;
+      return false;
+    }
+    node_counts.append(node_count);
+  }
+
+  Benchmark benchmark(options, iterations);
+  for (int node_count : node_counts) {
+    benchmark.run(node_count);
+  }
+
+  QByteArray json = QJsonDocument(benchmark.results()).toJson();
+  if (output.isEmpty()) {
+    fwrite(json.constData(), 1, json.size(), stdout);
+    return true;
+  }
+  QSaveFile output_file(output);
+  if (!output_file.open(QIODevice::WriteOnly) || output_file.write(json) < 0 ||
+      !output_file.commit()) {
+    qCritical().noquote() << output << ": failed to write";
+    return false;
+  }
+  return true;
+}
+
+// Fetch the favicons of the pages into an empty cache and report each result
+bool fetchFavicons(const QStringList &page_urls) {
+  QTemporaryDir cache_dir;
+  if (!cache_dir.isValid()) {
+    qCritical() << "Could not create a favicon cache directory";
+    return false;
+  }
+  FaviconFetcher &fetcher = FaviconFetcher::instance();
+  fetcher.setCacheDirectory(cache_dir.path());
+
+  QSet<QString> pending;
+  for (const QString &page_url : page_urls) {
+    QUrl url = QUrl::fromUserInput(page_url);
+    if (url.host().isEmpty()) {
+      qCritical().noquote() << page_url << ": not a web page URL";
+      return false;
+    }
+    pending.insert(url.host().toLower());
+  }
+
+  QEventLoop loop;
+  int fetched = 0;
+  auto answered = [&](const QString &host) {
+    pending.remove(host);
+    if (pending.isEmpty()) {
+      loop.quit();
+    }
+  };
+  QObject::connect(&fetcher, &FaviconFetcher::iconFetched, &loop,
+                   [&](const QString &host, const QImage &image) {
+                     printf("%s: %dx%d\n", qPrintable(host), image.width(), image.height());
+                     ++fetched;
+                     answered(host);
+                   });
+  QObject::connect(&fetcher, &FaviconFetcher::iconUnavailable, &loop, [&](const QString &host) {
+    printf("%s: unavailable\n", qPrintable(host));
+    answered(host);
+  });
+
+  int host_count = pending.size();
+  for (const QString &page_url : page_urls) {
+    fetcher.fetch(QUrl::fromUserInput(page_url));
+  }
+  loop.exec();
+  fetcher.waitForCacheWrites();
+  fflush(stdout);
+  return fetched == host_count;
+}
+
+// Process the maps in child processes, at most jobs at a time; returns the number of failures
+int runJobs(const QStringList &inputs, const QStringList &outputs, const QStringList &options,
+            int jobs) {
+  QEventLoop loop;
+  int next = 0;
+  int running = 0;
+  int failures = 0;
+
+  std::function<void()> start_next = [&]() {
+    while (running < jobs && next < inputs.size()) {
+      QString input = inputs[next];
+      QString output = outputs[next];
+      ++next;
+      ++running;
+
+      QProcess *process = new QProcess(&loop);
+      process->setProcessChannelMode(QProcess::ForwardedChannels);
+
+      auto done = [&, process](bool ok) {
+        if (!ok) {
+          ++failures;
+        }
+        --running;
+        process->deleteLater();
+        if (running == 0 && next == inputs.size()) {
+          loop.quit();
+        } else {
+          start_next();
+        }
+      };
+      QObject::connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+                       [done](int exit_code, QProcess::ExitStatus exit_status) {
+                         done(exit_status == QProcess::NormalExit && exit_code == 0);
+                       });
+      QObject::connect(process, &QProcess::errorOccurred, [done, input](QProcess::ProcessError error) {
+        // Processes that never started will not report finished()
+        if (error == QProcess::FailedToStart) {
+          qCritical().noquote() << input << ": could not start worker process";
+          done(false);
+        }
+      });
+
+      process->start(QCoreApplication::applicationFilePath(),
+                     options + QStringList{"--jobs", "1", "--output", output, input});
+    }
+  };
+
+  start_next();
+  if (running > 0) {
+    loop.exec();
+  }
+  return failures;
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  Trace::startFromEnvironment(argc, argv);
+
+  // No window system is needed for loading and rendering
+  if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+  qInstallMessageHandler(messageHandler);
+
+  QApplication app(argc, argv);
+  QCoreApplication::setApplicationName("qtmindmap-cli");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Convert, lay out and export QtMindMap maps without a window.");
+  parser.addHelpOption();
+  parser.addPositionalArgument("maps", "Map files (.json, .cbor, .mm, .opml) to process.", "<map>...");
+
+  QCommandLineOption format_option({"f", "format"},
+                                   "Output format: " + kFormats.join(", ") +
+                                   ". Defaults to the suffix of --output, else png.",
+                                   "format");
+  QCommandLineOption output_option({"o", "output"}, "Output file (one map only).", "file");
+  QCommandLineOption output_dir_option({"d", "output-dir"},
+                                       "Directory for the outputs. Defaults to the map's directory.",
+                                       "dir");
+  QCommandLineOption layout_option({"l", "layout"}, "Run Organize Layout on every root node.");
+  QCommandLineOption jobs_option({"j", "jobs"},
+                                 "Maps processed in parallel. Defaults to the number of cores.",
+                                 "n", QString::number(QThread::idealThreadCount()));
+  QCommandLineOption verbose_option("verbose", "Show debug output.");
+  QCommandLineOption trace_option("trace", "Write a Chrome trace of the run to a file.", "file");
+  QCommandLineOption generate_option("generate", "Write a generated map with this many nodes to --output.",
+                                     "nodes");
+  QCommandLineOption bench_option("bench", "Time loading, search, saving, layout, dragging, rendering and "
+                                           "export on generated maps and write the results as JSON.");
+  QCommandLineOption bench_sizes_option("bench-sizes", "Node counts of the benchmark maps.", "sizes",
+                                        "1000,10000,100000");
+  QCommandLineOption iterations_option("iterations", "Runs of each benchmark.", "n", "3");
+  QCommandLineOption depth_option("depth", "Deepest level of generated trees.", "n", "8");
+  QCommandLineOption fan_out_option("fan-out", "Most children per generated node.", "n", "6");
+  QCommandLineOption seed_option("seed", "Seed for generated maps.", "n", "1");
+  QCommandLineOption fetch_favicons_option("fetch-favicons",
+                                            "Fetch the favicons of the page URLs given instead of "
+                                            "maps, bypassing the icon cache, and print the results.");
+  QCommandLineOption mix_option("mix", "Extra items in generated maps, in percent of the nodes, "
+                                       "e.g. url=5,directory=5,media=5,image=5.", "mix");
+  parser.addOptions({format_option, output_option, output_dir_option, layout_option, jobs_option,
+                     verbose_option, trace_option, generate_option, bench_option, bench_sizes_option,
+                     iterations_option, depth_option, fan_out_option, seed_option, mix_option,
+                     fetch_favicons_option});
+  parser.process(app);
+
+  g_verbose = parser.isSet(verbose_option);
+
+  // Generated maps for --generate and --bench
+  if (parser.isSet(generate_option) || parser.isSet(bench_option)) {
+    MapGenerator::Options options;
+    options.node_count = parser.value(generate_option).toInt();
+    options.max_depth = qMax(1, parser.value(depth_option).toInt());
+    options.fan_out = qMax(1, parser.value(fan_out_option).toInt());
+    options.seed = parser.value(seed_option).toUInt();
+    if (!MapGenerator::parseMix(parser.value(mix_option), &options)) {
+      qCritical().noquote() << "Invalid item mix" << parser.value(mix_option);
+      return 1;
+    }
+
+    bool success = false;
+    if (parser.isSet(bench_option)) {
+      // Icons are resolved right away, as in conversions
+      IconLoader::instance().setSynchronous(true);
+      success = runBenchmarks(options, parser.value(bench_sizes_option),
+                              parser.value(iterations_option).toInt(), parser.value(output_option));
+    } else if (parser.value(output_option).isEmpty() || options.node_count <= 0) {
+      qCritical() << "--generate needs a positive node count and --output";
+    } else {
+      success = generateMap(options, parser.value(output_option));
+    }
+
+    // Pixmaps must not outlive QApplication
+    IconCache::instance().release();
+    Trace::stop();
+    return success ? 0 : 1;
+  }
+
+  const QStringList inputs = parser.positionalArguments();
+  if (inputs.isEmpty()) {
+    parser.showHelp(1);
+  }
+
+  if (parser.isSet(fetch_favicons_option)) {
+    bool success = fetchFavicons(inputs);
+    Trace::stop();
+    return success ? 0 : 1;
+  }
+
+  // Resolve the format from --format or the output file
+  QString output = parser.value(output_option);
+  QString format = parser.value(format_option).toLower();
+  if (!output.isEmpty()) {
+    if (inputs.size() > 1) {
+      qCritical() << "--output can only be used with a single map, use --output-dir";
+      return 1;
+    }
+    QString suffix = QFileInfo(output).suffix().toLower();
+    if (format.isEmpty()) {
+      format = suffix;
+    } else if (suffix != format) {
+      qCritical().noquote() << "Output file" << output << "does not end in ." + format;
+      return 1;
+    }
+  }
+  if (format.isEmpty()) {
+    format = "png";
+  }
+  if (!kFormats.contains(format)) {
+    qCritical().noquote() << "Unknown format" << format << "- use one of" << kFormats.join(", ");
+    return 1;
+  }
+
+  QStringList outputs;
+  for (const QString &input : inputs) {
+    outputs.append(output.isEmpty() ? outputPath(input, parser.value(output_dir_option), format)
+                                    : output);
+  }
+  if (parser.isSet(output_dir_option)) {
+    QDir().mkpath(parser.value(output_dir_option));
+  }
+
+  // Icons are resolved right away instead of on worker threads
+  IconLoader::instance().setSynchronous(true);
+
+  bool layout = parser.isSet(layout_option);
+  int jobs = qMax(1, parser.value(jobs_option).toInt());
+  int failures = 0;
+
+  if (inputs.size() > 1 && jobs > 1) {
+    QStringList options;
+    if (layout) {
+      options << "--layout";
+    }
+    if (g_verbose) {
+      options << "--verbose";
+    }
+    failures = runJobs(inputs, outputs, options, jobs);
+  } else {
+    for (int i = 0; i < inputs.size(); ++i) {
+      if (!processFile(inputs[i], outputs[i], layout)) {
+        ++failures;
+      }
+    }
+  }
+
+  if (failures > 0) {
+    qCritical() << failures << "of" << inputs.size() << "maps failed";
+  }
+
+  IconCache::instance().release();
+  Trace::stop();
+  return failures > 0 ? 1 : 0;
+}
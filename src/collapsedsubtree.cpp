@@ -0,0 +1,205 @@
+#include "pch.h"
+
+#include "collapsedsubtree.h"
+#include "infinitecanvas.h"
+
+CollapsedSubtree CollapsedSubtree::capture(const EditableTextItem *node,
+                                           QHash<const EditableTextItem*, QString> *record_ids)
+{
+    QPointF origin = node->pos();
+
+    // Records of all descendants keyed by temporary ids; hidden descendants
+    // of nested collapsed nodes are taken over as they are
+    QHash<QString, QJsonObject> source;
+    QJsonArray child_ids;
+    QVector<const EditableTextItem*> pending;
+    QVector<const EditableTextItem*> captured;
+    for (const EditableTextItem *child : node->childNodes()) {
+        child_ids.append(QString::number(quintptr(child)));
+        pending.append(child);
+    }
+
+    while (!pending.isEmpty()) {
+        const EditableTextItem *current = pending.takeLast();
+        QString id = QString::number(quintptr(current));
+        captured.append(current);
+
+        QJsonObject record = current->toRecord();
+        record["id"] = id;
+        record["x"] = current->x() - origin.x();
+        record["y"] = current->y() - origin.y();
+
+        QJsonArray record_child_ids;
+        if (const CollapsedSubtree *hidden = current->collapsedSubtree()) {
+            QString prefix = id + "/";
+            for (const QJsonValue &hidden_record : hidden->toMapItems(prefix, current->pos() - origin)) {
+                source.insert(hidden_record["id"].toString(), hidden_record.toObject());
+            }
+            record["collapsed"] = true;
+            record_child_ids = hidden->childIds(prefix);
+        }
+        for (const EditableTextItem *child : current->childNodes()) {
+            record_child_ids.append(QString::number(quintptr(child)));
+            pending.append(child);
+        }
+        if (!record_child_ids.isEmpty()) {
+            record["child_nodes"] = record_child_ids;
+        }
+
+        source.insert(id, record);
+    }
+
+    CollapsedSubtree subtree;
+    QHash<QString, QString> new_ids;
+    subtree.m_child_ids = copyRecords(source, child_ids, QPointF(), &subtree.m_records, &new_ids);
+
+    if (record_ids) {
+        for (const EditableTextItem *item : captured) {
+            record_ids->insert(item, new_ids.value(QString::number(quintptr(item))));
+        }
+    }
+    return subtree;
+}
+
+CollapsedSubtree CollapsedSubtree::fromMapItems(const QHash<QString, QJsonObject> &map_nodes,
+                                                const QJsonArray &child_ids, const QPointF &origin)
+{
+    CollapsedSubtree subtree;
+    subtree.m_child_ids = copyRecords(map_nodes, child_ids, -origin, &subtree.m_records);
+    return subtree;
+}
+
+QJsonArray CollapsedSubtree::toMapItems(const QString &id_prefix, const QPointF &origin) const
+{
+    QJsonArray items;
+    for (const QJsonValue &value : m_records) {
+        QJsonObject record = value.toObject();
+        record["id"] = id_prefix + record["id"].toString();
+        record["x"] = record["x"].toDouble() + origin.x();
+        record["y"] = record["y"].toDouble() + origin.y();
+        if (record.contains("child_nodes")) {
+            QJsonArray child_ids;
+            for (const QJsonValue &child_id : record["child_nodes"].toArray()) {
+                child_ids.append(id_prefix + child_id.toString());
+            }
+            record["child_nodes"] = child_ids;
+        }
+        items.append(record);
+    }
+    return items;
+}
+
+QJsonArray CollapsedSubtree::childIds(const QString &id_prefix) const
+{
+    QJsonArray child_ids;
+    for (const QJsonValue &child_id : m_child_ids) {
+        child_ids.append(id_prefix + child_id.toString());
+    }
+    return child_ids;
+}
+
+CollapsedSubtree CollapsedSubtree::extract(const QString &record_id) const
+{
+    QHash<QString, QJsonObject> records = recordsById();
+    QJsonObject record = records.value(record_id);
+    QPointF origin(record["x"].toDouble(), record["y"].toDouble());
+
+    CollapsedSubtree subtree;
+    subtree.m_child_ids = copyRecords(records, record["child_nodes"].toArray(), -origin,
+                                      &subtree.m_records);
+    return subtree;
+}
+
+QHash<QString, QJsonObject> CollapsedSubtree::recordsById() const
+{
+    QHash<QString, QJsonObject> records;
+    records.reserve(m_records.size());
+    for (const QJsonValue &value : m_records) {
+        QJsonObject record = value.toObject();
+        records.insert(record["id"].toString(), record);
+    }
+    return records;
+}
+
+void CollapsedSubtree::forEachRecord(const std::function<void(const QJsonObject &, int)> &visit) const
+{
+    QHash<QString, QJsonObject> records = recordsById();
+
+    // Records still to be visited with their depth, next one last
+    QVector<QPair<QString, int>> pending;
+    for (int i = m_child_ids.size() - 1; i >= 0; --i) {
+        pending.append(qMakePair(m_child_ids[i].toString(), 1));
+    }
+
+    while (!pending.isEmpty()) {
+        QPair<QString, int> entry = pending.takeLast();
+        auto it = records.constFind(entry.first);
+        if (it == records.constEnd()) {
+            continue;
+        }
+        visit(it.value(), entry.second);
+
+        QJsonArray child_ids = it.value()["child_nodes"].toArray();
+        for (int i = child_ids.size() - 1; i >= 0; --i) {
+            pending.append(qMakePair(child_ids[i].toString(), entry.second + 1));
+        }
+    }
+}
+
+QJsonArray CollapsedSubtree::copyRecords(const QHash<QString, QJsonObject> &source,
+                                         const QJsonArray &child_ids, const QPointF &offset,
+                                         QJsonArray *records, QHash<QString, QString> *id_map)
+{
+    // Number the reachable records first so child lists can be rewritten;
+    // ids continue after the records already in the array
+    QHash<QString, QString> new_ids;
+    QStringList order;
+    QVector<QString> pending;
+    for (int i = child_ids.size() - 1; i >= 0; --i) {
+        pending.append(child_ids[i].toString());
+    }
+    while (!pending.isEmpty()) {
+        QString id = pending.takeLast();
+        if (new_ids.contains(id) || !source.contains(id)) {
+            continue;
+        }
+        new_ids.insert(id, QString::number(records->size() + order.size()));
+        order.append(id);
+
+        QJsonArray record_child_ids = source.value(id)["child_nodes"].toArray();
+        for (int i = record_child_ids.size() - 1; i >= 0; --i) {
+            pending.append(record_child_ids[i].toString());
+        }
+    }
+
+    for (const QString &id : order) {
+        QJsonObject record = source.value(id);
+        record["id"] = new_ids.value(id);
+        record["x"] = record["x"].toDouble() + offset.x();
+        record["y"] = record["y"].toDouble() + offset.y();
+
+        QJsonArray record_child_ids;
+        for (const QJsonValue &child_id : record["child_nodes"].toArray()) {
+            if (new_ids.contains(child_id.toString())) {
+                record_child_ids.append(new_ids.value(child_id.toString()));
+            }
+        }
+        if (record_child_ids.isEmpty()) {
+            record.remove("child_nodes");
+        } else {
+            record["child_nodes"] = record_child_ids;
+        }
+        records->append(record);
+    }
+
+    QJsonArray copied_child_ids;
+    for (const QJsonValue &child_id : child_ids) {
+        if (new_ids.contains(child_id.toString())) {
+            copied_child_ids.append(new_ids.value(child_id.toString()));
+        }
+    }
+    if (id_map) {
+        *id_map = std::move(new_ids);
+    }
+    return copied_child_ids;
+}
@@ -0,0 +1,59 @@
+#ifndef COLLAPSEDSUBTREE_H
+#define COLLAPSEDSUBTREE_H
+
+#include "pch.h"
+
+class EditableTextItem;
+
+// Descendants of a collapsed node, kept as records instead of scene items.
+//
+// A record holds the text_node fields of the map format, with an id local
+// to the subtree and a position relative to the collapsed node, so the node
+// can be moved while collapsed and its children follow when it is expanded.
+// Records marked "collapsed" keep their own descendants in the same array;
+// those stay records when the outer subtree is expanded. Ids are renumbered
+// whenever records are copied, so they never grow across saves.
+class CollapsedSubtree
+{
+public:
+    // Record the descendants of a node; the scene items are left alone.
+    // record_ids receives the record id each captured item got.
+    static CollapsedSubtree capture(const EditableTextItem *node,
+                                    QHash<const EditableTextItem*, QString> *record_ids = nullptr);
+
+    // Collect the descendants of a saved node from the map's text nodes
+    // (by id), with positions made relative to the node at origin
+    static CollapsedSubtree fromMapItems(const QHash<QString, QJsonObject> &map_nodes,
+                                         const QJsonArray &child_ids, const QPointF &origin);
+
+    // Records as map items, with ids prefixed by id_prefix and positions
+    // relative to the scene again
+    QJsonArray toMapItems(const QString &id_prefix, const QPointF &origin) const;
+    QJsonArray childIds(const QString &id_prefix) const;
+
+    // The descendants of a collapsed record, relative to that record
+    CollapsedSubtree extract(const QString &record_id) const;
+
+    // Records by id and the ids of the collapsed node's direct children
+    QHash<QString, QJsonObject> recordsById() const;
+    QJsonArray childIds() const { return m_child_ids; }
+
+    // Visit the records depth first in child order; direct children have depth 1
+    void forEachRecord(const std::function<void(const QJsonObject &record, int depth)> &visit) const;
+
+    int nodeCount() const { return m_records.size(); }
+    bool isEmpty() const { return m_records.isEmpty(); }
+
+private:
+    // Copy the records reachable from child_ids with fresh ids, moved by
+    // offset; returns the new ids of child_ids. id_map receives the new id
+    // of every copied record by its old id.
+    static QJsonArray copyRecords(const QHash<QString, QJsonObject> &source,
+                                  const QJsonArray &child_ids, const QPointF &offset,
+                                  QJsonArray *records, QHash<QString, QString> *id_map = nullptr);
+
+    QJsonArray m_records;
+    QJsonArray m_child_ids;
+};
+
+#endif // COLLAPSEDSUBTREE_H
@@ -0,0 +1,262 @@
+#include "pch.h"
+
+#include "faviconfetcher.h"
+
+namespace {
+// Hosts without a favicon are retried after this many days
+constexpr int kUnavailableExpiryDays = 1;
+
+// Larger responses are not favicons
+constexpr qint64 kMaxIconBytes = 1024 * 1024;
+
+// Give up on servers that stop responding
+constexpr int kTransferTimeoutMs = 10000;
+}
+
+FaviconFetcher &FaviconFetcher::instance()
+{
+    static FaviconFetcher *fetcher = new FaviconFetcher(qApp);
+    return *fetcher;
+}
+
+FaviconFetcher::FaviconFetcher(QObject *parent)
+    : QObject(parent),
+      m_network(new QNetworkAccessManager(this)),
+      m_in_flight(0),
+      m_max_in_flight(4),
+      m_expiry_days(7)
+{
+    // Writes to the same file must not overlap
+    m_cache_pool.setMaxThreadCount(1);
+
+    m_cache_dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/favicons";
+
+    // Allow pointing the fetcher at a local stand-in server
+    QString url_template = qEnvironmentVariable("QTMINDMAP_FAVICON_URL");
+    if (!url_template.isEmpty()) {
+        m_url_template = url_template;
+    }
+
+    connect(m_network, &QNetworkAccessManager::finished, this, &FaviconFetcher::onReplyFinished);
+}
+
+FaviconFetcher::~FaviconFetcher()
+{
+    // Let pending cache writes finish
+    m_cache_pool.waitForDone();
+}
+
+QString FaviconFetcher::hostKey(const QUrl &url)
+{
+    return url.host().toLower();
+}
+
+void FaviconFetcher::fetch(const QUrl &page_url)
+{
+    QString host = hostKey(page_url);
+    if (host.isEmpty() || m_active_hosts.contains(host)) {
+        return;
+    }
+    m_active_hosts.insert(host);
+
+    // Look the host up in the disk cache off the GUI thread
+    QString icon_path = cacheFilePath(host, "png");
+    QString unavailable_path = cacheFilePath(host, "none");
+    int expiry_days = m_expiry_days;
+
+    m_cache_pool.start([this, host, page_url, icon_path, unavailable_path, expiry_days]() {
+        QDateTime now = QDateTime::currentDateTimeUtc();
+        CacheState state = CacheState::Missing;
+        QImage image;
+
+        QFileInfo icon_info(icon_path);
+        QFileInfo unavailable_info(unavailable_path);
+        if (icon_info.exists() && image.load(icon_path)) {
+            bool fresh = icon_info.lastModified().toUTC().daysTo(now) < expiry_days;
+            state = fresh ? CacheState::Fresh : CacheState::Stale;
+        } else if (unavailable_info.exists() &&
+                   unavailable_info.lastModified().toUTC().daysTo(now) < kUnavailableExpiryDays) {
+            state = CacheState::Unavailable;
+        }
+
+        QMetaObject::invokeMethod(this, [this, host, page_url, state, image]() {
+            onCacheLookupFinished(host, page_url, state, image);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void FaviconFetcher::onCacheLookupFinished(const QString &host, const QUrl &page_url,
+                                           CacheState state, const QImage &image)
+{
+    // Cancelled while the cache was being read
+    if (!m_active_hosts.contains(host)) {
+        return;
+    }
+
+    switch (state) {
+    case CacheState::Fresh:
+        m_active_hosts.remove(host);
+        emit iconFetched(host, image);
+        return;
+    case CacheState::Unavailable:
+        m_active_hosts.remove(host);
+        emit iconUnavailable(host);
+        return;
+    case CacheState::Stale:
+        // Expired icons are fetched again; the old one is only a fallback
+        // for when the server cannot be reached
+        m_stale_icons.insert(host, image);
+        break;
+    case CacheState::Missing:
+        break;
+    }
+
+    // A repeated request may already have queued the download
+    if (!m_queue.contains(host) && !m_downloading.contains(host)) {
+        m_queue.append(host);
+        m_page_urls.insert(host, page_url);
+        startDownloads();
+    }
+}
+
+void FaviconFetcher::cancel(const QString &host)
+{
+    // Downloads that already started are allowed to finish and be cached
+    if (m_downloading.contains(host)) {
+        return;
+    }
+
+    // Drop queued downloads and ignore pending cache lookups
+    if (m_queue.removeOne(host)) {
+        m_page_urls.remove(host);
+    }
+    m_active_hosts.remove(host);
+    m_stale_icons.remove(host);
+}
+
+QUrl FaviconFetcher::faviconUrl(const QUrl &page_url) const
+{
+    if (!m_url_template.isEmpty()) {
+        QString url_str = m_url_template;
+        url_str.replace("{scheme}", page_url.scheme());
+        url_str.replace("{host}", page_url.host());
+        url_str.replace("{port}", page_url.port() > 0 ? QString::number(page_url.port()) : QString());
+        return QUrl(url_str);
+    }
+
+    // Default to /favicon.ico on the page's own server
+    QUrl url;
+    url.setScheme(page_url.scheme());
+    url.setHost(page_url.host());
+    url.setPort(page_url.port());
+    url.setPath("/favicon.ico");
+    return url;
+}
+
+void FaviconFetcher::startDownloads()
+{
+    while (m_in_flight < m_max_in_flight && !m_queue.isEmpty()) {
+        QString host = m_queue.takeFirst();
+        QUrl page_url = m_page_urls.take(host);
+
+        QNetworkRequest request(faviconUrl(page_url));
+        request.setAttribute(QNetworkRequest::RedirectPolicyAttribute,
+                             QNetworkRequest::NoLessSafeRedirectPolicy);
+        request.setTransferTimeout(kTransferTimeoutMs);
+
+        QNetworkReply *reply = m_network->get(request);
+        reply->setProperty("host", host);
+
+        // Stop oversized responses as soon as they show, instead of
+        // downloading them whole
+        connect(reply, &QNetworkReply::downloadProgress, reply, [reply](qint64 received, qint64 total) {
+            if (received > kMaxIconBytes || total > kMaxIconBytes) {
+                reply->setProperty("too_large", true);
+                reply->abort();
+            }
+        });
+        m_downloading.insert(host);
+        ++m_in_flight;
+    }
+}
+
+void FaviconFetcher::onReplyFinished(QNetworkReply *reply)
+{
+    reply->deleteLater();
+    --m_in_flight;
+
+    QString host = reply->property("host").toString();
+    m_downloading.remove(host);
+    m_active_hosts.remove(host);
+    QImage stale_image = m_stale_icons.take(host);
+
+    // Decode the favicon (small, so this is cheap on the GUI thread)
+    QImage image;
+    bool too_large = reply->property("too_large").toBool();
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (reply->error() == QNetworkReply::NoError && status == 200) {
+        QByteArray data = reply->read(kMaxIconBytes + 1);
+        if (data.size() > kMaxIconBytes || !image.loadFromData(data)) {
+            image = QImage();
+        }
+    }
+
+    QString icon_path = cacheFilePath(host, "png");
+    QString unavailable_path = cacheFilePath(host, "none");
+
+    if (!image.isNull()) {
+        // Store as PNG so every cached icon decodes the same way
+        QByteArray png_data;
+        QBuffer buffer(&png_data);
+        buffer.open(QIODevice::WriteOnly);
+        image.save(&buffer, "PNG");
+
+        m_cache_pool.start([icon_path, unavailable_path, png_data]() {
+            storeInCache(icon_path, unavailable_path, png_data);
+        });
+        emit iconFetched(host, image);
+    } else {
+        qDebug() << "No favicon for" << host << "-"
+                 << (too_large ? QString("response too large") : reply->errorString());
+
+        // Remember the miss only for real answers, not for network failures
+        if (reply->error() == QNetworkReply::NoError ||
+            reply->error() == QNetworkReply::ContentNotFoundError || too_large) {
+            m_cache_pool.start([icon_path, unavailable_path]() {
+                storeInCache(icon_path, unavailable_path, QByteArray());
+            });
+            emit iconUnavailable(host);
+        } else if (!stale_image.isNull()) {
+            emit iconFetched(host, stale_image);
+        } else {
+            emit iconUnavailable(host);
+        }
+    }
+
+    startDownloads();
+}
+
+QString FaviconFetcher::cacheFilePath(const QString &host, const QString &suffix) const
+{
+    // Keep host names safe for use as file names
+    static const QRegularExpression unsafe_chars("[^a-z0-9._-]");
+    QString file_name = host;
+    file_name.replace(unsafe_chars, "_");
+    return m_cache_dir + "/" + file_name + "." + suffix;
+}
+
+void FaviconFetcher::storeInCache(const QString &icon_path, const QString &unavailable_path,
+                                  const QByteArray &data)
+{
+    QDir().mkpath(QFileInfo(icon_path).absolutePath());
+
+    // An empty payload marks a host without favicon
+    QString file_path = data.isEmpty() ? unavailable_path : icon_path;
+    QFile::remove(data.isEmpty() ? icon_path : unavailable_path);
+
+    QSaveFile cache_file(file_path);
+    if (cache_file.open(QIODevice::WriteOnly)) {
+        cache_file.write(data);
+        cache_file.commit();
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef FAVICONFETCHER_H
+#define FAVICONFETCHER_H
+
+#include "pch.h"
+
+// Fetches website favicons asynchronously.
+//
+// Requests are deduplicated by host and at most a few downloads run at a
+// time. Results (including "no favicon" answers) are kept in an on-disk
+// cache with an expiry, so known hosts are answered without any network
+// traffic. Cache lookups and writes run on a worker thread, so callers on
+// the GUI thread never block.
+class FaviconFetcher : public QObject
+{
+    Q_OBJECT
+public:
+    static FaviconFetcher &instance();
+    ~FaviconFetcher();
+
+    // Fetch the favicon of the site a page URL belongs to
+    void fetch(const QUrl &page_url);
+
+    // Drop a request for a host that has not started downloading yet
+    void cancel(const QString &host);
+
+    // Override the favicon URL, e.g. "http://127.0.0.1:8000/icons/{host}.ico".
+    // Supported placeholders are {scheme}, {host} and {port}. An empty
+    // template fetches /favicon.ico from the page's own server.
+    void setUrlTemplate(const QString &url_template) { m_url_template = url_template; }
+
+    // Maximum number of simultaneous downloads
+    void setMaxInFlight(int max_in_flight) { m_max_in_flight = qMax(1, max_in_flight); }
+
+    // Directory of the on-disk cache and lifetime of its entries
+    void setCacheDirectory(const QString &dir_path) { m_cache_dir = dir_path; }
+    void setCacheExpiry(int days) { m_expiry_days = days; }
+
+    // Wait for pending cache writes, e.g. before the cache directory is removed
+    void waitForCacheWrites() { m_cache_pool.waitForDone(); }
+
+signals:
+    // Emitted once per request with the decoded favicon
+    void iconFetched(const QString &host, const QImage &image);
+
+    // Emitted when the host has no usable favicon
+    void iconUnavailable(const QString &host);
+
+private:
+    explicit FaviconFetcher(QObject *parent = nullptr);
+
+    // Result of looking up a host in the disk cache
+    enum class CacheState { Missing, Fresh, Stale, Unavailable };
+
+    void onCacheLookupFinished(const QString &host, const QUrl &page_url,
+                               CacheState state, const QImage &image);
+    void startDownloads();
+    void onReplyFinished(QNetworkReply *reply);
+
+    QUrl faviconUrl(const QUrl &page_url) const;
+    QString cacheFilePath(const QString &host, const QString &suffix) const;
+
+    // Record a result in the disk cache (runs on the cache thread)
+    static void storeInCache(const QString &icon_path, const QString &unavailable_path,
+                             const QByteArray &data);
+
+    static QString hostKey(const QUrl &url);
+
+    QNetworkAccessManager *m_network;
+    QThreadPool m_cache_pool;
+
+    QSet<QString> m_active_hosts;       // Looked up, queued or downloading
+    QStringList m_queue;                // Hosts waiting for a download slot
+    QSet<QString> m_downloading;        // Hosts with a running download
+    QHash<QString, QUrl> m_page_urls;   // Page URL of each queued host
+    QHash<QString, QImage> m_stale_icons; // Expired cached icons being refetched
+    int m_in_flight;
+
+    QString m_url_template;
+    QString m_cache_dir;
+    int m_max_in_flight;
+    int m_expiry_days;
+};
+
+#endif // FAVICONFETCHER_H
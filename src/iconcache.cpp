@@ -0,0 +1,382 @@
+#include "pch.h"
+
+#include "iconcache.h"
+#include "trace.h"
+
+namespace {
+// Disk cache file header
+constexpr quint32 kCacheMagic = 0x51494343; // "QICC"
+constexpr quint32 kCacheVersion = 1;
+
+// Common audio file extensions
+const QStringList &audioExtensions() {
+    static const QStringList extensions = {
+        "mp3", "wav", "ogg", "flac", "aac", "wma", "m4a", "aiff"
+    };
+    return extensions;
+}
+
+// Common video file extensions
+const QStringList &videoExtensions() {
+    static const QStringList extensions = {
+        "mp4", "avi", "mov", "wmv", "mkv", "flv", "webm", "m4v", "mpg", "mpeg"
+    };
+    return extensions;
+}
+
+// Identifies the environment the cached icons were rendered for
+QString cacheSignature() {
+    return QSysInfo::prettyProductName() + "|" + QIcon::themeName() + "|" + QT_VERSION_STR;
+}
+}
+
+IconCache &IconCache::instance()
+{
+    static IconCache cache;
+    return cache;
+}
+
+IconCache::IconCache()
+    : m_loaded(false), m_dirty(false)
+{
+}
+
+QFileIconProvider &IconCache::provider()
+{
+    // Created on first use, once QApplication exists
+    if (!m_provider) {
+        m_provider.reset(new QFileIconProvider());
+    }
+    return *m_provider;
+}
+
+// Check if the platform draws an individual icon for this file
+bool IconCache::hasPerFileIcon(const QString &file_path)
+{
+#ifdef Q_OS_WIN
+    // Executables, shortcuts and icon files carry their own icon
+    static const QStringList per_file_suffixes = {
+        "exe", "lnk", "ico", "cur", "ani", "url"
+    };
+    return per_file_suffixes.contains(QFileInfo(file_path).suffix().toLower());
+#else
+    Q_UNUSED(file_path);
+    return false;
+#endif
+}
+
+// Get the cache key for a file path
+QString IconCache::fileKey(const QString &file_path)
+{
+    if (hasPerFileIcon(file_path)) {
+        return "path:" + QDir::cleanPath(file_path);
+    }
+    return "suffix:" + QFileInfo(file_path).suffix().toLower();
+}
+
+QString IconCache::scaledKey(const QString &key) const
+{
+    return key + "@" + QString::number(qApp->devicePixelRatio());
+}
+
+QPixmap IconCache::find(const QString &key) const
+{
+    return m_pixmaps.value(scaledKey(key));
+}
+
+void IconCache::insert(const QString &key, const QPixmap &pixmap)
+{
+    m_pixmaps.insert(scaledKey(key), pixmap);
+    if (isPersistentKey(key)) {
+        m_dirty = true;
+    }
+}
+
+QPixmap IconCache::toPixmap(const QIcon &icon) const
+{
+    // High-DPI pixmaps carry the screen's device pixel ratio
+    QPixmap pixmap = icon.pixmap(kIconSize, kIconSize);
+
+    // If we got an empty pixmap, use a default
+    if (pixmap.isNull()) {
+        pixmap = QPixmap(kIconSize, kIconSize);
+        pixmap.fill(Qt::transparent);
+    }
+
+    return pixmap;
+}
+
+// Get file icon
+QPixmap IconCache::fileIcon(const QString &file_path)
+{
+    TRACE_SCOPE("IconCache::fileIcon", "icons");
+
+    load();
+
+    QString key = fileKey(file_path);
+    QPixmap pixmap = find(key);
+    if (!pixmap.isNull()) {
+        return pixmap;
+    }
+
+    if (hasPerFileIcon(file_path)) {
+        pixmap = toPixmap(provider().icon(QFileInfo(file_path)));
+    } else {
+        // Resolve by name only so the provider never touches the file itself
+        QString suffix = QFileInfo(file_path).suffix();
+        QFileInfo probe(suffix.isEmpty() ? QString("icon_probe") : "icon_probe." + suffix);
+        pixmap = toPixmap(provider().icon(probe));
+    }
+
+    insert(key, pixmap);
+    return pixmap;
+}
+
+// Get the generic file icon
+QPixmap IconCache::placeholderIcon()
+{
+    load();
+
+    QString key = "type:file";
+    QPixmap pixmap = find(key);
+    if (pixmap.isNull()) {
+        pixmap = toPixmap(provider().icon(QFileIconProvider::File));
+        insert(key, pixmap);
+    }
+    return pixmap;
+}
+
+// Get directory icon
+QPixmap IconCache::directoryIcon(const QString &dir_path)
+{
+    TRACE_SCOPE("IconCache::directoryIcon", "icons");
+
+    load();
+
+    // Drive roots have their own icon, all other folders share one
+    bool is_root = QDir(dir_path).isRoot();
+    QString key = is_root ? "path:" + QDir::cleanPath(dir_path) : QString("type:folder");
+
+    QPixmap pixmap = find(key);
+    if (!pixmap.isNull()) {
+        return pixmap;
+    }
+
+    QIcon icon = is_root ? provider().icon(QFileIconProvider::Drive)
+                         : provider().icon(QFileIconProvider::Folder);
+    pixmap = toPixmap(icon);
+
+    insert(key, pixmap);
+    return pixmap;
+}
+
+// Get media file icon
+QPixmap IconCache::mediaIcon(const QString &media_path)
+{
+    load();
+
+    QString suffix = QFileInfo(media_path).suffix().toLower();
+    QString key = "media:" + suffix;
+
+    QPixmap pixmap = find(key);
+    if (!pixmap.isNull()) {
+        return pixmap;
+    }
+
+    QFileInfo probe("icon_probe." + suffix);
+    pixmap = provider().icon(probe).pixmap(kIconSize, kIconSize);
+
+    // Draw a media-specific default icon if the provider has none
+    if (pixmap.isNull()) {
+        pixmap = drawMediaIcon(suffix);
+    }
+
+    insert(key, pixmap);
+    return pixmap;
+}
+
+// Get website icon
+QPixmap IconCache::websiteIcon(const QUrl &url)
+{
+    QString host = url.host().toLower();
+    QString key = "host:" + host;
+
+    QPixmap pixmap = find(key);
+    if (!pixmap.isNull()) {
+        return pixmap;
+    }
+
+    pixmap = drawWebsiteIcon(host);
+    insert(key, pixmap);
+    return pixmap;
+}
+
+QPixmap IconCache::drawMediaIcon(const QString &suffix) const
+{
+    qreal dpr = qApp->devicePixelRatio();
+    QPixmap pixmap(QSize(kIconSize, kIconSize) * dpr);
+    pixmap.setDevicePixelRatio(dpr);
+    pixmap.fill(Qt::transparent);
+
+    QPainter painter(&pixmap);
+
+    if (audioExtensions().contains(suffix)) {
+        // Audio icon (blue)
+        painter.setBrush(QColor(100, 149, 237)); // Cornflower blue
+        painter.setPen(Qt::black);
+        painter.drawEllipse(8, 8, 48, 48);
+
+        // Draw audio wave symbol
+        QPainterPath path;
+        path.moveTo(24, 22);
+        path.lineTo(24, 42);
+        path.moveTo(32, 18);
+        path.lineTo(32, 46);
+        path.moveTo(40, 22);
+        path.lineTo(40, 42);
+
+        painter.setPen(QPen(Qt::white, 3));
+        painter.drawPath(path);
+    }
+    else if (videoExtensions().contains(suffix)) {
+        // Video icon (red)
+        painter.setBrush(QColor(205, 92, 92)); // Indian red
+        painter.setPen(Qt::black);
+        painter.drawRect(8, 8, 48, 48);
+
+        // Draw video play symbol
+        QPolygonF triangle;
+        triangle << QPointF(24, 18) << QPointF(44, 32) << QPointF(24, 46);
+
+        painter.setBrush(Qt::white);
+        painter.setPen(Qt::NoPen);
+        painter.drawPolygon(triangle);
+    }
+
+    return pixmap;
+}
+
+QPixmap IconCache::drawWebsiteIcon(const QString &host) const
+{
+    // Create a default icon with domain initial
+    qreal dpr = qApp->devicePixelRatio();
+    QPixmap pixmap(QSize(kIconSize, kIconSize) * dpr);
+    pixmap.setDevicePixelRatio(dpr);
+    pixmap.fill(Qt::lightGray);
+
+    QPainter painter(&pixmap);
+    painter.setPen(Qt::blue);
+    painter.setFont(QFont("Arial", 32, QFont::Bold));
+
+    QString letter = host.isEmpty() ? QString("W") : QString(host.at(0).toUpper());
+    painter.drawText(QRect(0, 0, kIconSize, kIconSize), Qt::AlignCenter, letter);
+
+    return pixmap;
+}
+
+// Only provider icons keyed by type are worth persisting; per-file icons may
+// change and website glyphs are cheap to redraw
+bool IconCache::isPersistentKey(const QString &key)
+{
+    return key.startsWith("suffix:") || key.startsWith("type:") || key.startsWith("media:");
+}
+
+QString IconCache::cacheFilePath() const
+{
+    QString cache_path = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    return cache_path + "/icon_cache.bin";
+}
+
+// Restore icons cached by a previous session
+void IconCache::load()
+{
+    if (m_loaded) {
+        return;
+    }
+    TRACE_SCOPE("IconCache::load", "icons");
+
+    m_loaded = true;
+
+    QFile cache_file(cacheFilePath());
+    if (!cache_file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    QDataStream stream(&cache_file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    QString signature;
+    stream >> magic >> version;
+    if (magic != kCacheMagic || version != kCacheVersion) {
+        qWarning() << "Ignoring incompatible icon cache:" << cache_file.fileName();
+        return;
+    }
+
+    // Icons rendered for another platform, theme or Qt version are stale
+    stream >> signature;
+    if (signature != cacheSignature()) {
+        qDebug() << "Icon cache signature changed, rebuilding";
+        return;
+    }
+
+    QHash<QString, QPixmap> pixmaps;
+    stream >> pixmaps;
+    if (stream.status() != QDataStream::Ok) {
+        qWarning() << "Failed to read icon cache:" << cache_file.fileName();
+        return;
+    }
+
+    // Streamed pixmaps lose their device pixel ratio, restore it from the key
+    for (auto it = pixmaps.begin(); it != pixmaps.end(); ++it) {
+        it.value().setDevicePixelRatio(it.key().section('@', -1).toDouble());
+    }
+
+    m_pixmaps.insert(pixmaps);
+    qDebug() << "Loaded" << pixmaps.size() << "cached icons";
+}
+
+// Write the persistent part of the cache to disk
+void IconCache::save()
+{
+    TRACE_SCOPE("IconCache::save", "icons");
+
+    if (!m_dirty) {
+        return;
+    }
+
+    QHash<QString, QPixmap> pixmaps;
+    for (auto it = m_pixmaps.constBegin(); it != m_pixmaps.constEnd(); ++it) {
+        if (isPersistentKey(it.key())) {
+            pixmaps.insert(it.key(), it.value());
+        }
+    }
+
+    QString file_path = cacheFilePath();
+    QDir().mkpath(QFileInfo(file_path).absolutePath());
+
+    QSaveFile cache_file(file_path);
+    if (!cache_file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to open icon cache for writing:" << file_path;
+        return;
+    }
+
+    QDataStream stream(&cache_file);
+    stream << kCacheMagic << kCacheVersion << cacheSignature() << pixmaps;
+
+    if (cache_file.commit()) {
+        m_dirty = false;
+        qDebug() << "Saved" << pixmaps.size() << "icons to cache";
+    }
+}
+
+void IconCache::release()
+{
+    m_pixmaps.clear();
+    m_provider.reset();
+}
+
+void IconCache::shutdown()
+{
+    save();
+    release();
+}
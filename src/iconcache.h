@@ -0,0 +1,75 @@
+#ifndef ICONCACHE_H
+#define ICONCACHE_H
+
+#include "pch.h"
+
+// Process-wide cache of file, folder, media and website icons.
+//
+// Icons are keyed by file suffix or item type (or by path where the icon is
+// really per-file, e.g. executables on Windows) plus the device pixel ratio,
+// so loading a map with thousands of links only asks QFileIconProvider once
+// per file type. Returned pixmaps are implicitly shared. Provider icons are
+// persisted to disk and reused by later sessions.
+class IconCache
+{
+public:
+    // Logical edge length of all cached icons
+    static constexpr int kIconSize = 64;
+
+    static IconCache &instance();
+
+    // Icon getters (cached)
+    QPixmap fileIcon(const QString &file_path);
+    QPixmap directoryIcon(const QString &dir_path);
+    QPixmap mediaIcon(const QString &media_path);
+    QPixmap websiteIcon(const QUrl &url);
+
+    // Cache key used for a file path
+    static QString fileKey(const QString &file_path);
+
+    // Whether the platform draws an individual icon for this file
+    static bool hasPerFileIcon(const QString &file_path);
+
+    // Generic file icon shown while the real one is being resolved
+    QPixmap placeholderIcon();
+
+    // Look up or insert an entry (the device pixel ratio is added to the key)
+    QPixmap find(const QString &key) const;
+    void insert(const QString &key, const QPixmap &pixmap);
+
+    // Write the persistent part of the cache to disk
+    void save();
+
+    // Drop all pixmaps and the icon provider. Must run while QApplication
+    // still exists, as the cache itself lives until static destruction.
+    void release();
+
+    // Save and release when the application exits
+    void shutdown();
+
+private:
+    IconCache();
+
+    QString scaledKey(const QString &key) const;
+
+    // Convert a provider icon to a pixmap, falling back to a transparent tile
+    QPixmap toPixmap(const QIcon &icon) const;
+
+    // Draw fallback icons
+    QPixmap drawMediaIcon(const QString &suffix) const;
+    QPixmap drawWebsiteIcon(const QString &host) const;
+
+    // Disk persistence
+    void load();
+    QString cacheFilePath() const;
+    static bool isPersistentKey(const QString &key);
+
+    QFileIconProvider &provider();
+
+    std::unique_ptr<QFileIconProvider> m_provider;
+    QHash<QString, QPixmap> m_pixmaps;
+    bool m_loaded;
+    bool m_dirty;
+};
+
+#endif // ICONCACHE_H
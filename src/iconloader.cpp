@@ -0,0 +1,317 @@
+#include "pch.h"
+
+#include "iconloader.h"
+#include "iconcache.h"
+#include "faviconfetcher.h"
+#include "infinitecanvas.h"
+#include "trace.h"
+
+IconLoader *IconLoader::s_instance = nullptr;
+
+IconLoader &IconLoader::instance()
+{
+    if (!s_instance) {
+        s_instance = new IconLoader(qApp);
+    }
+    return *s_instance;
+}
+
+IconLoader::IconLoader(QObject *parent)
+    : QObject(parent), m_synchronous(false)
+{
+    // A few threads are enough to hide file system latency
+    m_pool.setMaxThreadCount(4);
+
+    // Swap fetched favicons into waiting URL items
+    FaviconFetcher &fetcher = FaviconFetcher::instance();
+    connect(&fetcher, &FaviconFetcher::iconFetched, this, &IconLoader::onFaviconFetched);
+    connect(&fetcher, &FaviconFetcher::iconUnavailable, this, &IconLoader::onFaviconUnavailable);
+}
+
+IconLoader::~IconLoader()
+{
+    // Drop queued lookups and wait for running ones
+    for (PendingIcon &pending : m_pending) {
+        pending.cancelled->storeRelaxed(1);
+    }
+    m_pool.clear();
+    m_pool.waitForDone();
+
+    s_instance = nullptr;
+}
+
+void IconLoader::requestFileIcon(QGraphicsItem *item, const QString &file_path)
+{
+    if (!item) {
+        return;
+    }
+
+    // Replace any earlier request of this item
+    cancel(item);
+
+    IconCache &cache = IconCache::instance();
+    QString key = IconCache::fileKey(file_path);
+
+    // Icons that are cached or need no file access are applied right away
+    QPixmap cached = cache.find(key);
+    if (!cached.isNull() || !IconCache::hasPerFileIcon(file_path) || m_synchronous) {
+        applyIcon(item, cached.isNull() ? cache.fileIcon(file_path) : cached);
+        return;
+    }
+
+    // Show the placeholder until the real icon arrives
+    applyIcon(item, cache.placeholderIcon());
+    if (addPending(key, item)) {
+        return;
+    }
+
+    QSharedPointer<QAtomicInt> cancelled = m_pending[key].cancelled;
+    qreal dpr = qApp->devicePixelRatio();
+    m_pool.start([this, key, file_path, cancelled, dpr]() {
+        // Skip lookups whose items were deleted while queued
+        if (cancelled->loadRelaxed()) {
+            return;
+        }
+
+        QImage image = readFileIcon(file_path, qRound(IconCache::kIconSize * dpr));
+        QMetaObject::invokeMethod(this, [this, key, image, dpr]() {
+            // Pixmaps are only created here, on the GUI thread; the result is
+            // cached so later requests are answered immediately
+            QPixmap pixmap;
+            if (!image.isNull()) {
+                QImage scaled = image.scaled(QSize(IconCache::kIconSize, IconCache::kIconSize) * dpr,
+                                             Qt::KeepAspectRatio, Qt::SmoothTransformation);
+                scaled.setDevicePixelRatio(dpr);
+                pixmap = QPixmap::fromImage(scaled);
+                IconCache::instance().insert(key, pixmap);
+            }
+            deliver(key, pixmap);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void IconLoader::requestWebsiteIcon(QGraphicsItem *item, const QUrl &url)
+{
+    if (!item) {
+        return;
+    }
+
+    // Replace any earlier request of this item
+    cancel(item);
+
+    IconCache &cache = IconCache::instance();
+    QString host = url.host().toLower();
+    QString key = "favicon:" + host;
+
+    // Favicons fetched earlier in this session are applied right away
+    QPixmap cached = cache.find(key);
+    if (!cached.isNull()) {
+        applyIcon(item, cached);
+        return;
+    }
+
+    // Show the letter glyph meanwhile (and for good without network access)
+    applyIcon(item, cache.websiteIcon(url));
+    bool is_web = url.scheme() == "http" || url.scheme() == "https";
+    if (host.isEmpty() || !is_web || m_synchronous) {
+        return;
+    }
+
+    if (!addPending(key, item)) {
+        FaviconFetcher::instance().fetch(url);
+    }
+}
+
+bool IconLoader::addPending(const QString &key, QGraphicsItem *item)
+{
+    m_item_keys.insert(item, key);
+
+    // Join a lookup that is already running for the same icon
+    auto it = m_pending.find(key);
+    if (it != m_pending.end()) {
+        it->items.append(item);
+        return true;
+    }
+
+    PendingIcon pending;
+    pending.items.append(item);
+    pending.cancelled.reset(new QAtomicInt(0));
+    m_pending.insert(key, pending);
+    return false;
+}
+
+#ifdef Q_OS_WIN
+// Copy the color bitmap of a shell icon into an image
+static QImage imageFromIcon(HICON icon)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    return QImage::fromHICON(icon);
+#else
+    ICONINFO info;
+    if (!GetIconInfo(icon, &info)) {
+        return QImage();
+    }
+
+    QImage image;
+    BITMAP bitmap;
+    if (info.hbmColor && GetObject(info.hbmColor, sizeof(bitmap), &bitmap)) {
+        BITMAPINFO bitmap_info = {};
+        bitmap_info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        bitmap_info.bmiHeader.biWidth = bitmap.bmWidth;
+        bitmap_info.bmiHeader.biHeight = -bitmap.bmHeight; // Top-down rows
+        bitmap_info.bmiHeader.biPlanes = 1;
+        bitmap_info.bmiHeader.biBitCount = 32;
+        bitmap_info.bmiHeader.biCompression = BI_RGB;
+
+        image = QImage(bitmap.bmWidth, bitmap.bmHeight, QImage::Format_ARGB32_Premultiplied);
+        HDC dc = GetDC(nullptr);
+        if (!GetDIBits(dc, info.hbmColor, 0, bitmap.bmHeight, image.bits(), &bitmap_info,
+                       DIB_RGB_COLORS)) {
+            image = QImage();
+        }
+        ReleaseDC(nullptr, dc);
+
+        // Old icons leave the alpha channel empty and are fully opaque
+        bool has_alpha = false;
+        for (int y = 0; y < image.height() && !has_alpha; ++y) {
+            const QRgb *line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+            for (int x = 0; x < image.width() && !has_alpha; ++x) {
+                has_alpha = qAlpha(line[x]) != 0;
+            }
+        }
+        if (!image.isNull() && !has_alpha) {
+            image.reinterpretAsFormat(QImage::Format_RGB32);
+        }
+    }
+
+    if (info.hbmColor) {
+        DeleteObject(info.hbmColor);
+    }
+    if (info.hbmMask) {
+        DeleteObject(info.hbmMask);
+    }
+    return image;
+#endif
+}
+#endif
+
+QImage IconLoader::readFileIcon(const QString &file_path, int size)
+{
+    TRACE_SCOPE("IconLoader::readFileIcon", "icons");
+
+    QImage image;
+
+#ifdef Q_OS_WIN
+    // The shell icon API needs COM on this thread
+    HRESULT hr = CoInitialize(NULL);
+
+    // Ask the shell directly: QFileIconProvider and QIcon produce pixmaps,
+    // which are GUI-thread only
+    SHFILEINFOW file_info = {};
+    QString native_path = QDir::toNativeSeparators(file_path);
+    if (SHGetFileInfoW(reinterpret_cast<LPCWSTR>(native_path.utf16()), 0, &file_info,
+                       sizeof(file_info), SHGFI_SYSICONINDEX)) {
+        // The smallest system image list that is at least as large as wanted
+        int list = size > 48 ? SHIL_JUMBO : (size > 32 ? SHIL_EXTRALARGE : SHIL_LARGE);
+        IImageList *image_list = nullptr;
+        if (SUCCEEDED(SHGetImageList(list, IID_IImageList,
+                                     reinterpret_cast<void**>(&image_list)))) {
+            HICON icon = nullptr;
+            if (SUCCEEDED(image_list->GetIcon(file_info.iIcon, ILD_TRANSPARENT, &icon)) && icon) {
+                image = imageFromIcon(icon);
+                DestroyIcon(icon);
+            }
+            image_list->Release();
+        }
+    }
+
+    if (SUCCEEDED(hr)) {
+        CoUninitialize();
+    }
+#else
+    // Only the Windows shell has per-file icons
+    Q_UNUSED(file_path);
+    Q_UNUSED(size);
+#endif
+
+    return image;
+}
+
+void IconLoader::deliver(const QString &key, const QPixmap &pixmap)
+{
+    auto it = m_pending.find(key);
+    if (it == m_pending.end()) {
+        return;
+    }
+    QList<QGraphicsItem*> items = it->items;
+    m_pending.erase(it);
+
+    // Swap the icon into every waiting item
+    for (QGraphicsItem *item : items) {
+        m_item_keys.remove(item);
+        if (!pixmap.isNull()) {
+            applyIcon(item, pixmap);
+        }
+    }
+}
+
+void IconLoader::onFaviconFetched(const QString &host, const QImage &image)
+{
+    // Favicons come in all sizes, show them at the common icon size
+    qreal dpr = qApp->devicePixelRatio();
+    QImage scaled = image.scaled(QSize(IconCache::kIconSize, IconCache::kIconSize) * dpr,
+                                 Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    scaled.setDevicePixelRatio(dpr);
+
+    QString key = "favicon:" + host;
+    QPixmap pixmap = QPixmap::fromImage(scaled);
+    IconCache::instance().insert(key, pixmap);
+    deliver(key, pixmap);
+}
+
+void IconLoader::onFaviconUnavailable(const QString &host)
+{
+    // Items keep their letter glyph
+    deliver("favicon:" + host, QPixmap());
+}
+
+void IconLoader::applyIcon(QGraphicsItem *item, const QPixmap &pixmap)
+{
+    if (IconLabelItem *label_item = dynamic_cast<IconLabelItem*>(item)) {
+        label_item->setIcon(pixmap);
+    } else if (QGraphicsPixmapItem *pixmap_item = dynamic_cast<QGraphicsPixmapItem*>(item)) {
+        pixmap_item->setPixmap(pixmap);
+    }
+}
+
+void IconLoader::cancelRequests(QGraphicsItem *item)
+{
+    // Nothing can be pending if the loader was never created
+    if (s_instance) {
+        s_instance->cancel(item);
+    }
+}
+
+void IconLoader::cancel(QGraphicsItem *item)
+{
+    auto key_it = m_item_keys.find(item);
+    if (key_it == m_item_keys.end()) {
+        return;
+    }
+
+    auto it = m_pending.find(key_it.value());
+    m_item_keys.erase(key_it);
+    if (it == m_pending.end()) {
+        return;
+    }
+
+    // Cancel the lookup once no item is waiting for it
+    it->items.removeOne(item);
+    if (it->items.isEmpty()) {
+        it->cancelled->storeRelaxed(1);
+        if (it.key().startsWith("favicon:")) {
+            FaviconFetcher::instance().cancel(it.key().mid(8));
+        }
+        m_pending.erase(it);
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef ICONLOADER_H
+#define ICONLOADER_H
+
+#include "pch.h"
+
+// Resolves icons that need file system access on a worker pool.
+//
+// Items show a generic placeholder immediately; once the real icon has been
+// read it is stored in the IconCache and swapped into every item waiting for
+// it. Requests for the same icon are shared, and deleting an item cancels
+// its request.
+class IconLoader : public QObject
+{
+    Q_OBJECT
+public:
+    static IconLoader &instance();
+    ~IconLoader();
+
+    // Give an item the icon for a file, asynchronously if it needs file access.
+    // Supports IconLabelItem and QGraphicsPixmapItem based items.
+    void requestFileIcon(QGraphicsItem *item, const QString &file_path);
+
+    // Give an item the favicon of a website. The item shows the letter glyph
+    // until the favicon has been fetched (or for good if there is none).
+    void requestWebsiteIcon(QGraphicsItem *item, const QUrl &url);
+
+    // Forget pending requests of an item (safe to call from item destructors)
+    static void cancelRequests(QGraphicsItem *item);
+
+    // Resolve icons on the calling thread instead of the worker pool
+    void setSynchronous(bool synchronous) { m_synchronous = synchronous; }
+
+private:
+    explicit IconLoader(QObject *parent = nullptr);
+
+    // Apply an icon to a waiting item
+    static void applyIcon(QGraphicsItem *item, const QPixmap &pixmap);
+
+    // Register an item as waiting for a key; returns true if a lookup
+    // for that key is already running
+    bool addPending(const QString &key, QGraphicsItem *item);
+
+    // Hand a resolved icon to all waiting items (null keeps their current icon)
+    void deliver(const QString &key, const QPixmap &pixmap);
+
+    // Favicon results
+    void onFaviconFetched(const QString &host, const QImage &image);
+    void onFaviconUnavailable(const QString &host);
+
+    // Read an icon of the given pixel size from the shell (runs on a worker
+    // thread, so it must not create pixmaps)
+    static QImage readFileIcon(const QString &file_path, int size);
+
+    void cancel(QGraphicsItem *item);
+
+    struct PendingIcon {
+        QList<QGraphicsItem*> items;
+        QSharedPointer<QAtomicInt> cancelled; // Set when nobody waits anymore
+    };
+
+    static IconLoader *s_instance;
+
+    QThreadPool m_pool;
+    QHash<QString, PendingIcon> m_pending;      // Keyed by icon cache key
+    QHash<QGraphicsItem*, QString> m_item_keys; // Pending key of each item
+    bool m_synchronous;
+};
+
+#endif // ICONLOADER_H
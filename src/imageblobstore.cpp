@@ -0,0 +1,158 @@
+#include "pch.h"
+
+#include "imageblobstore.h"
+#include "infinitecanvas.h"
+#include "trace.h"
+
+QString ImageBlobStore::add(ImageItem *item)
+{
+    TRACE_SCOPE("ImageBlobStore::add", "save");
+
+    ImageSource source = item->source();
+
+    // Items loaded from an embedded map already know their key and data
+    if (source.isEmbedded() && !source.blob_key.isEmpty()) {
+        if (!m_blobs.contains(source.blob_key)) {
+            QJsonObject blob;
+            blob["width"] = item->imageSize().width();
+            blob["height"] = item->imageSize().height();
+            blob["data"] = QString::fromLatin1(source.data_is_base64 ? source.data
+                                                                     : source.data.toBase64());
+            blob["thumbnail"] = QString::fromLatin1(source.thumbnail.toBase64());
+            m_blobs.insert(source.blob_key, blob);
+        }
+        return source.blob_key;
+    }
+
+    QByteArray data = encodeSource(source);
+    if (data.isEmpty()) {
+        qWarning() << "Failed to read image for embedding:" << source.file_path;
+        return QString();
+    }
+
+    // Identical images share one blob
+    QString key = "sha256:" + QString::fromLatin1(
+        QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex());
+
+    QByteArray thumbnail;
+    QSize image_size;
+    if (m_blobs.contains(key)) {
+        QJsonObject blob = m_blobs.value(key).toObject();
+        thumbnail = QByteArray::fromBase64(blob["thumbnail"].toString().toLatin1());
+        image_size = QSize(blob["width"].toInt(), blob["height"].toInt());
+    } else {
+        thumbnail = createThumbnail(data, &image_size);
+
+        QJsonObject blob;
+        blob["width"] = image_size.width();
+        blob["height"] = image_size.height();
+        blob["data"] = QString::fromLatin1(data.toBase64());
+        blob["thumbnail"] = QString::fromLatin1(thumbnail.toBase64());
+        m_blobs.insert(key, blob);
+    }
+
+    // Images with a file keep reading it, so their data is only held until
+    // the document is written
+    if (!source.file_path.isEmpty()) {
+        return key;
+    }
+
+    // Other images switch to the encoded data, one copy per distinct image
+    auto it = m_sources.find(key);
+    if (it == m_sources.end()) {
+        ImageSource embedded;
+        embedded.blob_key = key;
+        embedded.data = data;
+        embedded.thumbnail = thumbnail;
+        embedded.image_size = image_size;
+        it = m_sources.insert(key, embedded);
+    }
+    item->embed(it.value());
+    return key;
+}
+
+void ImageBlobStore::fromJson(const QJsonObject &blobs)
+{
+    m_blobs = blobs;
+    m_sources.clear();
+}
+
+ImageSource ImageBlobStore::source(const QString &key, const QString &file_path)
+{
+    auto it = m_sources.find(key);
+    if (it == m_sources.end()) {
+        QJsonObject blob = m_blobs.value(key).toObject();
+
+        // The image data stays base64 encoded until it is decoded
+        ImageSource source;
+        source.blob_key = key;
+        source.data = blob["data"].toString().toLatin1();
+        source.data_is_base64 = true;
+        source.thumbnail = QByteArray::fromBase64(blob["thumbnail"].toString().toLatin1());
+        source.image_size = QSize(blob["width"].toInt(), blob["height"].toInt());
+        it = m_sources.insert(key, source);
+    }
+
+    ImageSource source = it.value();
+    source.file_path = file_path;
+    return source;
+}
+
+QByteArray ImageBlobStore::encodeSource(const ImageSource &source)
+{
+    // Embed image files as they are
+    if (!source.file_path.isEmpty()) {
+        QFile file(source.file_path);
+        if (file.open(QIODevice::ReadOnly)) {
+            return file.readAll();
+        }
+    }
+
+    return QByteArray();
+}
+
+ImageSource ImageBlobStore::fromImage(const QImage &image)
+{
+    TRACE_SCOPE("ImageBlobStore::fromImage", "images");
+
+    ImageSource source;
+    if (image.isNull()) {
+        return source;
+    }
+
+    // Stored losslessly, keyed like the blob it becomes when the map is saved
+    source.data = encodePng(image);
+    source.blob_key = "sha256:" + QString::fromLatin1(
+        QCryptographicHash::hash(source.data, QCryptographicHash::Sha256).toHex());
+    source.image_size = image.size();
+
+    QSize thumbnail_size = ImageDecoder::levelSize(image.size(), ImageDecoder::levelCount(image.size()) - 1);
+    source.thumbnail = encodePng(thumbnail_size == image.size()
+                                     ? image
+                                     : image.scaled(thumbnail_size, Qt::IgnoreAspectRatio,
+                                                    Qt::SmoothTransformation));
+    return source;
+}
+
+QByteArray ImageBlobStore::createThumbnail(const QByteArray &data, QSize *image_size)
+{
+    ImageSource source;
+    source.data = data;
+
+    int level = 0;
+    QImage thumbnail = ImageDecoder::decodeLevel(source, ImageDecoder::kThumbnailLevel,
+                                                 image_size, &level);
+    if (thumbnail.isNull()) {
+        return QByteArray();
+    }
+    return encodePng(thumbnail);
+}
+
+QByteArray ImageBlobStore::encodePng(const QImage &image)
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    image.save(&buffer, "PNG");
+    return data;
+}
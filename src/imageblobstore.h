@@ -0,0 +1,51 @@
+#ifndef IMAGEBLOBSTORE_H
+#define IMAGEBLOBSTORE_H
+
+#include "pch.h"
+#include "imagedecoder.h"
+
+class ImageItem;
+
+// Content-addressed store for images embedded in map files.
+//
+// Blobs are keyed by the SHA-256 of the encoded image file, so an image
+// that appears several times in a map is stored once. Each blob carries a
+// small precomputed thumbnail: opening a map only decodes thumbnails, and
+// the full image data is decoded lazily once an image is viewed up close.
+class ImageBlobStore
+{
+public:
+    // Embed an item's image and return its blob key (empty if the image
+    // cannot be read). Items without an image file switch to the embedded
+    // data, shared with the other items of the same image.
+    QString add(ImageItem *item);
+
+    bool isEmpty() const { return m_blobs.isEmpty(); }
+
+    // Blobs in their serialized form
+    QJsonObject toJson() const { return m_blobs; }
+    void fromJson(const QJsonObject &blobs);
+
+    bool contains(const QString &key) const { return m_blobs.contains(key); }
+
+    // Embedded source for image data without a file (e.g. pasted), so it is
+    // kept encoded and decoded level by level like any other image
+    static ImageSource fromImage(const QImage &image);
+
+    // Image source of a stored blob; items sharing a blob share its data
+    ImageSource source(const QString &key, const QString &file_path);
+
+private:
+    // Read the encoded image file of an item that is not embedded yet
+    static QByteArray encodeSource(const ImageSource &source);
+
+    // Encode the smallest pyramid level of an encoded image
+    static QByteArray createThumbnail(const QByteArray &data, QSize *image_size);
+
+    static QByteArray encodePng(const QImage &image);
+
+    QJsonObject m_blobs;
+    QHash<QString, ImageSource> m_sources; // Sources handed out or embedded by key
+};
+
+#endif // IMAGEBLOBSTORE_H
@@ -0,0 +1,207 @@
+#include "pch.h"
+
+#include "imagedecoder.h"
+#include "infinitecanvas.h"
+#include "trace.h"
+
+namespace {
+// Stored thumbnail scaled to the size of its level, if it decodes
+QImage thumbnailAtSize(const QByteArray &thumbnail_data, const QSize &size)
+{
+    QImage thumbnail = QImage::fromData(thumbnail_data);
+    if (!thumbnail.isNull() && thumbnail.size() != size) {
+        thumbnail = thumbnail.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    return thumbnail;
+}
+}
+
+ImageDecoder *ImageDecoder::s_instance = nullptr;
+
+ImageDecoder &ImageDecoder::instance()
+{
+    if (!s_instance) {
+        s_instance = new ImageDecoder(qApp);
+    }
+    return *s_instance;
+}
+
+ImageDecoder::ImageDecoder(QObject *parent)
+    : QObject(parent)
+    , m_next_request_id(1)
+{
+    // Leave a core for the GUI thread
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+}
+
+ImageDecoder::~ImageDecoder()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+    s_instance = nullptr;
+}
+
+int ImageDecoder::levelCount(const QSize &image_size)
+{
+    int count = 1;
+    int edge = qMax(image_size.width(), image_size.height());
+    while (edge / 2 >= kMinLevelSize) {
+        edge /= 2;
+        ++count;
+    }
+    return count;
+}
+
+QSize ImageDecoder::levelSize(const QSize &image_size, int level)
+{
+    int divisor = 1 << level;
+    return QSize(qMax(1, image_size.width() / divisor), qMax(1, image_size.height() / divisor));
+}
+
+void ImageDecoder::requestLevel(ImageItem *item, int level)
+{
+    if (!item) {
+        return;
+    }
+
+    // Skip levels that are already being decoded
+    QHash<int, quint64> &levels = m_pending[item];
+    if (levels.contains(level)) {
+        return;
+    }
+    quint64 request_id = m_next_request_id++;
+    levels.insert(level, request_id);
+
+    ImageSource source = item->source();
+
+    m_pool.start([this, item, request_id, level, source]() {
+        if (takeCancelled(request_id)) {
+            return;
+        }
+
+        QSize image_size;
+        int decoded_level = level;
+        QImage image = decodeLevel(source, level, &image_size, &decoded_level);
+
+        // The item is only touched on the GUI thread, after checking it still waits
+        QMetaObject::invokeMethod(this, [this, item, request_id, level, decoded_level, image,
+                                         image_size]() {
+            deliver(item, request_id, level, decoded_level, image, image_size);
+        }, Qt::QueuedConnection);
+    });
+}
+
+QImage ImageDecoder::decodeLevel(const ImageSource &source, int level,
+                                 QSize *image_size, int *decoded_level)
+{
+    TRACE_SCOPE("ImageDecoder::decodeLevel", "images");
+
+    // Embedded images with a known size answer thumbnail requests from the
+    // stored thumbnail, without touching the image data
+    if (source.isEmbedded() && !source.thumbnail.isEmpty() && source.image_size.isValid()) {
+        int thumbnail_level = levelCount(source.image_size) - 1;
+        if (level == kThumbnailLevel || level == thumbnail_level) {
+            QImage thumbnail = thumbnailAtSize(source.thumbnail,
+                                               levelSize(source.image_size, thumbnail_level));
+            if (!thumbnail.isNull()) {
+                *image_size = source.image_size;
+                *decoded_level = thumbnail_level;
+                return thumbnail;
+            }
+        }
+    }
+
+    // Embedded images are read from memory, others from their file
+    QByteArray data = source.encodedData();
+    QBuffer buffer(&data);
+    QImageReader reader;
+    if (source.isEmbedded()) {
+        buffer.open(QIODevice::ReadOnly);
+        reader.setDevice(&buffer);
+    } else {
+        reader.setFileName(source.file_path);
+    }
+    reader.setAutoTransform(true);
+
+    // Reading the header is cheap and gives the full size
+    QSize size = reader.size();
+    if (!size.isValid()) {
+        qWarning() << "Failed to read image header:" << source.file_path << reader.errorString();
+        return QImage();
+    }
+    bool rotated = reader.transformation() & QImageIOHandler::TransformationRotate90;
+    if (rotated) {
+        size.transpose();
+    }
+    *image_size = size;
+
+    if (level == kThumbnailLevel) {
+        level = levelCount(size) - 1;
+    }
+    *decoded_level = level;
+
+    // Use the stored thumbnail instead of decoding the whole image
+    if (level == levelCount(size) - 1 && !source.thumbnail.isEmpty()) {
+        QImage thumbnail = thumbnailAtSize(source.thumbnail, levelSize(size, level));
+        if (!thumbnail.isNull()) {
+            return thumbnail;
+        }
+    }
+
+    // Decode directly at the level's size
+    if (level > 0) {
+        QSize scaled_size = levelSize(size, level);
+        if (rotated) {
+            scaled_size.transpose();
+        }
+        reader.setScaledSize(scaled_size);
+    }
+
+    QImage image = reader.read();
+    if (image.isNull()) {
+        qWarning() << "Failed to decode image:" << source.file_path << reader.errorString();
+    }
+    return image;
+}
+
+void ImageDecoder::deliver(ImageItem *item, quint64 request_id, int requested_level, int level,
+                           const QImage &image, const QSize &image_size)
+{
+    // Drop results of cancelled requests, e.g. of items that were deleted
+    // meanwhile, even if another item now lives at the same address
+    auto it = m_pending.find(item);
+    if (it == m_pending.end() || it->value(requested_level) != request_id) {
+        takeCancelled(request_id);
+        return;
+    }
+    it->remove(requested_level);
+    if (it->isEmpty()) {
+        m_pending.erase(it);
+    }
+
+    item->setDecodedLevel(level, image.isNull() ? QPixmap() : QPixmap::fromImage(image), image_size);
+}
+
+void ImageDecoder::cancelRequests(ImageItem *item)
+{
+    // Nothing can be pending if the decoder was never created
+    if (!s_instance) {
+        return;
+    }
+    QHash<int, quint64> levels = s_instance->m_pending.take(item);
+    if (levels.isEmpty()) {
+        return;
+    }
+
+    // Let the workers skip the requests that have not started yet
+    QMutexLocker locker(&s_instance->m_cancelled_mutex);
+    for (quint64 request_id : qAsConst(levels)) {
+        s_instance->m_cancelled.insert(request_id);
+    }
+}
+
+bool ImageDecoder::takeCancelled(quint64 request_id)
+{
+    QMutexLocker locker(&m_cancelled_mutex);
+    return m_cancelled.remove(request_id);
+}
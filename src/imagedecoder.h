@@ -0,0 +1,92 @@
+#ifndef IMAGEDECODER_H
+#define IMAGEDECODER_H
+
+#include "pch.h"
+
+class ImageItem;
+
+// Where the pixels of an image come from; all members are implicitly shared
+// so sources can be handed to worker threads cheaply.
+struct ImageSource
+{
+    QString file_path;      // Image file on disk
+    QByteArray data;        // Embedded image file contents (takes precedence over the file)
+    bool data_is_base64 = false;
+    QByteArray thumbnail;   // Encoded smallest pyramid level of embedded images, if known
+    QSize image_size;       // Full size of embedded images, if known
+    QString blob_key;       // Key of embedded data in the map's ImageBlobStore
+
+    static ImageSource fromFile(const QString &file_path) {
+        ImageSource source;
+        source.file_path = file_path;
+        return source;
+    }
+
+    bool isEmbedded() const { return !data.isEmpty(); }
+    bool isNull() const { return file_path.isEmpty() && data.isEmpty(); }
+
+    // Embedded image file contents, decoded from base64 if needed
+    QByteArray encodedData() const { return data_is_base64 ? QByteArray::fromBase64(data) : data; }
+};
+
+// Decodes image pyramid levels on a worker pool.
+//
+// Level 0 is the full resolution image, each further level halves both
+// dimensions. Levels are decoded straight at their target size with
+// QImageReader::setScaledSize, so a thumbnail of a large photo never
+// allocates the full size image. Embedded images with a stored thumbnail
+// only decode the thumbnail until a finer level is needed. Results are handed back to the item on
+// the GUI thread. Every request has its own id: cancelled requests are
+// skipped by the workers, and a result is only delivered if its id is still
+// the pending one, so a new item at the address of a deleted one never
+// receives the old item's pixels.
+class ImageDecoder : public QObject
+{
+    Q_OBJECT
+public:
+    // Requesting this level decodes the smallest level of the pyramid
+    static constexpr int kThumbnailLevel = -1;
+
+    // Smallest level keeps at least this edge length
+    static constexpr int kMinLevelSize = 128;
+
+    static ImageDecoder &instance();
+    ~ImageDecoder();
+
+    // Decode a level of an item's image (no-op if already requested)
+    void requestLevel(ImageItem *item, int level);
+
+    // Forget pending requests of an item (safe to call from item destructors)
+    static void cancelRequests(ImageItem *item);
+
+    // Number of pyramid levels for an image of this size
+    static int levelCount(const QSize &image_size);
+
+    // Size of a pyramid level
+    static QSize levelSize(const QSize &image_size, int level);
+
+    // Decode one level of an image. Thread safe; reports the full image size
+    // and the level actually decoded.
+    static QImage decodeLevel(const ImageSource &source, int level,
+                              QSize *image_size, int *decoded_level);
+
+private:
+    explicit ImageDecoder(QObject *parent = nullptr);
+
+    void deliver(ImageItem *item, quint64 request_id, int requested_level, int level,
+                 const QImage &image, const QSize &image_size);
+
+    // Whether a request was cancelled; forgets the id (worker threads)
+    bool takeCancelled(quint64 request_id);
+
+    static ImageDecoder *s_instance;
+
+    QThreadPool m_pool;
+    QHash<ImageItem*, QHash<int, quint64>> m_pending; // Request id of each requested level per item
+    quint64 m_next_request_id;
+
+    QMutex m_cancelled_mutex;
+    QSet<quint64> m_cancelled; // Cancelled requests not yet seen by a worker
+};
+
+#endif // IMAGEDECODER_H
@@ -0,0 +1,115 @@
+#include "pch.h"
+
+#include "imageresidency.h"
+#include "infinitecanvas.h"
+
+ImageResidency &ImageResidency::instance()
+{
+    static ImageResidency residency;
+    return residency;
+}
+
+ImageResidency::ImageResidency()
+    : m_budget(qint64(kDefaultBudgetMB) * 1024 * 1024), m_resident_bytes(0)
+{
+}
+
+void ImageResidency::setBudget(qint64 bytes)
+{
+    m_budget = qMax<qint64>(0, bytes);
+    evict();
+}
+
+void ImageResidency::insert(ImageItem *item, int level, const QPixmap &pixmap, bool is_thumbnail)
+{
+    EntryKey key(item, level);
+
+    // Replace an earlier registration of the same level
+    auto it = m_entries.find(key);
+    if (it != m_entries.end()) {
+        m_resident_bytes -= it.value()->bytes;
+        m_lru.erase(it.value());
+        m_entries.erase(it);
+    }
+
+    Entry entry;
+    entry.item = item;
+    entry.level = level;
+    entry.bytes = qint64(pixmap.width()) * pixmap.height() * pixmap.depth() / 8;
+    entry.is_thumbnail = is_thumbnail;
+
+    // Newly decoded levels were requested by a paint, so they count as recent
+    m_entries.insert(key, m_lru.insert(m_lru.end(), entry));
+    m_resident_bytes += entry.bytes;
+
+    // The new level is about to be painted, keep it
+    evict(&entry);
+}
+
+void ImageResidency::touch(ImageItem *item, int level)
+{
+    auto it = m_entries.find(EntryKey(item, level));
+    if (it != m_entries.end()) {
+        // Move to the most recently painted end
+        m_lru.splice(m_lru.end(), m_lru, it.value());
+    }
+}
+
+void ImageResidency::removeItem(ImageItem *item, int level_count)
+{
+    for (int level = 0; level < level_count; ++level) {
+        auto it = m_entries.find(EntryKey(item, level));
+        if (it != m_entries.end()) {
+            m_resident_bytes -= it.value()->bytes;
+            m_lru.erase(it.value());
+            m_entries.erase(it);
+        }
+    }
+}
+
+bool ImageResidency::isInUse(const Entry &entry)
+{
+    if (entry.item->paintedLevel() != entry.level) {
+        return false;
+    }
+
+    QGraphicsScene *scene = entry.item->scene();
+    if (!scene) {
+        return false;
+    }
+
+    // Check whether the item intersects the viewport of any visible view
+    QRectF item_rect = entry.item->sceneBoundingRect();
+    for (QGraphicsView *view : scene->views()) {
+        if (view->isVisible() &&
+            view->mapToScene(view->viewport()->rect()).boundingRect().intersects(item_rect)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ImageResidency::evict(const Entry *keep)
+{
+    // Full levels go first, thumbnails only if that was not enough
+    for (int pass = 0; pass < 2 && m_resident_bytes > m_budget; ++pass) {
+        bool evict_thumbnails = pass == 1;
+
+        auto it = m_lru.begin();
+        while (it != m_lru.end() && m_resident_bytes > m_budget) {
+            // Never evict what is on screen right now
+            bool keep_entry = keep && it->item == keep->item && it->level == keep->level;
+            if (keep_entry || it->is_thumbnail != evict_thumbnails || isInUse(*it)) {
+                ++it;
+                continue;
+            }
+
+            Entry entry = *it;
+            m_entries.remove(EntryKey(entry.item, entry.level));
+            it = m_lru.erase(it);
+            m_resident_bytes -= entry.bytes;
+
+            entry.item->evictLevel(entry.level);
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef IMAGERESIDENCY_H
+#define IMAGERESIDENCY_H
+
+#include "pch.h"
+
+class ImageItem;
+
+// Keeps the decoded pixels of all image items within a memory budget.
+//
+// Every decoded pyramid level is registered with its size in bytes and
+// moved to the back of an LRU list whenever it is painted. When the budget
+// is exceeded, levels of images that are not on screen are evicted, least
+// recently painted first. Thumbnails (the smallest level) are only evicted
+// once nothing else is left, so images normally keep a tiny placeholder.
+// Evicted levels are decoded again when the image is painted.
+class ImageResidency
+{
+public:
+    static constexpr int kDefaultBudgetMB = 256;
+
+    static ImageResidency &instance();
+
+    // Memory budget for decoded images, evicts immediately if lowered
+    void setBudget(qint64 bytes);
+    qint64 budget() const { return m_budget; }
+
+    // Bytes currently held by decoded levels
+    qint64 residentBytes() const { return m_resident_bytes; }
+
+    // Register a decoded level (may evict other levels)
+    void insert(ImageItem *item, int level, const QPixmap &pixmap, bool is_thumbnail);
+
+    // Mark a level as just painted
+    void touch(ImageItem *item, int level);
+
+    // Forget all levels of an item (e.g. when it is deleted)
+    void removeItem(ImageItem *item, int level_count);
+
+private:
+    ImageResidency();
+
+    struct Entry {
+        ImageItem *item;
+        int level;
+        qint64 bytes;
+        bool is_thumbnail;
+    };
+    using EntryKey = QPair<ImageItem*, int>;
+
+    // Evict levels until the budget is met, sparing the given entry
+    void evict(const Entry *keep = nullptr);
+
+    // Whether the level is what the item currently shows in a view
+    static bool isInUse(const Entry &entry);
+
+    std::list<Entry> m_lru; // Least recently painted first
+    QHash<EntryKey, std::list<Entry>::iterator> m_entries;
+    qint64 m_budget;
+    qint64 m_resident_bytes;
+};
+
+#endif // IMAGERESIDENCY_H
@@ -1,6 +1,20 @@
 #include "pch.h"
 
 #include "infinitecanvas.h"
+#include "collapsedsubtree.h"
+#include "iconcache.h"
+#include "iconloader.h"
+#include "imageblobstore.h"
+#include "imagedecoder.h"
+#include "imageresidency.h"
+#include "itempool.h"
+#include "mapclipboard.h"
+#include "outlineparser.h"
+#include "sceneindexsuspender.h"
+#include "searchindex.h"
+#include "styletable.h"
+#include "trace.h"
+#include "undocommands.h"
 
 // ShortcutItem implementation
 ShortcutItem::ShortcutItem(const QPixmap &pixmap, const QString &target_path, QGraphicsItem *parent)
@@ -12,6 +26,22 @@ ShortcutItem::ShortcutItem(const QPixmap &pixmap, const QString &target_path, QG
     // Store the target path as item data
     setData(0, target_path);
     setData(1, "shortcut"); // Mark as shortcut item
+    
+    // Make the target findable
+    SearchIndex::instance().markDirty(this);
+}
+
+ShortcutItem::~ShortcutItem() {
+    // Drop a pending icon lookup
+    IconLoader::cancelRequests(this);
+    SearchIndex::instance().removeItem(this);
+    ItemRegistry::instance().removeItem(this);
+}
+
+void ShortcutItem::setTarget(const QPixmap &pixmap, const QString &target_path) {
+    setPixmap(pixmap);
+    m_target_path = target_path;
+    setData(0, target_path);
 }
 
 void ShortcutItem::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) {
@@ -24,40 +54,114 @@ void ShortcutItem::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) {
     QGraphicsPixmapItem::mouseDoubleClickEvent(event);
 }
 
-// DirectoryItem implementation
-DirectoryItem::DirectoryItem(const QPixmap &pixmap, const QString &dir_path, QGraphicsItem *parent)
-    : QGraphicsItemGroup(parent), m_dir_path(dir_path) {
+// IconLabelItem implementation
+namespace {
+// Font shared by all icon labels
+const QFont &iconLabelFont() {
+    static const QFont label_font("Arial", 10);
+    return label_font;
+}
+
+// Maximum label width before the text is elided
+constexpr qreal kMaxLabelWidth = 120.0;
+
+// Gap between the icon and its label
+constexpr qreal kLabelSpacing = 5.0;
+}
+
+IconLabelItem::IconLabelItem(const QPixmap &pixmap, const QString &label, QGraphicsItem *parent)
+    : QGraphicsItem(parent), m_icon(pixmap) {
     // Enable item flags
     setFlag(QGraphicsItem::ItemIsSelectable, true);
     setFlag(QGraphicsItem::ItemIsMovable, true);
     
-    // Create the icon item
-    m_icon_item = new QGraphicsPixmapItem(pixmap, this);
-    addToGroup(m_icon_item);
+    // Set label and compute geometry
+    setLabel(label);
     
-    // Create the text label
-    QString dir_name = getDirName(dir_path);
-    m_label_item = new QGraphicsSimpleTextItem(dir_name, this);
+    // Make the URL or path findable (read on the next search, once the
+    // subclass is constructed)
+    SearchIndex::instance().markDirty(this);
+}
+
+IconLabelItem::~IconLabelItem() {
+    // Drop a pending icon lookup
+    IconLoader::cancelRequests(this);
+    SearchIndex::instance().removeItem(this);
+    ItemRegistry::instance().removeItem(this);
+}
+
+void IconLabelItem::setIcon(const QPixmap &pixmap) {
+    m_icon = pixmap;
     
-    // Set font for label
-    QFont label_font("Arial", 10);
-    m_label_item->setFont(label_font);
+    // Only geometry changes require re-indexing
+    QSizeF icon_size = QSizeF(m_icon.size()) / m_icon.devicePixelRatio();
+    if (icon_size != m_icon_rect.size()) {
+        updateGeometry();
+    } else {
+        update(m_icon_rect);
+    }
+}
+
+void IconLabelItem::setLabel(const QString &text) {
+    QFontMetricsF metrics(iconLabelFont());
+    m_label = metrics.elidedText(text, Qt::ElideRight, kMaxLabelWidth);
+    updateGeometry();
+}
+
+void IconLabelItem::updateGeometry() {
+    prepareGeometryChange();
     
-    // Position label below icon
-    int icon_width = pixmap.width();
-    int icon_height = pixmap.height();
-    int label_width = m_label_item->boundingRect().width();
+    // Icon at the origin, in device independent pixels
+    m_icon_rect = QRectF(QPointF(0, 0), QSizeF(m_icon.size()) / m_icon.devicePixelRatio());
     
     // Center the label below the icon
-    m_label_item->setPos((icon_width - label_width) / 2, icon_height + 5);
+    QFontMetricsF metrics(iconLabelFont());
+    qreal label_width = metrics.horizontalAdvance(m_label);
+    m_label_rect = QRectF((m_icon_rect.width() - label_width) / 2,
+                          m_icon_rect.height() + kLabelSpacing,
+                          label_width, metrics.height());
+    
+    m_bounding_rect = m_icon_rect.united(m_label_rect);
+}
+
+QRectF IconLabelItem::boundingRect() const {
+    return m_bounding_rect;
+}
+
+void IconLabelItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) {
+    Q_UNUSED(widget);
     
-    addToGroup(m_label_item);
+    // Draw the icon
+    painter->drawPixmap(m_icon_rect, m_icon, QRectF(m_icon.rect()));
     
+    // Draw the label
+    painter->setFont(iconLabelFont());
+    painter->setPen(Qt::black);
+    painter->drawText(m_label_rect, Qt::AlignCenter, m_label);
+    
+    // Draw the selection outline
+    if (option->state & QStyle::State_Selected) {
+        painter->setPen(QPen(option->palette.windowText(), 0, Qt::DashLine));
+        painter->setBrush(Qt::NoBrush);
+        painter->drawRect(m_bounding_rect);
+    }
+}
+
+// DirectoryItem implementation
+DirectoryItem::DirectoryItem(const QPixmap &pixmap, const QString &dir_path, QGraphicsItem *parent)
+    : IconLabelItem(pixmap, getDirName(dir_path), parent), m_dir_path(dir_path) {
     // Store the directory path as item data
     setData(0, dir_path);
     setData(1, "directory"); // Mark as directory item
 }
 
+void DirectoryItem::setDirPath(const QPixmap &pixmap, const QString &dir_path) {
+    setIcon(pixmap);
+    setLabel(getDirName(dir_path));
+    m_dir_path = dir_path;
+    setData(0, dir_path);
+}
+
 void DirectoryItem::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) {
     // Open the directory in file explorer/Finder
     if (!m_dir_path.isEmpty()) {
@@ -65,7 +169,7 @@ void DirectoryItem::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) {
     }
     
     // Call the base implementation
-    QGraphicsItemGroup::mouseDoubleClickEvent(event);
+    IconLabelItem::mouseDoubleClickEvent(event);
 }
 
 // Helper method to get directory name from path
@@ -83,49 +187,24 @@ QString DirectoryItem::getDirName(const QString &path) {
         }
     }
     
-    // Limit length to avoid very long names
-    const int MAX_NAME_LENGTH = 20;
-    if (name.length() > MAX_NAME_LENGTH) {
-        name = name.left(MAX_NAME_LENGTH - 3) + "...";
-    }
-    
     return name;
 }
 
 // MediaItem implementation
 MediaItem::MediaItem(const QPixmap &pixmap, const QString &media_path, QGraphicsItem *parent)
-    : QGraphicsItemGroup(parent), m_media_path(media_path) {
-    // Enable item flags
-    setFlag(QGraphicsItem::ItemIsSelectable, true);
-    setFlag(QGraphicsItem::ItemIsMovable, true);
-    
-    // Create the icon item
-    m_icon_item = new QGraphicsPixmapItem(pixmap, this);
-    addToGroup(m_icon_item);
-    
-    // Create the text label
-    QString file_name = getFileName(media_path);
-    m_label_item = new QGraphicsSimpleTextItem(file_name, this);
-    
-    // Set font for label
-    QFont label_font("Arial", 10);
-    m_label_item->setFont(label_font);
-    
-    // Position label below icon
-    int icon_width = pixmap.width();
-    int icon_height = pixmap.height();
-    int label_width = m_label_item->boundingRect().width();
-    
-    // Center the label below the icon
-    m_label_item->setPos((icon_width - label_width) / 2, icon_height + 5);
-    
-    addToGroup(m_label_item);
-    
+    : IconLabelItem(pixmap, getFileName(media_path), parent), m_media_path(media_path) {
     // Store the media path as item data
     setData(0, media_path);
     setData(1, "media"); // Mark as media item
 }
 
+void MediaItem::setMediaPath(const QPixmap &pixmap, const QString &media_path) {
+    setIcon(pixmap);
+    setLabel(getFileName(media_path));
+    m_media_path = media_path;
+    setData(0, media_path);
+}
+
 void MediaItem::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) {
     // Open the media file with default application
     if (!m_media_path.isEmpty()) {
@@ -133,57 +212,30 @@ void MediaItem::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) {
     }
     
     // Call the base implementation
-    QGraphicsItemGroup::mouseDoubleClickEvent(event);
+    IconLabelItem::mouseDoubleClickEvent(event);
 }
 
 // Helper method to get file name from path
 QString MediaItem::getFileName(const QString &path) {
     QFileInfo file_info(path);
-    QString name = file_info.fileName();
-    
-    // Limit length to avoid very long names
-    const int MAX_NAME_LENGTH = 20;
-    if (name.length() > MAX_NAME_LENGTH) {
-        name = name.left(MAX_NAME_LENGTH - 3) + "...";
-    }
-    
-    return name;
+    return file_info.fileName();
 }
 
 // UrlItem implementation
 UrlItem::UrlItem(const QPixmap &pixmap, const QUrl &url, QGraphicsItem *parent)
-    : QGraphicsItemGroup(parent), m_url(url) {
-    // Enable item flags
-    setFlag(QGraphicsItem::ItemIsSelectable, true);
-    setFlag(QGraphicsItem::ItemIsMovable, true);
-    
-    // Create the icon item
-    m_icon_item = new QGraphicsPixmapItem(pixmap, this);
-    addToGroup(m_icon_item);
-    
-    // Create the text label
-    QString domain = getDomainFromUrl(url);
-    m_label_item = new QGraphicsSimpleTextItem(domain, this);
-    
-    // Set font for label
-    QFont label_font("Arial", 10);
-    m_label_item->setFont(label_font);
-    
-    // Position label below icon
-    int icon_width = pixmap.width();
-    int icon_height = pixmap.height();
-    int label_width = m_label_item->boundingRect().width();
-    
-    // Center the label below the icon
-    m_label_item->setPos((icon_width - label_width) / 2, icon_height + 5);
-    
-    addToGroup(m_label_item);
-    
+    : IconLabelItem(pixmap, getDomainFromUrl(url), parent), m_url(url) {
     // Store the URL as item data
     setData(0, url.toString());
     setData(1, "url"); // Mark as URL item
 }
 
+void UrlItem::setUrl(const QPixmap &pixmap, const QUrl &url) {
+    setIcon(pixmap);
+    setLabel(getDomainFromUrl(url));
+    m_url = url;
+    setData(0, url.toString());
+}
+
 void UrlItem::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) {
     // Open the URL in the default browser
     if (m_url.isValid()) {
@@ -191,7 +243,7 @@ void UrlItem::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) {
     }
     
     // Call the base implementation
-    QGraphicsItemGroup::mouseDoubleClickEvent(event);
+    IconLabelItem::mouseDoubleClickEvent(event);
 }
 
 // Helper method to get domain from URL
@@ -203,13 +255,198 @@ QString UrlItem::getDomainFromUrl(const QUrl &url) {
         host = host.mid(4);
     }
     
-    // Limit length to avoid very long names
-    const int MAX_NAME_LENGTH = 20;
-    if (host.length() > MAX_NAME_LENGTH) {
-        host = host.left(MAX_NAME_LENGTH - 3) + "...";
+    return host;
+}
+
+// ImageItem implementation
+namespace {
+// Size shown while the image header has not been read yet
+const QSizeF kImagePlaceholderSize(160, 120);
+}
+
+ImageItem::ImageItem(const ImageSource &source, const QSize &size_hint, QGraphicsItem *parent)
+    : QGraphicsItem(parent), m_source(source), m_painted_level(-1), m_failed(false) {
+    // Enable item flags
+    setFlag(QGraphicsItem::ItemIsSelectable, true);
+    setFlag(QGraphicsItem::ItemIsMovable, true);
+    
+    // Store the file path as item data
+    if (!source.file_path.isEmpty()) {
+        setData(0, source.file_path);
+    }
+    setData(1, "image"); // Mark as image item
+    
+    // Reserve the known size so the layout does not jump once decoded
+    if (size_hint.isValid()) {
+        setImageSize(size_hint);
+    } else if (source.image_size.isValid()) {
+        setImageSize(source.image_size);
     }
     
-    return host;
+    // Start with the smallest level, finer ones follow when painted
+    ImageDecoder::instance().requestLevel(this, ImageDecoder::kThumbnailLevel);
+}
+
+ImageItem::ImageItem(const QString &file_path, const QSize &size_hint, QGraphicsItem *parent)
+    : ImageItem(ImageSource::fromFile(file_path), size_hint, parent) {
+}
+
+ImageItem::ImageItem(const QImage &image, QGraphicsItem *parent)
+    : ImageItem(ImageBlobStore::fromImage(image), QSize(), parent) {
+}
+
+ImageItem::~ImageItem() {
+    // Drop pending decodes and release the memory accounting
+    ImageDecoder::cancelRequests(this);
+    ImageResidency::instance().removeItem(this, m_levels.size());
+    ItemRegistry::instance().removeItem(this);
+}
+
+QImage ImageItem::fullImage() const {
+    QSize image_size;
+    int level = 0;
+    return ImageDecoder::decodeLevel(m_source, 0, &image_size, &level);
+}
+
+void ImageItem::embed(const ImageSource &embedded) {
+    m_source.blob_key = embedded.blob_key;
+    m_source.data = embedded.data;
+    m_source.data_is_base64 = embedded.data_is_base64;
+    m_source.thumbnail = embedded.thumbnail;
+    m_source.image_size = embedded.image_size;
+}
+
+void ImageItem::setImageSize(const QSize &image_size) {
+    prepareGeometryChange();
+    m_image_size = image_size;
+    
+    // Levels decoded for another size are useless
+    ImageResidency::instance().removeItem(this, m_levels.size());
+    m_levels.clear();
+    m_painted_level = -1;
+    m_levels.resize(ImageDecoder::levelCount(image_size));
+}
+
+void ImageItem::setDecodedLevel(int level, const QPixmap &pixmap, const QSize &image_size) {
+    if (pixmap.isNull()) {
+        // Stop requesting levels of an unreadable image
+        m_failed = true;
+        update();
+        return;
+    }
+    
+    // The file may differ from the size stored in the map
+    if (image_size != m_image_size) {
+        setImageSize(image_size);
+    }
+    
+    if (level >= 0 && level < m_levels.size()) {
+        storeLevel(level, pixmap);
+        update();
+    }
+}
+
+void ImageItem::storeLevel(int level, const QPixmap &pixmap) {
+    m_levels[level] = pixmap;
+    ImageResidency::instance().insert(this, level, pixmap, level == m_levels.size() - 1);
+}
+
+void ImageItem::evictLevel(int level) {
+    if (level < 0 || level >= m_levels.size()) {
+        return;
+    }
+    m_levels[level] = QPixmap();
+    
+    // Repaints with a coarser level, which requests this one again if needed
+    update();
+}
+
+int ImageItem::levelForScale(qreal scale) const {
+    if (scale <= 0) {
+        return m_levels.size() - 1;
+    }
+    
+    // Each level halves the resolution, pick the coarsest one that is still sharp
+    int level = qFloor(std::log2(1.0 / scale));
+    return qBound(0, level, m_levels.size() - 1);
+}
+
+int ImageItem::closestDecodedLevel(int level) const {
+    for (int i = level; i >= 0; --i) {
+        if (!m_levels[i].isNull()) {
+            return i;
+        }
+    }
+    for (int i = level + 1; i < m_levels.size(); ++i) {
+        if (!m_levels[i].isNull()) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+QRectF ImageItem::boundingRect() const {
+    if (m_image_size.isValid()) {
+        return QRectF(QPointF(0, 0), QSizeF(m_image_size));
+    }
+    return QRectF(QPointF(0, 0), kImagePlaceholderSize);
+}
+
+void ImageItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) {
+    QRectF rect = boundingRect();
+    int level = -1;
+    
+    if (!m_levels.isEmpty()) {
+        // Device pixels per image pixel at the current zoom
+        qreal scale = QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform())
+                      * painter->device()->devicePixelRatioF();
+        int wanted = levelForScale(scale);
+        
+        if (m_levels[wanted].isNull() && !m_failed) {
+            if (widget) {
+                ImageDecoder::instance().requestLevel(this, wanted);
+            } else {
+                // Offscreen rendering (e.g. export) cannot wait for the worker pool
+                QSize image_size;
+                int decoded_level = wanted;
+                QImage image = ImageDecoder::decodeLevel(m_source, wanted,
+                                                         &image_size, &decoded_level);
+                if (!image.isNull()) {
+                    storeLevel(wanted, QPixmap::fromImage(image));
+                }
+            }
+        }
+        level = closestDecodedLevel(wanted);
+    }
+    
+    // Keep the drawn level resident
+    m_painted_level = level;
+    if (level >= 0) {
+        ImageResidency::instance().touch(this, level);
+    }
+    
+    if (level >= 0) {
+        // Draw the best decoded level scaled to the item size
+        const QPixmap &pixmap = m_levels[level];
+        painter->setRenderHint(QPainter::SmoothPixmapTransform, true);
+        painter->drawPixmap(rect, pixmap, QRectF(pixmap.rect()));
+    } else {
+        // Draw a placeholder until the image is decoded
+        painter->setPen(QPen(QColor(180, 180, 180), 0));
+        painter->setBrush(QColor(235, 235, 235));
+        painter->drawRect(rect);
+        if (m_failed) {
+            painter->drawLine(rect.topLeft(), rect.bottomRight());
+            painter->drawLine(rect.topRight(), rect.bottomLeft());
+        }
+    }
+    
+    // Draw the selection outline
+    if (option->state & QStyle::State_Selected) {
+        painter->setPen(QPen(option->palette.windowText(), 0, Qt::DashLine));
+        painter->setBrush(Qt::NoBrush);
+        painter->drawRect(rect);
+    }
 }
 
 // ConnectionLine implementation
@@ -236,6 +473,16 @@ ConnectionLine::ConnectionLine(EditableTextItem *from_item, EditableTextItem *to
     setColorByIndex(level);
 }
 
+void ConnectionLine::setItems(EditableTextItem *from_item, EditableTextItem *to_item)
+{
+    m_source_item = from_item;
+    m_target_item = to_item;
+    if (to_item) {
+        setColorByIndex(to_item->getDepthLevel());
+    }
+    updatePosition();
+}
+
 void ConnectionLine::updatePosition()
 {
     if (!m_source_item || !m_target_item) {
@@ -315,10 +562,26 @@ void ConnectionLine::setColorByIndex(int index)
     setPen(line_pen);
 }
 
+namespace {
+// Font of the hidden descendant count on collapsed nodes
+const QFont &badgeFont() {
+    static const QFont badge_font("Arial", 9, QFont::Bold);
+    return badge_font;
+}
+
+// Gap between a collapsed node's frame and its badge
+constexpr qreal kBadgeSpacing = 4.0;
+}
+
 // Updated EditableTextItem implementation
 EditableTextItem::EditableTextItem(const QString &text, QGraphicsItem *parent)
-    : QGraphicsTextItem(text, parent), m_parent_node(nullptr), m_padding(5.0)
+    : QGraphicsTextItem(text, parent), m_parent_node(nullptr), m_style(0), m_padding(5.0)
 {
+    // Default font and color
+    const NodeStyle &style = StyleTable::instance().style(m_style);
+    setFont(style.font);
+    setDefaultTextColor(style.text_color);
+    
     // Set flags for selection and movement
     setFlag(QGraphicsItem::ItemIsSelectable, true);
     setFlag(QGraphicsItem::ItemIsMovable, true);
@@ -331,9 +594,21 @@ EditableTextItem::EditableTextItem(const QString &text, QGraphicsItem *parent)
     
     // Set document margins to accommodate padding
     document()->setDocumentMargin(m_padding);
+    
+    // Make the text findable
+    SearchIndex::instance().markDirty(this);
 }
 
 QRectF EditableTextItem::boundingRect() const
+{
+    // Collapsed nodes also cover their badge
+    if (isCollapsed()) {
+        return frameRect().united(badgeRect());
+    }
+    return frameRect();
+}
+
+QRectF EditableTextItem::frameRect() const
 {
     // Get the base bounding rect from QGraphicsTextItem
     QRectF base_rect = QGraphicsTextItem::boundingRect();
@@ -342,27 +617,42 @@ QRectF EditableTextItem::boundingRect() const
     return base_rect.adjusted(-m_padding, -m_padding, m_padding, m_padding);
 }
 
+QRectF EditableTextItem::badgeRect() const
+{
+    // Vertically centered to the right of the frame
+    QRectF frame = frameRect();
+    return QRectF(QPointF(frame.right() + kBadgeSpacing, frame.center().y() - m_badge_size.height() / 2),
+                  m_badge_size);
+}
+
 void EditableTextItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
 {
     // Save painter state
     painter->save();
     
     // Get the rectangle to draw
-    QRectF rect = boundingRect();
-    
-    // Set up the pen for the border
-    QPen border_pen(QColor(100, 149, 237)); // Cornflower blue
-    border_pen.setWidth(1);
-    painter->setPen(border_pen);
+    QRectF rect = frameRect();
     
-    // Set up the brush for the background
-    QBrush background_brush(QColor(240, 248, 255)); // AliceBlue - very light blue
-    painter->setBrush(background_brush);
+    // Border and background come ready made with the style
+    const NodeStyle &style = StyleTable::instance().style(m_style);
+    painter->setPen(style.border_pen);
+    painter->setBrush(style.background_brush);
     
     // Draw rounded rectangle
     qreal corner_radius = 8.0;
     painter->drawRoundedRect(rect, corner_radius, corner_radius);
     
+    // Draw the hidden descendant count as a pill next to the frame
+    if (isCollapsed()) {
+        QRectF badge_rect = badgeRect();
+        painter->setPen(Qt::NoPen);
+        painter->setBrush(style.border_pen.color());
+        painter->drawRoundedRect(badge_rect, badge_rect.height() / 2, badge_rect.height() / 2);
+        painter->setPen(Qt::white);
+        painter->setFont(badgeFont());
+        painter->drawText(badge_rect, Qt::AlignCenter, m_badge_text);
+    }
+    
     // Restore painter state before drawing the text
     painter->restore();
     
@@ -372,66 +662,201 @@ void EditableTextItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *
 
 EditableTextItem::~EditableTextItem()
 {
+    // Drop the search entry and the undo id
+    SearchIndex::instance().removeItem(this);
+    ItemRegistry::instance().removeItem(this);
+    
     // Remove connections to parent
     if (m_parent_node) {
         m_parent_node->removeChildNode(this);
     }
     
-    // Remove all connections to children
-    for (ConnectionLine *connection : m_connections) {
-        if (connection->scene()) {
-            connection->scene()->removeItem(connection);
+    // Remove all connections to children, which become roots
+    for (const NodeLinks::Link &link : m_links) {
+        link.child->m_parent_node = nullptr;
+        if (ConnectionLine *connection = link.line) {
+            if (connection->scene()) {
+                connection->scene()->removeItem(connection);
+            }
+            delete connection;
         }
-        delete connection;
     }
     
-    // Clear lists
-    m_connections.clear();
-    m_child_nodes.clear();
+    // Clear links
+    m_links.clear();
 }
 
-void EditableTextItem::addChildNode(EditableTextItem *child_node)
+void EditableTextItem::deleteItems(const QList<QGraphicsItem*> &items)
 {
-    if (!child_node || m_child_nodes.contains(child_node)) {
+    if (items.isEmpty()) {
         return;
     }
+    TRACE_SCOPE("EditableTextItem::deleteItems", "canvas");
     
-    // Add to our children list
-    m_child_nodes.append(child_node);
+    // Copied items are about to be deleted
+    MapClipboard::aboutToChangeItems(items);
     
-    // Set us as the parent of the child
-    child_node->setParentNode(this);
+    // Lines belong to their source node and go with it
+    QSet<QGraphicsItem*> deleted;
+    deleted.reserve(items.size());
+    for (QGraphicsItem *item : items) {
+        if (!dynamic_cast<ConnectionLine*>(item)) {
+            deleted.insert(item);
+        }
+    }
+    
+    // Unlink the deleted nodes, noting the parents that stay
+    QList<ConnectionLine*> connections;
+    QSet<EditableTextItem*> parents;
+    for (QGraphicsItem *item : deleted) {
+        EditableTextItem *node = dynamic_cast<EditableTextItem*>(item);
+        if (!node) {
+            continue;
+        }
+        if (node->m_parent_node && !deleted.contains(node->m_parent_node)) {
+            parents.insert(node->m_parent_node);
+        }
+        for (const NodeLinks::Link &link : node->m_links) {
+            if (!deleted.contains(link.child)) {
+                link.child->m_parent_node = nullptr;
+            }
+            if (link.line) {
+                connections.append(link.line);
+            }
+        }
+        node->m_parent_node = nullptr;
+        node->m_links.clear();
+    }
+    
+    // Each remaining parent drops its deleted children in one pass
+    for (EditableTextItem *parent : parents) {
+        NodeLinks::Link *kept_end = std::remove_if(parent->m_links.begin(), parent->m_links.end(),
+                                                   [&](const NodeLinks::Link &link) {
+                                                       if (!deleted.contains(link.child)) {
+                                                           return false;
+                                                       }
+                                                       if (link.line) {
+                                                           connections.append(link.line);
+                                                       }
+                                                       return true;
+                                                   });
+        parent->m_links.truncate(int(kept_end - parent->m_links.begin()));
+    }
+    
+    // Nothing is left for the destructors to unlink. The scene index stays
+    // on: it drops items that are being destroyed in one later pass, while
+    // a suspended index would search its item list for every one of them.
+    qDeleteAll(connections);
+    qDeleteAll(deleted);
+}
+
+void EditableTextItem::clearScene(QGraphicsScene *scene, ItemPool *pool)
+{
+    TRACE_SCOPE("EditableTextItem::clearScene", "canvas");
+    
+    MapClipboard::aboutToClearScene(scene);
+    
+    // Drop all links first, the lines go with the other scene items
+    QList<QGraphicsItem*> items = scene->items(Qt::AscendingOrder);
+    for (QGraphicsItem *item : items) {
+        if (EditableTextItem *node = dynamic_cast<EditableTextItem*>(item)) {
+            node->m_parent_node = nullptr;
+            node->m_links.clear();
+        }
+    }
+    
+    if (pool) {
+        // Take the items out in the order they were added (loaded maps add
+        // their lines last), so each one is at the front of the scene's
+        // item list and nothing has to be searched. Children go with their
+        // parents.
+        QList<QGraphicsItem*> top_level_items;
+        for (QGraphicsItem *item : items) {
+            if (!item->parentItem()) {
+                top_level_items.append(item);
+            }
+        }
+        std::stable_partition(top_level_items.begin(), top_level_items.end(), [](QGraphicsItem *item) {
+            return !dynamic_cast<ConnectionLine*>(item);
+        });
+        for (QGraphicsItem *item : top_level_items) {
+            if (!pool->recycle(item)) {
+                delete item;
+            }
+        }
+    }
+    scene->clear();
+}
+
+void EditableTextItem::setStyle(int index)
+{
+    MapClipboard::aboutToChangeItem(this);
+    const NodeStyle &style = StyleTable::instance().style(index);
+    m_style = quint16(StyleTable::instance().contains(index) ? index : 0);
+    
+    // Only a new font lays the text out again
+    if (font() != style.font) {
+        setFont(style.font);
+    }
+    setDefaultTextColor(style.text_color);
+    update();
+}
+
+void EditableTextItem::resetForReuse()
+{
+    m_collapsed_subtree.reset();
+    m_badge_text.clear();
+    m_badge_size = QSizeF();
+    m_text_before_edit.clear();
+    setTextInteractionFlags(Qt::NoTextInteraction);
+    
+    // Clear the text now, so restyling the node does not lay out the old one
+    setPlainText(QString());
+    document()->clearUndoRedoStacks();
+}
+
+void EditableTextItem::addChildNode(EditableTextItem *child_node, int index)
+{
+    if (!child_node || m_links.indexOf(child_node) >= 0) {
+        return;
+    }
+    MapClipboard::aboutToChangeItems({this, child_node});
     
     // Create connection line
+    ConnectionLine *connection = nullptr;
     if (scene()) {
-        ConnectionLine *connection = new ConnectionLine(this, child_node);
-        m_connections.append(connection);
+        connection = ItemPool::instance().takeLine(this, child_node);
         scene()->addItem(connection);
     }
+    
+    // Add to our children, at the end unless a position is given
+    if (index < 0 || index > m_links.size()) {
+        index = m_links.size();
+    }
+    m_links.insert(index, child_node, connection);
+    
+    // Set us as the parent of the child
+    child_node->setParentNode(this);
 }
 
 void EditableTextItem::removeChildNode(EditableTextItem *child_node)
 {
-    if (!child_node || !m_child_nodes.contains(child_node)) {
+    int index = child_node ? m_links.indexOf(child_node) : -1;
+    if (index < 0) {
         return;
     }
+    MapClipboard::aboutToChangeItems({this, child_node});
     
-    // Find and remove the connection to this child
-    for (int i = 0; i < m_connections.size(); ++i) {
-        ConnectionLine *connection = m_connections[i];
-        if (connection->targetItem() == child_node) {
-            if (connection->scene()) {
-                connection->scene()->removeItem(connection);
-            }
-            m_connections.removeAt(i);
-            delete connection;
-            break;
+    // Remove the child with the connection to it
+    ConnectionLine *connection = m_links.at(index).line;
+    m_links.removeAt(index);
+    if (connection) {
+        if (connection->scene()) {
+            connection->scene()->removeItem(connection);
         }
+        delete connection;
     }
     
-    // Remove from children list
-    m_child_nodes.removeOne(child_node);
-    
     // Set child's parent to null if it was us
     if (child_node->parentNode() == this) {
         child_node->setParentNode(nullptr);
@@ -441,19 +866,26 @@ void EditableTextItem::removeChildNode(EditableTextItem *child_node)
 void EditableTextItem::setParentNode(EditableTextItem *parent)
 {
     // Don't set as parent if it's already a child
-    if (m_child_nodes.contains(parent)) {
+    if (m_links.indexOf(parent) >= 0) {
         return;
     }
     
     m_parent_node = parent;
 }
 
+void EditableTextItem::updateChildConnections()
+{
+    for (const NodeLinks::Link &link : m_links) {
+        if (link.line) {
+            link.line->updatePosition();
+        }
+    }
+}
+
 void EditableTextItem::updateConnections()
 {
     // Update all connections
-    for (ConnectionLine *connection : m_connections) {
-        connection->updatePosition();
-    }
+    updateChildConnections();
     
     // If we have a parent, it also needs to update the connection to us
     if (m_parent_node) {
@@ -463,6 +895,18 @@ void EditableTextItem::updateConnections()
 
 void EditableTextItem::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event)
 {
+    // Double-clicking the badge expands the node instead of editing it
+    if (isCollapsed() && badgeRect().contains(event->pos())) {
+        UndoHistory::instance().push(scene(), new CollapseCommand(this, CollapseCommand::Expand));
+        event->accept();
+        return;
+    }
+    
+    // Remember the text for undoing the edit
+    if (!(textInteractionFlags() & Qt::TextEditorInteraction)) {
+        m_text_before_edit = toPlainText();
+    }
+    
     // Enable editing on double click
     setTextInteractionFlags(Qt::TextEditorInteraction);
     setFocus();
@@ -474,8 +918,37 @@ void EditableTextItem::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event)
     QGraphicsTextItem::mouseDoubleClickEvent(event);
 }
 
+void EditableTextItem::keyPressEvent(QKeyEvent *event)
+{
+    // Copied text keeps its content once a key changes it; shortcuts only
+    // count if they edit (AltGr is reported as Ctrl+Alt on some platforms)
+    Qt::KeyboardModifiers modifiers = event->modifiers();
+    bool shortcut = (modifiers & (Qt::ControlModifier | Qt::MetaModifier)) &&
+                    !(modifiers & Qt::AltModifier);
+    if ((!event->text().isEmpty() && !shortcut) || event->matches(QKeySequence::Cut) ||
+        event->matches(QKeySequence::Paste) || event->matches(QKeySequence::Undo) ||
+        event->matches(QKeySequence::Redo) || event->matches(QKeySequence::DeleteStartOfWord) ||
+        event->matches(QKeySequence::DeleteEndOfWord)) {
+        MapClipboard::aboutToChangeItem(this);
+    }
+    
+    QGraphicsTextItem::keyPressEvent(event);
+}
+
+void EditableTextItem::inputMethodEvent(QInputMethodEvent *event)
+{
+    // Text composed by an input method
+    if (!event->commitString().isEmpty() || event->replacementLength() > 0) {
+        MapClipboard::aboutToChangeItem(this);
+    }
+    
+    QGraphicsTextItem::inputMethodEvent(event);
+}
+
 void EditableTextItem::focusOutEvent(QFocusEvent *event)
 {
+    bool was_editing = textInteractionFlags().testFlag(Qt::TextEditorInteraction);
+    
     // Disable editing when focus is lost
     setTextInteractionFlags(Qt::NoTextInteraction);
     
@@ -487,6 +960,13 @@ void EditableTextItem::focusOutEvent(QFocusEvent *event)
     cursor.clearSelection();
     setTextCursor(cursor);
     
+    // The finished edit becomes one undo step, and its text is re-indexed
+    if (was_editing && toPlainText() != m_text_before_edit) {
+        SearchIndex::instance().markDirty(this);
+        UndoHistory::instance().push(scene(), new TextEditCommand(this, m_text_before_edit));
+    }
+    m_text_before_edit.clear();
+    
     // Call parent method
     QGraphicsTextItem::focusOutEvent(event);
 }
@@ -524,13 +1004,13 @@ qreal EditableTextItem::getTotalHeightRequirement() const
     qreal total_height = boundingRect().height() + 20; // Add some vertical spacing
     
     // If no children, just return this node's height
-    if (m_child_nodes.isEmpty()) {
+    if (m_links.isEmpty()) {
         return total_height;
     }
     
     // Calculate sum of all children's height requirements
     qreal children_height = 0;
-    for (EditableTextItem *child : m_child_nodes) {
+    for (EditableTextItem *child : childNodes()) {
         children_height += child->getTotalHeightRequirement();
     }
     
@@ -541,19 +1021,22 @@ qreal EditableTextItem::getTotalHeightRequirement() const
 // Organize layout of this node's children
 void EditableTextItem::organizeChildrenLayout()
 {
+    TRACE_SCOPE("EditableTextItem::organizeChildrenLayout", "layout");
+
     // If no children, nothing to organize
-    if (m_child_nodes.isEmpty()) {
+    if (m_links.isEmpty()) {
         return;
     }
     
     // Position children symmetrically around this node
     positionChildrenSymmetrically();
     
-    // Update connections after repositioning
-    updateConnections();
+    // Only the lines to the children moved; the line into this node was
+    // updated by the parent and walking up the tree here would be quadratic
+    updateChildConnections();
     
     // Recursively organize each child's children
-    for (EditableTextItem *child : m_child_nodes) {
+    for (EditableTextItem *child : childNodes()) {
         child->organizeChildrenLayout();
     }
 }
@@ -561,7 +1044,7 @@ void EditableTextItem::organizeChildrenLayout()
 // Position children symmetrically around this node
 void EditableTextItem::positionChildrenSymmetrically()
 {
-    if (m_child_nodes.isEmpty()) {
+    if (m_links.isEmpty()) {
         return;
     }
     
@@ -576,18 +1059,15 @@ void EditableTextItem::positionChildrenSymmetrically()
     qreal x_offset = parent_rect.width() + 100; // Increase distance for better visibility
     
     // Special case: if there's only one child, align it horizontally with parent
-    if (m_child_nodes.size() == 1) {
-        EditableTextItem *child = m_child_nodes.first();
+    if (m_links.size() == 1) {
+        EditableTextItem *child = m_links.at(0).child;
         
         // Position child at same y-level as parent
         child->setPos(parent_pos.x() + x_offset, parent_pos.y());
         
         // Update connection color
-        for (ConnectionLine* conn : m_connections) {
-            if (conn->targetItem() == child) {
-                conn->setColorByIndex(0);
-                break;
-            }
+        if (ConnectionLine *conn = m_links.at(0).line) {
+            conn->setColorByIndex(0);
         }
         return;
     }
@@ -596,7 +1076,7 @@ void EditableTextItem::positionChildrenSymmetrically()
     QList<qreal> child_heights;
     qreal total_height = 0;
     
-    for (EditableTextItem *child : m_child_nodes) {
+    for (EditableTextItem *child : childNodes()) {
         qreal height = child->boundingRect().height() + 30; // Increased vertical spacing
         child_heights.append(height);
         total_height += height;
@@ -606,8 +1086,8 @@ void EditableTextItem::positionChildrenSymmetrically()
     qreal start_y = parent_center_y - (total_height / 2);
     
     // Position each child
-    for (int i = 0; i < m_child_nodes.size(); ++i) {
-        EditableTextItem *child = m_child_nodes[i];
+    for (int i = 0; i < m_links.size(); ++i) {
+        EditableTextItem *child = m_links.at(i).child;
         QRectF child_rect = child->boundingRect();
         
         // Calculate y position for this child, accounting for the child's own height
@@ -616,17 +1096,162 @@ void EditableTextItem::positionChildrenSymmetrically()
         // Update child position - all children aligned on same x coordinate
         child->setPos(parent_pos.x() + x_offset, y_pos);
         
-        // Update connection colors
-        for (ConnectionLine* conn : m_connections) {
-            if (conn->targetItem() == child) {
-                conn->setColorByIndex(0);
-                break;
+        // Move to next position
+        start_y += child_heights[i];
+    }
+    
+    // Update connection colors (one line per child, so no per-child lookup)
+    for (const NodeLinks::Link &link : m_links) {
+        if (link.line) {
+            link.line->setColorByIndex(0);
+        }
+    }
+}
+
+QJsonObject EditableTextItem::toRecord() const
+{
+    QJsonObject record;
+    record["type"] = "text_node";
+    record["content"] = toPlainText();
+    if (m_style != 0) {
+        record["style"] = m_style;
+    }
+    return record;
+}
+
+EditableTextItem *EditableTextItem::fromRecord(const QJsonObject &record, const QVector<int> &style_map)
+{
+    // Create text item with its style, reusing a pooled one
+    EditableTextItem *text_item = ItemPool::instance().takeNode();
+    text_item->setStyle(StyleTable::instance().resolve(record, style_map));
+    
+    // Set the text last so the document is laid out once
+    text_item->setPlainText(record["content"].toString());
+    return text_item;
+}
+
+void EditableTextItem::collapse()
+{
+    TRACE_SCOPE("EditableTextItem::collapse", "canvas");
+
+    if (m_links.isEmpty() || isCollapsed()) {
+        return;
+    }
+    
+    QHash<const EditableTextItem*, QString> record_ids;
+    std::unique_ptr<CollapsedSubtree> subtree(new CollapsedSubtree(CollapsedSubtree::capture(this, &record_ids)));
+    
+    // Undo commands may still refer to the descendants
+    ItemRegistry::instance().hideItems(this, record_ids);
+    
+    // All descendants go in one batch, which also unlinks our children
+    QList<QGraphicsItem*> descendants;
+    QVector<EditableTextItem*> pending = childNodes().toVector();
+    while (!pending.isEmpty()) {
+        EditableTextItem *node = pending.takeLast();
+        descendants.append(node);
+        for (EditableTextItem *child : node->childNodes()) {
+            pending.append(child);
+        }
+    }
+    deleteItems(descendants);
+    
+    prepareGeometryChange();
+    m_collapsed_subtree = std::move(subtree);
+    updateBadge();
+}
+
+void EditableTextItem::expand()
+{
+    TRACE_SCOPE("EditableTextItem::expand", "canvas");
+
+    if (!isCollapsed() || !scene()) {
+        return;
+    }
+    
+    prepareGeometryChange();
+    std::unique_ptr<CollapsedSubtree> subtree = std::move(m_collapsed_subtree);
+    updateBadge();
+    
+    // Create the nodes up to nested collapsed ones, which keep their
+    // descendants as records
+    QHash<QString, QJsonObject> records = subtree->recordsById();
+    QHash<QString, EditableTextItem*> nodes;
+    QList<EditableTextItem*> created; // In creation order
+    QVector<QPair<EditableTextItem*, QJsonArray>> links; // Node and its child ids
+    QVector<QString> pending;
+    const QJsonArray child_ids = subtree->childIds();
+    for (int i = child_ids.size() - 1; i >= 0; --i) {
+        pending.append(child_ids[i].toString());
+    }
+    while (!pending.isEmpty()) {
+        QString id = pending.takeLast();
+        auto it = records.constFind(id);
+        if (it == records.constEnd() || nodes.contains(id)) {
+            continue;
+        }
+        
+        const QJsonObject &record = it.value();
+        EditableTextItem *node = fromRecord(record);
+        node->setPos(pos() + QPointF(record["x"].toDouble(), record["y"].toDouble()));
+        nodes.insert(id, node);
+        created.append(node);
+        
+        if (record["collapsed"].toBool()) {
+            CollapsedSubtree hidden = subtree->extract(id);
+            if (!hidden.isEmpty()) {
+                node->setCollapsedSubtree(hidden);
             }
+        } else {
+            QJsonArray record_child_ids = record["child_nodes"].toArray();
+            links.append(qMakePair(node, record_child_ids));
+            for (int i = record_child_ids.size() - 1; i >= 0; --i) {
+                pending.append(record_child_ids[i].toString());
+            }
+        }
+    }
+    
+    // Nodes and their connection lines go in with the index suspended
+    SceneIndexSuspender suspend_index(scene(), created.size() * 2);
+    for (EditableTextItem *node : created) {
+        scene()->addItem(node);
+    }
+    
+    // Link in a second pass, connections need both ends in the scene
+    for (const QJsonValue &child_id : child_ids) {
+        addChildNode(nodes.value(child_id.toString()));
+    }
+    for (const auto &link : links) {
+        for (const QJsonValue &child_id : link.second) {
+            link.first->addChildNode(nodes.value(child_id.toString()));
         }
-        
-        // Move to next position
-        start_y += child_heights[i];
     }
+    
+    ItemRegistry::instance().restoreHidden(this, nodes);
+}
+
+void EditableTextItem::setCollapsedSubtree(const CollapsedSubtree &subtree)
+{
+    prepareGeometryChange();
+    m_collapsed_subtree.reset(new CollapsedSubtree(subtree));
+    updateBadge();
+}
+
+void EditableTextItem::updateBadge()
+{
+    if (!isCollapsed()) {
+        m_badge_text.clear();
+        m_badge_size = QSizeF();
+        update();
+        return;
+    }
+    
+    // Cache the text and size, the count only changes with the subtree
+    m_badge_text = QString("+%1").arg(m_collapsed_subtree->nodeCount());
+    QFontMetricsF metrics(badgeFont());
+    m_badge_size = QSizeF(metrics.horizontalAdvance(m_badge_text) + metrics.height(),
+                          metrics.height() + 4);
+    update();
 }
 
 // InfiniteCanvas implementation
@@ -634,7 +1259,8 @@ InfiniteCanvas::InfiniteCanvas(QGraphicsScene *scene, QWidget *parent)
     : QGraphicsView(scene, parent),
       m_scale_factor(1.0),
       m_max_scale(4.0),
-      m_min_scale(0.1) {
+      m_min_scale(0.1),
+      m_drag_may_move(false) {
   setDragMode(QGraphicsView::ScrollHandDrag);
   // Only enable antialiasing for shapes, not for grid points
   setRenderHints(QPainter::Antialiasing);
@@ -650,6 +1276,12 @@ InfiniteCanvas::InfiniteCanvas(QGraphicsScene *scene, QWidget *parent)
   setAcceptDrops(true);
 }
 
+void InfiniteCanvas::paintEvent(QPaintEvent *event) {
+    TRACE_SCOPE("InfiniteCanvas::paintEvent", "paint");
+    
+    QGraphicsView::paintEvent(event);
+}
+
 void InfiniteCanvas::wheelEvent(QWheelEvent *event) {
   // Only zoom if Ctrl key is pressed
   if (event->modifiers() & Qt::ControlModifier) {
@@ -677,8 +1309,9 @@ void InfiniteCanvas::wheelEvent(QWheelEvent *event) {
 
 void InfiniteCanvas::dragEnterEvent(QDragEnterEvent *event)
 {
-    // Accept if the drag event contains image data, urls, or text
-    if (event->mimeData()->hasImage() || 
+    // Accept if the drag event contains map items, image data, urls, or text
+    if (event->mimeData()->hasFormat(MapClipboard::kMimeType) ||
+        event->mimeData()->hasImage() || 
         event->mimeData()->hasUrls() || 
         event->mimeData()->hasText()) {
         event->acceptProposedAction();
@@ -710,44 +1343,33 @@ bool InfiniteCanvas::processItemFromMimeData(const QMimeData *mime_data, const Q
     
     bool handled = false;
     
-    // Handle URL data (including shortcuts and directories)
-    if (mime_data->hasUrls()) {
-        QList<QUrl> urls = mime_data->urls();
-        
-        for (const QUrl &url : urls) {
-            if (url.isLocalFile()) {
-                QString file_path = url.toLocalFile();
-                QFileInfo file_info(file_path);
-                
-                // Check if it's a directory
-                if (isDirectory(file_path)) {
-                    handleDirectoryDrop(url, pos);
-                    handled = true;
-                    break;
-                }
-                // Check if it's a Windows shortcut file
-                else if (file_info.suffix().toLower() == "lnk") {
-                    handleShortcutDrop(url, pos);
-                    handled = true;
-                    break;
-                }
-                // Check if it's a media file
-                else if (isMediaFile(file_path)) {
-                    handleMediaDrop(url, pos);
-                    handled = true;
-                    break;
-                }
+    // Items copied from a map come back with their links and layout
+    if (mime_data->hasFormat(MapClipboard::kMimeType)) {
+        QList<QGraphicsItem*> items = MapClipboard::paste(scene(), mime_data->data(MapClipboard::kMimeType), pos);
+        if (!items.isEmpty()) {
+            scene()->clearSelection();
+            for (QGraphicsItem *item : items) {
+                item->setSelected(true);
             }
+            recordInsertedItems(items, QObject::tr("Insert Items"));
+            return true;
         }
+    }
+    
+    // Handle URL data (files, folders, shortcuts and websites), one item per URL
+    if (mime_data->hasUrls()) {
+        QList<QUrl> urls = mime_data->urls();
+        bool has_local_file = std::any_of(urls.cbegin(), urls.cend(),
+                                          [](const QUrl &url) { return url.isLocalFile(); });
         
-        // If not handled as a directory, shortcut, or media file, try handling as an image
-        if (!handled && (mime_data->hasImage() || mime_data->hasUrls())) {
-            handleImageDrop(mime_data, pos);
-            handled = true;
+        // Browsers put the image data next to its web address; prefer the image then
+        if (has_local_file || !mime_data->hasImage()) {
+            handled = importUrls(urls, pos);
         }
     }
+    
     // Handle image data if no URLs or URLs weren't handled
-    else if (!handled && mime_data->hasImage()) {
+    if (!handled && mime_data->hasImage()) {
         handleImageDrop(mime_data, pos);
         handled = true;
     }
@@ -761,97 +1383,301 @@ bool InfiniteCanvas::processItemFromMimeData(const QMimeData *mime_data, const Q
     return handled;
 }
 
-void InfiniteCanvas::handleImageDrop(const QMimeData *mime_data, const QPointF &pos)
+// Result of classifying one imported URL on a worker thread
+struct InfiniteCanvas::UrlImport
 {
-    QImage image;
-    QString file_path;
-    
-    // Try to get image directly from mime data
-    if (mime_data->hasImage()) {
-        image = qvariant_cast<QImage>(mime_data->imageData());
+    enum Kind { Skip, Directory, Shortcut, Media, Image, Website };
+
+    Kind kind = Skip;
+    QUrl url;
+    QString path;     // Local path, or the target of a shortcut
+    QSize image_size; // Image size from the file header
+};
+
+namespace {
+// Gap between imported items
+constexpr qreal kImportSpacing = 20.0;
+}
+
+bool InfiniteCanvas::importUrls(const QList<QUrl> &urls, const QPointF &pos)
+{
+    // Keep local files and web addresses, other schemes have no item type
+    QList<QUrl> importable;
+    for (const QUrl &url : urls) {
+        QString scheme = url.scheme().toLower();
+        if (url.isLocalFile() || scheme == "http" || scheme == "https" || scheme == "ftp") {
+            importable.append(url);
+        }
     }
-    // Try to load image from URLs
-    else if (mime_data->hasUrls()) {
-        QList<QUrl> urls = mime_data->urls();
-        for (const QUrl &url : urls) {
-            // Only handle local files
-            if (url.isLocalFile()) {
-                file_path = url.toLocalFile();
-                QImageReader reader(file_path);
-                if (reader.canRead()) {
-                    image = reader.read();
-                    break;
-                }
+    if (importable.isEmpty()) {
+        return false;
+    }
+
+    // State shared by the classification tasks
+    struct Batch {
+        QVector<UrlImport> entries;
+        QAtomicInt remaining;
+        QPointF pos;
+        QPointer<EditableTextItem> target; // Node the URLs were dropped onto
+    };
+    QSharedPointer<Batch> batch = QSharedPointer<Batch>::create();
+    batch->entries.resize(importable.size());
+    batch->pos = pos;
+    batch->target = dynamic_cast<EditableTextItem*>(scene()->itemAt(pos, transform()));
+
+    // Each task classifies every n-th URL, writing only its own entries
+    UrlImport *entries = batch->entries.data();
+    int task_count = qMin(importable.size(), qMax(1, QThread::idealThreadCount()));
+    batch->remaining.storeRelaxed(task_count);
+    QPointer<InfiniteCanvas> canvas(this);
+
+    for (int task = 0; task < task_count; ++task) {
+        QThreadPool::globalInstance()->start([canvas, batch, entries, importable, task, task_count]() {
+            for (int i = task; i < importable.size(); i += task_count) {
+                entries[i] = classifyUrl(importable.at(i));
+            }
+
+            // The last task to finish hands the batch to the GUI thread
+            if (!batch->remaining.deref()) {
+                QMetaObject::invokeMethod(qApp, [canvas, batch]() {
+                    if (canvas) {
+                        canvas->insertImportedUrls(batch->entries, batch->pos, batch->target);
+                    }
+                }, Qt::QueuedConnection);
             }
+        });
+    }
+
+    return true;
+}
+
+// Classify a URL (runs on a worker thread)
+InfiniteCanvas::UrlImport InfiniteCanvas::classifyUrl(const QUrl &url)
+{
+    UrlImport entry;
+    entry.url = url;
+
+    if (!url.isLocalFile()) {
+        entry.kind = UrlImport::Website;
+        return entry;
+    }
+
+    QString file_path = url.toLocalFile();
+    entry.path = file_path;
+
+    if (isDirectory(file_path)) {
+        entry.kind = UrlImport::Directory;
+    }
+    else if (QFileInfo(file_path).suffix().toLower() == "lnk") {
+        // Resolving goes through COM and may have to wake up the target's drive
+        entry.path = resolveShortcutTarget(file_path);
+        if (!entry.path.isEmpty()) {
+            entry.kind = UrlImport::Shortcut;
         }
     }
-    
-    if (!image.isNull()) {
-        // Create a pixmap item from the image
-        QGraphicsPixmapItem *pixmap_item = new QGraphicsPixmapItem(QPixmap::fromImage(image));
-        
-        // Position the image at the drop position
-        pixmap_item->setPos(pos);
-        
-        // Store the file path for serialization
-        if (!file_path.isEmpty()) {
-            pixmap_item->setData(0, file_path);
+    else if (isMediaFile(file_path)) {
+        entry.kind = UrlImport::Media;
+    }
+    else if (isImageFile(file_path)) {
+        // The header gives the size for the layout without decoding the image
+        QImageReader reader(file_path);
+        entry.image_size = reader.size();
+        if (reader.transformation() & QImageIOHandler::TransformationRotate90) {
+            entry.image_size.transpose();
         }
-        
-        // Add to scene
-        scene()->addItem(pixmap_item);
-        
-        // Make the item selectable and movable
-        pixmap_item->setFlag(QGraphicsItem::ItemIsSelectable, true);
-        pixmap_item->setFlag(QGraphicsItem::ItemIsMovable, true);
+        entry.kind = UrlImport::Image;
     }
+
+    return entry;
 }
 
-void InfiniteCanvas::handleShortcutDrop(const QUrl &url, const QPointF &pos)
+void InfiniteCanvas::insertImportedUrls(const QVector<UrlImport> &entries, const QPointF &pos,
+                                        EditableTextItem *target)
 {
-    QString shortcut_path = url.toLocalFile();
-    QString target_path = resolveShortcutTarget(shortcut_path);
-    
-    if (!target_path.isEmpty()) {
-        // Get icon for the shortcut
-        QPixmap icon = getFileIcon(target_path);
-        
-        // Create the shortcut item
-        ShortcutItem *shortcut_item = new ShortcutItem(icon, target_path);
-        
-        // Position at drop location
-        shortcut_item->setPos(pos);
-        
-        // Add to scene
-        scene()->addItem(shortcut_item);
-        
-        // Set tooltip to show target path
-        shortcut_item->setToolTip(target_path);
+    TRACE_SCOPE("InfiniteCanvas::insertImportedUrls", "canvas");
+
+    QList<QGraphicsItem*> items;
+    items.reserve(entries.size());
+
+    for (const UrlImport &entry : entries) {
+        switch (entry.kind) {
+        case UrlImport::Directory: {
+            DirectoryItem *dir_item = new DirectoryItem(getDirectoryIcon(entry.path), entry.path);
+            dir_item->setToolTip(entry.path);
+            items.append(dir_item);
+            break;
+        }
+        case UrlImport::Shortcut: {
+            // Per-file icons are read on the icon loader's pool
+            ShortcutItem *shortcut_item = new ShortcutItem(IconCache::instance().placeholderIcon(), entry.path);
+            IconLoader::instance().requestFileIcon(shortcut_item, entry.path);
+            shortcut_item->setToolTip(entry.path);
+            items.append(shortcut_item);
+            break;
+        }
+        case UrlImport::Media: {
+            MediaItem *media_item = new MediaItem(getMediaIcon(entry.path), entry.path);
+            media_item->setToolTip(entry.path);
+            items.append(media_item);
+            break;
+        }
+        case UrlImport::Image:
+            items.append(new ImageItem(entry.path, entry.image_size));
+            break;
+        case UrlImport::Website: {
+            UrlItem *url_item = new UrlItem(getWebsiteIcon(entry.url), entry.url);
+            IconLoader::instance().requestWebsiteIcon(url_item, entry.url);
+            url_item->setToolTip(entry.url.toString());
+            items.append(url_item);
+            break;
+        }
+        case UrlImport::Skip:
+            qDebug() << "Skipping unsupported item:" << entry.url.toString();
+            break;
+        }
+    }
+
+    if (items.isEmpty()) {
+        return;
+    }
+
+    // Items dropped onto a node are placed beside it, others at the drop position
+    QPointF origin = pos;
+    if (target && target->scene() == scene()) {
+        origin = target->sceneBoundingRect().topRight() + QPointF(kImportSpacing * 2, 0);
+    }
+
+    // Lay the items out in rows of a roughly square grid
+    qreal row_width = qCeil(qSqrt(items.size())) * (kMaxLabelWidth + kImportSpacing);
+    qreal x = 0;
+    qreal y = 0;
+    qreal row_height = 0;
+    for (QGraphicsItem *item : items) {
+        QRectF rect = item->boundingRect();
+        if (x > 0 && x + rect.width() > row_width) {
+            x = 0;
+            y += row_height + kImportSpacing;
+            row_height = 0;
+        }
+        item->setPos(origin + QPointF(x - rect.left(), y - rect.top()));
+        x += rect.width() + kImportSpacing;
+        row_height = qMax(row_height, rect.height());
+    }
+
+    addItemsInBatch(items);
+    recordInsertedItems(items, QObject::tr("Insert Items"));
+
+    // The inserted items become the selection
+    scene()->clearSelection();
+    for (QGraphicsItem *item : items) {
+        item->setSelected(true);
+    }
+}
+
+void InfiniteCanvas::addItemsInBatch(const QList<QGraphicsItem*> &items)
+{
+    SceneIndexSuspender suspend_index(scene(), items.size());
+
+    for (QGraphicsItem *item : items) {
+        scene()->addItem(item);
+    }
+}
+
+void InfiniteCanvas::recordInsertedItems(const QList<QGraphicsItem*> &items, const QString &text)
+{
+    // Only the ids are kept while the items exist
+    UndoHistory &history = UndoHistory::instance();
+    if (!items.isEmpty() && history.isTracking(scene())) {
+        history.push(scene(), new ItemSetCommand(scene(), items, ItemSetCommand::Added, text));
+    }
+}
+
+void InfiniteCanvas::pasteOutline(const QVector<OutlineEntry> &outline, const QPointF &pos)
+{
+    TRACE_SCOPE("InfiniteCanvas::pasteOutline", "canvas");
+
+    QList<EditableTextItem*> nodes;
+    QList<EditableTextItem*> roots;
+    QVector<EditableTextItem*> parents; // Open ancestors, indexed by depth
+    nodes.reserve(outline.size());
+
+    // Create all nodes before anything touches the scene. The text is set
+    // after the style so each document is laid out only once.
+    for (const OutlineEntry &entry : outline) {
+        EditableTextItem *node = new EditableTextItem(QString());
+        node->setStyle(StyleTable::instance().depthStyle(entry.depth));
+        node->setPlainText(entry.text);
+
+        // The parser guarantees depth <= number of open ancestors
+        parents.resize(entry.depth);
+        if (parents.isEmpty()) {
+            roots.append(node);
+        }
+        parents.append(node);
+        nodes.append(node);
+    }
+
+    // Nodes and their connection lines go in with the index suspended
+    SceneIndexSuspender suspend_index(scene(), nodes.size() * 2);
+
+    for (EditableTextItem *node : nodes) {
+        scene()->addItem(node);
+    }
+
+    // Link in a second pass, connections need both ends in the scene
+    parents.clear();
+    for (int i = 0; i < outline.size(); ++i) {
+        parents.resize(outline[i].depth);
+        if (!parents.isEmpty()) {
+            parents.last()->addChildNode(nodes[i]);
+        }
+        parents.append(nodes[i]);
     }
+
+    // Stack the top level entries and lay out each tree once
+    qreal y = pos.y();
+    QList<QGraphicsItem*> root_items;
+    for (EditableTextItem *root : roots) {
+        qreal height = root->getTotalHeightRequirement();
+        root->setPos(pos.x(), y + (height - root->boundingRect().height()) / 2);
+        root->organizeChildrenLayout();
+        y += height;
+        root_items.append(root);
+    }
+
+    // Undoing removes the trees with their roots
+    recordInsertedItems(root_items, QObject::tr("Insert Items"));
 }
 
-void InfiniteCanvas::handleDirectoryDrop(const QUrl &url, const QPointF &pos)
+void InfiniteCanvas::handleImageDrop(const QMimeData *mime_data, const QPointF &pos)
 {
-    QString dir_path = url.toLocalFile();
+    ImageItem *image_item = nullptr;
     
-    if (isDirectory(dir_path)) {
-        // Get directory icon
-        QPixmap icon = getDirectoryIcon(dir_path);
-        
-        // Create the directory item
-        DirectoryItem *dir_item = new DirectoryItem(icon, dir_path);
-        
-        // Position at drop location
-        dir_item->setPos(pos);
+    // Try to get image directly from mime data
+    if (mime_data->hasImage()) {
+        QImage image = qvariant_cast<QImage>(mime_data->imageData());
+        if (!image.isNull()) {
+            image_item = new ImageItem(image);
+        }
+    }
+    
+    if (image_item) {
+        // Position the image at the drop position
+        image_item->setPos(pos);
         
         // Add to scene
-        scene()->addItem(dir_item);
-        
-        // Set tooltip to show complete directory path
-        dir_item->setToolTip(dir_path);
+        scene()->addItem(image_item);
+        recordInsertedItems({image_item}, QObject::tr("Insert Items"));
     }
 }
 
+// Check by extension whether a file is a readable image, without touching the file
+bool InfiniteCanvas::isImageFile(const QString &file_path)
+{
+    static const QList<QByteArray> formats = QImageReader::supportedImageFormats();
+    return formats.contains(QFileInfo(file_path).suffix().toLower().toLatin1());
+}
+
 void InfiniteCanvas::handleTextDrop(const QMimeData *mime_data, const QPointF &pos)
 {
     if (mime_data->hasText()) {
@@ -861,20 +1687,25 @@ void InfiniteCanvas::handleTextDrop(const QMimeData *mime_data, const QPointF &p
             // Check if the text is a URL
             if (isUrl(text)) {
                 handleUrlDrop(text, pos);
+                return;
+            }
+            
+            // Outlines (indented text, Markdown lists and headings) become a tree of nodes
+            bool structured = false;
+            QVector<OutlineEntry> outline = OutlineParser::parse(text, &structured);
+            if (structured && outline.size() > 1) {
+                pasteOutline(outline, pos);
             } else {
                 // Create custom text item with double-click editing
                 EditableTextItem *text_item = new EditableTextItem(text);
-                
-                // Set font and color
-                QFont font("Arial", 12);
-                text_item->setFont(font);
-                text_item->setDefaultTextColor(Qt::black);
+                text_item->setStyle(StyleTable::instance().depthStyle(0));
                 
                 // Set position
                 text_item->setPos(pos);
                 
                 // Add to scene
                 scene()->addItem(text_item);
+                recordInsertedItems({text_item}, QObject::tr("Insert Items"));
             }
         }
     }
@@ -894,11 +1725,11 @@ void InfiniteCanvas::handleUrlDrop(const QString &url_str, const QPointF &pos)
     QUrl url(normalized_url);
     
     if (url.isValid()) {
-        // Get icon for the website
-        QPixmap icon = getWebsiteIcon(url);
+        // Create the URL item with the letter glyph
+        UrlItem *url_item = new UrlItem(getWebsiteIcon(url), url);
         
-        // Create the URL item
-        UrlItem *url_item = new UrlItem(icon, url);
+        // Fetch the site's favicon in the background
+        IconLoader::instance().requestWebsiteIcon(url_item, url);
         
         // Position at drop location
         url_item->setPos(pos);
@@ -908,30 +1739,14 @@ void InfiniteCanvas::handleUrlDrop(const QString &url_str, const QPointF &pos)
         
         // Set tooltip to show full URL
         url_item->setToolTip(url.toString());
+        recordInsertedItems({url_item}, QObject::tr("Insert Items"));
     }
 }
 
-// Get website icon using network request to fetch favicon
+// Get website icon (shared per host)
 QPixmap InfiniteCanvas::getWebsiteIcon(const QUrl &url)
 {
-    // Create a default icon with domain initial
-    QPixmap fallback_icon(64, 64);
-    fallback_icon.fill(Qt::lightGray);
-    
-    QPainter painter(&fallback_icon);
-    painter.setPen(Qt::blue);
-    painter.setFont(QFont("Arial", 32, QFont::Bold));
-    
-    QString letter;
-    if (url.host().isEmpty()) {
-        letter = "W";
-    } else {
-        QChar first_char = url.host().at(0).toUpper();
-        letter = QString(first_char);
-    }
-    painter.drawText(fallback_icon.rect(), Qt::AlignCenter, letter);
-    
-    return fallback_icon;
+    return IconCache::instance().websiteIcon(url);
 }
 
 // Check if text is a URL
@@ -981,14 +1796,21 @@ void InfiniteCanvas::contextMenuEvent(QContextMenuEvent *event)
             // Add "Add Child Node" action to the menu
             QAction *add_child_action = context_menu.addAction(QObject::tr("Add Child Node"));
             connect(add_child_action, &QAction::triggered, [this, text_node]() {
+                // The new child joins the node's visible children
+                if (text_node->isCollapsed()) {
+                    UndoHistory::instance().push(scene(), new CollapseCommand(text_node, CollapseCommand::Expand));
+                }
+                
                 // Calculate position for new child (below and to the right)
                 QPointF child_pos = text_node->pos() + QPointF(50, 50);
                 
                 // Create child node
-                EditableTextItem *child_node = createTextNode(child_pos, "Child Node");
+                EditableTextItem *child_node = createTextNode(child_pos, "Child Node",
+                                                              text_node->getDepthLevel() + 1);
                 
                 // Add as child
                 text_node->addChildNode(child_node);
+                recordInsertedItems({child_node}, QObject::tr("Add Child Node"));
             });
             
             // Add "Organize Layout" action to the menu
@@ -997,6 +1819,28 @@ void InfiniteCanvas::contextMenuEvent(QContextMenuEvent *event)
                 organizeLayoutFromNode(text_node);
             });
             
+            // Add "Collapse" or "Expand" for nodes with children
+            if (text_node->isCollapsed()) {
+                QAction *expand_action = context_menu.addAction(QObject::tr("Expand"));
+                connect(expand_action, &QAction::triggered, [this, text_node]() {
+                    UndoHistory::instance().push(scene(), new CollapseCommand(text_node, CollapseCommand::Expand));
+                });
+            } else if (!text_node->childNodes().isEmpty()) {
+                QAction *collapse_action = context_menu.addAction(QObject::tr("Collapse"));
+                connect(collapse_action, &QAction::triggered, [this, text_node]() {
+                    UndoHistory::instance().push(scene(), new CollapseCommand(text_node, CollapseCommand::Collapse));
+                });
+            }
+            
+            // Add "Detach from Parent" to make a child node a root
+            if (text_node->parentNode()) {
+                QAction *detach_action = context_menu.addAction(QObject::tr("Detach from Parent"));
+                connect(detach_action, &QAction::triggered, [this, text_node]() {
+                    UndoHistory::instance().push(scene(), new ReparentCommand(text_node, nullptr, -1,
+                                                                             QObject::tr("Detach from Parent")));
+                });
+            }
+            
             context_menu.addSeparator();
         }
         
@@ -1011,7 +1855,8 @@ void InfiniteCanvas::contextMenuEvent(QContextMenuEvent *event)
         // If no selection, add action to create a new text node
         QAction *new_node_action = context_menu.addAction(QObject::tr("Create New Node"));
         connect(new_node_action, &QAction::triggered, [this, scene_pos]() {
-            createTextNode(scene_pos);
+            EditableTextItem *text_node = createTextNode(scene_pos);
+            recordInsertedItems({text_node}, QObject::tr("Create New Node"));
         });
     }
     
@@ -1029,58 +1874,8 @@ void InfiniteCanvas::copySelectedItemsToClipboard()
         return;
     }
     
-    // If multiple items are selected, only copy the first one
-    QGraphicsItem *item = selected_items.first();
-    
-    // Create a new mime data object
-    QMimeData *mime_data = new QMimeData();
-    
-    // Handle text items
-    if (QGraphicsTextItem *text_item = dynamic_cast<QGraphicsTextItem*>(item)) {
-        QString text = text_item->toPlainText();
-        mime_data->setText(text);
-    }
-    // Handle URL items
-    else if (item->data(1).toString() == "url") {
-        QString url_str = item->data(0).toString();
-        mime_data->setUrls(QList<QUrl>() << QUrl(url_str));
-        mime_data->setText(url_str);
-    }
-    // Handle shortcut items
-    else if (item->data(1).toString() == "shortcut") {
-        QString path = item->data(0).toString();
-        mime_data->setUrls(QList<QUrl>() << QUrl::fromLocalFile(path));
-        mime_data->setText(path);
-    }
-    // Handle directory items
-    else if (item->data(1).toString() == "directory") {
-        QString dir_path = item->data(0).toString();
-        mime_data->setUrls(QList<QUrl>() << QUrl::fromLocalFile(dir_path));
-        mime_data->setText(dir_path);
-    }
-    // Handle media items
-    else if (item->data(1).toString() == "media") {
-        QString media_path = item->data(0).toString();
-        mime_data->setUrls(QList<QUrl>() << QUrl::fromLocalFile(media_path));
-        mime_data->setText(media_path);
-    }
-    // Handle image items
-    else if (QGraphicsPixmapItem *pixmap_item = dynamic_cast<QGraphicsPixmapItem*>(item)) {
-        // First check if it has a file path stored
-        QVariant path_variant = pixmap_item->data(0);
-        if (path_variant.isValid()) {
-            QString file_path = path_variant.toString();
-            mime_data->setUrls(QList<QUrl>() << QUrl::fromLocalFile(file_path));
-            mime_data->setText(file_path);
-        }
-        
-        // Also add the image data
-        QPixmap pixmap = pixmap_item->pixmap();
-        mime_data->setImageData(pixmap.toImage());
-    }
-    
-    // Set the mime data to the clipboard
-    QApplication::clipboard()->setMimeData(mime_data);
+    // The data of each format is only produced when it is pasted
+    QApplication::clipboard()->setMimeData(MapClipboard::mimeData(scene(), selected_items));
 }
 
 // Method to delete selected items
@@ -1088,12 +1883,13 @@ void InfiniteCanvas::deleteSelectedItems()
 {
     // Get the list of selected items
     QList<QGraphicsItem*> selected_items = scene()->selectedItems();
-    
-    // Delete each selected item
-    for (QGraphicsItem *item : selected_items) {
-        scene()->removeItem(item);
-        delete item;
+    if (selected_items.isEmpty()) {
+        return;
     }
+    
+    // Nodes go with their descendants, all in one undo step
+    UndoHistory::instance().push(scene(), new ItemSetCommand(scene(), selected_items, ItemSetCommand::Removed,
+                                                             QObject::tr("Delete")));
 }
 
 // Check if the path is a directory
@@ -1109,47 +1905,16 @@ void InfiniteCanvas::openDirectory(const QString &dir_path)
     QDesktopServices::openUrl(QUrl::fromLocalFile(dir_path));
 }
 
-// Get file icon
+// Get file icon (shared per file type)
 QPixmap InfiniteCanvas::getFileIcon(const QString &file_path)
 {
-    QFileIconProvider icon_provider;
-    QFileInfo file_info(file_path);
-    QIcon icon = icon_provider.icon(file_info);
-    
-    // Get a reasonable size for the icon
-    QPixmap pixmap = icon.pixmap(64, 64);
-    
-    // If we got an empty pixmap, use a default
-    if (pixmap.isNull()) {
-        pixmap = QPixmap(64, 64);
-        pixmap.fill(Qt::transparent);
-    }
-    
-    return pixmap;
+    return IconCache::instance().fileIcon(file_path);
 }
 
-// Get directory icon
+// Get directory icon (shared by all folders)
 QPixmap InfiniteCanvas::getDirectoryIcon(const QString &dir_path)
 {
-    QFileIconProvider icon_provider;
-    QFileInfo dir_info(dir_path);
-    QIcon icon = icon_provider.icon(QFileIconProvider::Folder);
-    
-    // For specific folder, use its actual icon
-    if (dir_info.exists()) {
-        icon = icon_provider.icon(dir_info);
-    }
-    
-    // Get a reasonable size for the icon
-    QPixmap pixmap = icon.pixmap(64, 64);
-    
-    // If we got an empty pixmap, use a default
-    if (pixmap.isNull()) {
-        pixmap = QPixmap(64, 64);
-        pixmap.fill(Qt::transparent);
-    }
-    
-    return pixmap;
+    return IconCache::instance().directoryIcon(dir_path);
 }
 
 // Resolve shortcut target path
@@ -1218,28 +1983,6 @@ void InfiniteCanvas::resetZoom() {
     centerOn(center_point);
 }
 
-void InfiniteCanvas::handleMediaDrop(const QUrl &url, const QPointF &pos)
-{
-    QString media_path = url.toLocalFile();
-    
-    if (!media_path.isEmpty()) {
-        // Get media file icon
-        QPixmap icon = getMediaIcon(media_path);
-        
-        // Create the media item
-        MediaItem *media_item = new MediaItem(icon, media_path);
-        
-        // Position at drop location
-        media_item->setPos(pos);
-        
-        // Add to scene
-        scene()->addItem(media_item);
-        
-        // Set tooltip to show complete media path
-        media_item->setToolTip(media_path);
-    }
-}
-
 // Check if the file is a media file (audio/video)
 bool InfiniteCanvas::isMediaFile(const QString &file_path)
 {
@@ -1259,72 +2002,10 @@ bool InfiniteCanvas::isMediaFile(const QString &file_path)
     return audio_extensions.contains(suffix) || video_extensions.contains(suffix);
 }
 
-// Get media file icon
+// Get media file icon (shared per media type)
 QPixmap InfiniteCanvas::getMediaIcon(const QString &media_path)
 {
-    QFileIconProvider icon_provider;
-    QFileInfo file_info(media_path);
-    QIcon icon = icon_provider.icon(file_info);
-    
-    // Get a reasonable size for the icon
-    QPixmap pixmap = icon.pixmap(64, 64);
-    
-    // If we got an empty pixmap, use a default
-    if (pixmap.isNull()) {
-        pixmap = QPixmap(64, 64);
-        pixmap.fill(Qt::transparent);
-        
-        // Draw a media-specific default icon
-        QPainter painter(&pixmap);
-        
-        // Different colors for audio vs video
-        QString suffix = file_info.suffix().toLower();
-        
-        // Audio file extensions
-        static const QStringList audio_extensions = {
-            "mp3", "wav", "ogg", "flac", "aac", "wma", "m4a", "aiff"
-        };
-        
-        // Video file extensions
-        static const QStringList video_extensions = {
-            "mp4", "avi", "mov", "wmv", "mkv", "flv", "webm", "m4v", "mpg", "mpeg"
-        };
-        
-        if (audio_extensions.contains(suffix)) {
-            // Audio icon (blue)
-            painter.setBrush(QColor(100, 149, 237)); // Cornflower blue
-            painter.setPen(Qt::black);
-            painter.drawEllipse(8, 8, 48, 48);
-            
-            // Draw audio wave symbol
-            QPainterPath path;
-            path.moveTo(24, 22);
-            path.lineTo(24, 42);
-            path.moveTo(32, 18);
-            path.lineTo(32, 46);
-            path.moveTo(40, 22);
-            path.lineTo(40, 42);
-            
-            painter.setPen(QPen(Qt::white, 3));
-            painter.drawPath(path);
-        } 
-        else if (video_extensions.contains(suffix)) {
-            // Video icon (red)
-            painter.setBrush(QColor(205, 92, 92)); // Indian red
-            painter.setPen(Qt::black);
-            painter.drawRect(8, 8, 48, 48);
-            
-            // Draw video play symbol
-            QPolygonF triangle;
-            triangle << QPointF(24, 18) << QPointF(44, 32) << QPointF(24, 46);
-            
-            painter.setBrush(Qt::white);
-            painter.setPen(Qt::NoPen);
-            painter.drawPolygon(triangle);
-        }
-    }
-    
-    return pixmap;
+    return IconCache::instance().mediaIcon(media_path);
 }
 
 void InfiniteCanvas::pasteFromClipboard()
@@ -1363,9 +2044,12 @@ void InfiniteCanvas::pasteFromClipboard()
     if (success) {
         qDebug() << "Successfully pasted item from clipboard";
         
-        // Select the last added item (which should be the one we just pasted)
+        // Select the last added item (which should be the one we just pasted);
+        // pasted map items are selected already, and imported URLs select
+        // themselves once they are inserted
         QList<QGraphicsItem*> all_items = scene()->items();
-        if (!all_items.isEmpty()) {
+        if (!all_items.isEmpty() && !mime_data->hasFormat(MapClipboard::kMimeType) &&
+            !mime_data->hasUrls()) {
             all_items.first()->setSelected(true);
         }
     } else {
@@ -1406,16 +2090,103 @@ void InfiniteCanvas::copyToClipboard()
     copySelectedItemsToClipboard();
 }
 
+// Public delete method for MainWindow
+void InfiniteCanvas::deleteSelection()
+{
+    deleteSelectedItems();
+}
+
+// Remember where the selected items are when a drag may start
+void InfiniteCanvas::mousePressEvent(QMouseEvent *event)
+{
+    QGraphicsView::mousePressEvent(event);
+    
+    m_drag_start_positions.clear();
+    m_drag_may_move = false;
+    if (event->button() != Qt::LeftButton) {
+        return;
+    }
+    
+    QGraphicsItem *item = itemAt(event->pos());
+    if (!item || !(item->flags() & QGraphicsItem::ItemIsMovable)) {
+        return;
+    }
+    m_drag_may_move = true;
+    
+    if (UndoHistory::instance().isTracking(scene())) {
+        ItemRegistry &registry = ItemRegistry::instance();
+        for (QGraphicsItem *selected_item : scene()->selectedItems()) {
+            if (selected_item->flags() & QGraphicsItem::ItemIsMovable) {
+                m_drag_start_positions.append(qMakePair(registry.idOf(selected_item), selected_item->pos()));
+            }
+        }
+    }
+}
+
+// Copied items are taken as they were before the first move of a drag
+void InfiniteCanvas::mouseMoveEvent(QMouseEvent *event)
+{
+    if (m_drag_may_move && (event->buttons() & Qt::LeftButton)) {
+        m_drag_may_move = false;
+        MapClipboard::aboutToChangeItems(scene()->selectedItems());
+    }
+    
+    QGraphicsView::mouseMoveEvent(event);
+}
+
+// Record a finished drag as one undo step
+void InfiniteCanvas::mouseReleaseEvent(QMouseEvent *event)
+{
+    QGraphicsView::mouseReleaseEvent(event);
+    
+    m_drag_may_move = false;
+    if (event->button() != Qt::LeftButton || m_drag_start_positions.isEmpty()) {
+        return;
+    }
+    
+    QList<QGraphicsItem*> moved_items;
+    QVector<QPointF> old_positions;
+    QPointF delta;
+    bool same_delta = true;
+    for (const auto &start : qAsConst(m_drag_start_positions)) {
+        QGraphicsItem *item = ItemRegistry::instance().item(start.first);
+        if (!item || item->scene() != scene() || item->pos() == start.second) {
+            continue;
+        }
+        
+        QPointF item_delta = item->pos() - start.second;
+        if (moved_items.isEmpty()) {
+            delta = item_delta;
+        } else if ((item_delta - delta).manhattanLength() > 0.01) {
+            same_delta = false;
+        }
+        moved_items.append(item);
+        old_positions.append(start.second);
+    }
+    m_drag_start_positions.clear();
+    
+    if (moved_items.isEmpty()) {
+        return;
+    }
+    
+    // Items dragged together share one offset, which merges with the next drag
+    MapCommand *command = nullptr;
+    if (same_delta) {
+        command = new MoveItemsCommand(scene(), moved_items, delta);
+    } else {
+        command = new PositionsCommand(scene(), moved_items, old_positions, QObject::tr("Move"));
+    }
+    UndoHistory::instance().push(scene(), command);
+}
+
 // Create a new text node at the specified position
-EditableTextItem* InfiniteCanvas::createTextNode(const QPointF &position, const QString &text)
+EditableTextItem* InfiniteCanvas::createTextNode(const QPointF &position, const QString &text, int depth)
 {
     // Create the text item
     EditableTextItem *text_item = new EditableTextItem(text);
     
-    // Set font and color
-    QFont font("Arial", 12);
-    text_item->setFont(font);
-    text_item->setDefaultTextColor(Qt::black);
+    // Style of nodes at its depth
+    text_item->setStyle(StyleTable::instance().depthStyle(depth));
     
     // Set position
     text_item->setPos(position);
@@ -1430,16 +2201,61 @@ EditableTextItem* InfiniteCanvas::createTextNode(const QPointF &position, const
     return text_item;
 }
 
+// Center the view on an item and select it
+void InfiniteCanvas::revealItem(QGraphicsItem *item)
+{
+    if (!item || item->scene() != scene()) {
+        return;
+    }
+    
+    centerOn(item);
+    scene()->clearSelection();
+    item->setSelected(true);
+}
+
 // Organize the entire mind map layout from the selected node
 void InfiniteCanvas::organizeLayoutFromNode(EditableTextItem* node)
 {
+    TRACE_SCOPE("InfiniteCanvas::organizeLayoutFromNode", "layout");
+
     if (!node) {
         return;
     }
     
+    // Remember the descendants' positions, undo swaps them back in one batch
+    bool tracking = UndoHistory::instance().isTracking(scene());
+    QList<QGraphicsItem*> descendants;
+    QVector<QPointF> old_positions;
+    QVector<EditableTextItem*> pending = node->childNodes().toVector();
+    while (!pending.isEmpty()) {
+        EditableTextItem *descendant = pending.takeLast();
+        descendants.append(descendant);
+        old_positions.append(descendant->pos());
+        for (EditableTextItem *child : descendant->childNodes()) {
+            pending.append(child);
+        }
+    }
+    MapClipboard::aboutToChangeItems(descendants);
+    
     // Organize the layout starting from this node
     node->organizeChildrenLayout();
     
+    if (tracking) {
+        // Only the nodes that moved are kept
+        QList<QGraphicsItem*> moved_items;
+        QVector<QPointF> moved_from;
+        for (int i = 0; i < descendants.size(); ++i) {
+            if (descendants[i]->pos() != old_positions[i]) {
+                moved_items.append(descendants[i]);
+                moved_from.append(old_positions[i]);
+            }
+        }
+        if (!moved_items.isEmpty()) {
+            UndoHistory::instance().push(scene(), new PositionsCommand(scene(), moved_items, moved_from,
+                                                                       QObject::tr("Organize Layout")));
+        }
+    }
+    
     // Update the scene
     scene()->update();
 }
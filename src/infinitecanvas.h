@@ -2,20 +2,29 @@
 #define INFINITECANVAS_H
 
 #include "pch.h"
+#include "imagedecoder.h"
+#include "nodelinks.h"
 
 // Forward declarations
 class EditableTextItem;
 class ConnectionLine;
+class CollapsedSubtree;
+class ItemPool;
+struct OutlineEntry;
 
 // Custom shortcut item class
 class ShortcutItem : public QGraphicsPixmapItem
 {
 public:
     ShortcutItem(const QPixmap &pixmap, const QString &target_path, QGraphicsItem *parent = nullptr);
+    ~ShortcutItem();
     
     // Get the target path of the shortcut
     QString getTargetPath() const { return m_target_path; }
     
+    // Show another target (when reused, see ItemPool)
+    void setTarget(const QPixmap &pixmap, const QString &target_path);
+    
 protected:
     void mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) override;
     
@@ -23,8 +32,42 @@ private:
     QString m_target_path;
 };
 
+// Base class for items that show an icon with a short label centered below it.
+// The icon and label are painted directly so each node is a single scene item
+// with an analytically computed bounding rect.
+class IconLabelItem : public QGraphicsItem
+{
+public:
+    IconLabelItem(const QPixmap &pixmap, const QString &label, QGraphicsItem *parent = nullptr);
+    ~IconLabelItem();
+    
+    // Replace the icon (geometry is recomputed if the size changes)
+    void setIcon(const QPixmap &pixmap);
+    QPixmap icon() const { return m_icon; }
+    
+    // Get the (elided) label text
+    QString label() const { return m_label; }
+    
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
+    
+protected:
+    // Set the label text, eliding it to the maximum label width
+    void setLabel(const QString &text);
+    
+private:
+    QPixmap m_icon;
+    QString m_label;
+    QRectF m_icon_rect;
+    QRectF m_label_rect;
+    QRectF m_bounding_rect;
+    
+    // Recompute icon, label and bounding rects
+    void updateGeometry();
+};
+
 // Custom URL item class
-class UrlItem : public QGraphicsItemGroup
+class UrlItem : public IconLabelItem
 {
 public:
     UrlItem(const QPixmap &pixmap, const QUrl &url, QGraphicsItem *parent = nullptr);
@@ -32,20 +75,21 @@ public:
     // Get the URL
     QUrl getUrl() const { return m_url; }
     
+    // Show another URL (when reused, see ItemPool)
+    void setUrl(const QPixmap &pixmap, const QUrl &url);
+    
 protected:
     void mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) override;
     
 private:
     QUrl m_url;
-    QGraphicsPixmapItem *m_icon_item;
-    QGraphicsSimpleTextItem *m_label_item;
     
     // Helper method to get website domain from URL
-    QString getDomainFromUrl(const QUrl &url);
+    static QString getDomainFromUrl(const QUrl &url);
 };
 
 // Custom directory item class
-class DirectoryItem : public QGraphicsItemGroup
+class DirectoryItem : public IconLabelItem
 {
 public:
     DirectoryItem(const QPixmap &pixmap, const QString &dir_path, QGraphicsItem *parent = nullptr);
@@ -53,20 +97,21 @@ public:
     // Get the directory path
     QString getDirPath() const { return m_dir_path; }
     
+    // Show another directory (when reused, see ItemPool)
+    void setDirPath(const QPixmap &pixmap, const QString &dir_path);
+    
 protected:
     void mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) override;
     
 private:
     QString m_dir_path;
-    QGraphicsPixmapItem *m_icon_item;
-    QGraphicsSimpleTextItem *m_label_item;
     
     // Helper method to get directory name from path
-    QString getDirName(const QString &path);
+    static QString getDirName(const QString &path);
 };
 
 // Custom media item class for audio/video files
-class MediaItem : public QGraphicsItemGroup
+class MediaItem : public IconLabelItem
 {
 public:
     MediaItem(const QPixmap &pixmap, const QString &media_path, QGraphicsItem *parent = nullptr);
@@ -74,16 +119,79 @@ public:
     // Get the media file path
     QString getMediaPath() const { return m_media_path; }
     
+    // Show another media file (when reused, see ItemPool)
+    void setMediaPath(const QPixmap &pixmap, const QString &media_path);
+    
 protected:
     void mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) override;
     
 private:
     QString m_media_path;
-    QGraphicsPixmapItem *m_icon_item;
-    QGraphicsSimpleTextItem *m_label_item;
     
     // Helper method to get file name from path
-    QString getFileName(const QString &path);
+    static QString getFileName(const QString &path);
+};
+
+// Image item that decodes its picture in the background.
+// Downscaled levels of the image are decoded on demand and painting picks
+// the level matching the current zoom, so large photos only occupy memory
+// at full resolution while they are viewed at full size.
+class ImageItem : public QGraphicsItem
+{
+public:
+    // Image from any source; size_hint avoids a layout jump when the size is already known
+    ImageItem(const ImageSource &source, const QSize &size_hint = QSize(), QGraphicsItem *parent = nullptr);
+    
+    // Image backed by a file
+    ImageItem(const QString &file_path, const QSize &size_hint = QSize(), QGraphicsItem *parent = nullptr);
+    
+    // Image backed by in-memory data (e.g. dropped from another application)
+    ImageItem(const QImage &image, QGraphicsItem *parent = nullptr);
+    ~ImageItem();
+    
+    // Get the image file path (empty for in-memory images)
+    QString filePath() const { return m_source.file_path; }
+    ImageSource source() const { return m_source; }
+    
+    // Switch to embedded image data stored under a blob key (see ImageBlobStore)
+    void embed(const ImageSource &embedded);
+    QString blobKey() const { return m_source.blob_key; }
+    
+    // Full resolution size in pixels (invalid until the image header was read)
+    QSize imageSize() const { return m_image_size; }
+    
+    // Decode the full resolution image on the calling thread
+    QImage fullImage() const;
+    
+    // Hand a decoded level to the item (called by ImageDecoder)
+    void setDecodedLevel(int level, const QPixmap &pixmap, const QSize &image_size);
+    
+    // Drop the pixels of a level (called by ImageResidency)
+    void evictLevel(int level);
+    
+    // Level drawn by the last paint, or -1
+    int paintedLevel() const { return m_painted_level; }
+    
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
+    
+private:
+    ImageSource m_source;
+    QSize m_image_size;
+    QVector<QPixmap> m_levels; // Decoded levels, null until needed or once evicted
+    int m_painted_level;
+    bool m_failed;
+    
+    void setImageSize(const QSize &image_size);
+    
+    // Store a decoded level and register it with the residency manager
+    void storeLevel(int level, const QPixmap &pixmap);
+    
+    // Level whose resolution matches a device scale factor
+    int levelForScale(qreal scale) const;
+    
+    // Decoded level closest to the wanted one (finer first), or -1
+    int closestDecodedLevel(int level) const;
 };
 
 // Connection line between nodes
@@ -95,6 +203,9 @@ public:
     // Update line position based on connected items
     void updatePosition();
     
+    // Connect other items (when reused, see ItemPool); null detaches
+    void setItems(EditableTextItem *from_item, EditableTextItem *to_item);
+    
     // Get source and target items
     EditableTextItem* sourceItem() const { return m_source_item; }
     EditableTextItem* targetItem() const { return m_target_item; }
@@ -116,13 +227,14 @@ public:
     EditableTextItem(const QString &text, QGraphicsItem *parent = nullptr);
     ~EditableTextItem();
     
-    // Add or remove a child node
-    void addChildNode(EditableTextItem *child_node);
+    // Add a child node (at index, or last) or remove one
+    void addChildNode(EditableTextItem *child_node, int index = -1);
     void removeChildNode(EditableTextItem *child_node);
     
-    // Get parent and child nodes
+    // Get parent and child nodes. The children are a view of the node's
+    // links, valid until they change.
     EditableTextItem* parentNode() const { return m_parent_node; }
-    QList<EditableTextItem*> childNodes() const { return m_child_nodes; }
+    NodeLinks::Children childNodes() const { return m_links.children(); }
     
     // Set parent node
     void setParentNode(EditableTextItem *parent);
@@ -130,6 +242,9 @@ public:
     // Update all connections
     void updateConnections();
     
+    // Update only the lines to the children
+    void updateChildConnections();
+    
     // Organize layout of children
     void organizeChildrenLayout();
     
@@ -145,20 +260,69 @@ public:
     // Get total height requirement for this node and all descendants
     qreal getTotalHeightRequirement() const;
     
+    // Replace the descendants by records (collapse) or recreate their items
+    // from the records in one batch (expand). A collapsed node shows the
+    // number of hidden descendants in a badge. Undo ids of the removed
+    // nodes go to the recreated ones (see ItemRegistry).
+    void collapse();
+    void expand();
+    bool isCollapsed() const { return m_collapsed_subtree != nullptr; }
+    
+    // Hidden descendants while collapsed, else null
+    const CollapsedSubtree *collapsedSubtree() const { return m_collapsed_subtree.get(); }
+    
+    // Collapse with the given hidden descendants (e.g. from a loaded map)
+    void setCollapsedSubtree(const CollapsedSubtree &subtree);
+    
+    // Style of the node (see StyleTable)
+    int style() const { return m_style; }
+    void setStyle(int index);
+    
+    // Node in the text_node format of maps (type, content and style). The
+    // style of records from a map file is resolved through the file's
+    // style_map (see StyleTable::resolve).
+    QJsonObject toRecord() const;
+    static EditableTextItem *fromRecord(const QJsonObject &record,
+                                        const QVector<int> &style_map = QVector<int>());
+    
+    // Delete many items at once (e.g. subtrees). Nodes that stay are
+    // unlinked from their deleted children in one pass each and links among
+    // deleted nodes are simply dropped, so the cost is linear in the number
+    // of items instead of quadratic in the number of siblings.
+    static void deleteItems(const QList<QGraphicsItem*> &items);
+    
+    // Delete every item of a scene, with all links dropped up front.
+    // Items that pool can reuse are handed to it instead.
+    static void clearScene(QGraphicsScene *scene, ItemPool *pool = nullptr);
+    
+    // Return to the state of a new, empty node without links (see ItemPool)
+    void resetForReuse();
+    
 protected:
     void mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
+    void inputMethodEvent(QInputMethodEvent *event) override;
     void focusOutEvent(QFocusEvent *event) override;
     void contextMenuEvent(QGraphicsSceneContextMenuEvent *event) override;
     void mouseMoveEvent(QGraphicsSceneMouseEvent *event) override;
     
 private:
-    QPointer<EditableTextItem> m_parent_node;
-    QList<EditableTextItem*> m_child_nodes;
-    QList<ConnectionLine*> m_connections;
+    EditableTextItem *m_parent_node; // Nulled by the parent when it goes
+    NodeLinks m_links; // Children with the lines to them
+    quint16 m_style; // Index in StyleTable
     qreal m_padding; // Padding around text for border
+    std::unique_ptr<CollapsedSubtree> m_collapsed_subtree;
+    QString m_badge_text; // Hidden descendant count while collapsed
+    QSizeF m_badge_size;
+    QString m_text_before_edit; // Text when editing started, for undo
     
     // Position children symmetrically
     void positionChildrenSymmetrically();
+    
+    // Rounded frame around the text, and the badge to its right
+    QRectF frameRect() const;
+    QRectF badgeRect() const;
+    void updateBadge();
 };
 
 class InfiniteCanvas : public QGraphicsView
@@ -174,11 +338,11 @@ public:
     // Reset zoom to 100%
     void resetZoom();
     
-    // Website icon getter
+    // Icon getters (backed by the shared icon cache)
     QPixmap getWebsiteIcon(const QUrl &url);
-    
-    // Media file icon getter
     QPixmap getMediaIcon(const QString &media_path);
+    QPixmap getFileIcon(const QString &file_path);
+    QPixmap getDirectoryIcon(const QString &dir_path);
     
     // Paste from clipboard functionality
     void pasteFromClipboard();
@@ -186,17 +350,24 @@ public:
     // Copy selected items to clipboard
     void copyToClipboard();
 
+    // Delete the selected items (nodes with their descendants) as one undo step
+    void deleteSelection();
+
     // For MainWindow to access current zoom level
     qreal currentZoomFactor() const { return m_scale_factor; }
     
-    // Create a new text node at the specified position
-    EditableTextItem* createTextNode(const QPointF &position, const QString &text = "New Node");
+    // Create a new text node at the specified position, styled for its depth
+    EditableTextItem* createTextNode(const QPointF &position, const QString &text = "New Node", int depth = 0);
     
     // Organize the entire mind map layout from the selected node
     void organizeLayoutFromNode(EditableTextItem* node);
+    
+    // Center the view on an item and make it the only selected item
+    void revealItem(QGraphicsItem *item);
 
 protected:
     void wheelEvent(QWheelEvent *event) override;
+    void paintEvent(QPaintEvent *event) override;
     
     // Drag and drop event handlers
     void dragEnterEvent(QDragEnterEvent *event) override;
@@ -208,19 +379,38 @@ protected:
     
     // Key press handler for shortcuts
     void keyPressEvent(QKeyEvent *event) override;
+    
+    // Mouse handlers recording dragged items for undo
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
 
 private:
     // Helper methods for drag and drop
     void handleImageDrop(const QMimeData *mime_data, const QPointF &pos);
     void handleTextDrop(const QMimeData *mime_data, const QPointF &pos);
     void handleUrlDrop(const QString &url_str, const QPointF &pos);
-    void handleShortcutDrop(const QUrl &url, const QPointF &pos);
-    void handleDirectoryDrop(const QUrl &url, const QPointF &pos);
-    void handleMediaDrop(const QUrl &url, const QPointF &pos);
     
     // Universal handler for mime data (used by both drag-drop and paste)
     bool processItemFromMimeData(const QMimeData *mime_data, const QPointF &pos);
-    
+
+    // Batch import of dropped or pasted URLs, one item per URL. Local files
+    // are classified on the thread pool; returns false if no URL is usable.
+    struct UrlImport;
+    bool importUrls(const QList<QUrl> &urls, const QPointF &pos);
+    static UrlImport classifyUrl(const QUrl &url);
+    void insertImportedUrls(const QVector<UrlImport> &entries, const QPointF &pos,
+                            EditableTextItem *target);
+
+    // Add many items to the scene with the scene index suspended
+    void addItemsInBatch(const QList<QGraphicsItem*> &items);
+
+    // Record items that were just added as one undo step
+    void recordInsertedItems(const QList<QGraphicsItem*> &items, const QString &text);
+
+    // Create a node tree from a parsed outline, laid out and inserted in one batch
+    void pasteOutline(const QVector<OutlineEntry> &outline, const QPointF &pos);
+
     // Helper method to delete selected items
     void deleteSelectedItems();
     
@@ -228,19 +418,20 @@ private:
     void copySelectedItemsToClipboard();
     
     // Helper methods for file/directory/url handling
-    QPixmap getFileIcon(const QString &file_path);
-    QPixmap getDirectoryIcon(const QString &dir_path);
-    bool isDirectory(const QString &path);
+    static bool isDirectory(const QString &path);
     bool isUrl(const QString &text);
-    bool isMediaFile(const QString &file_path);
+    static bool isMediaFile(const QString &file_path);
+    static bool isImageFile(const QString &file_path);
     void openDirectory(const QString &dir_path);
-    
-    // Helper method to resolve shortcut target
-    QString resolveShortcutTarget(const QString &shortcut_path);
+
+    // Helper method to resolve shortcut target (thread safe)
+    static QString resolveShortcutTarget(const QString &shortcut_path);
 
     qreal m_scale_factor; // Tracks current scale factor
     qreal m_max_scale;    // Maximum allowed scale factor (4x)
     qreal m_min_scale;    // Minimum allowed scale factor
+    QVector<QPair<quint64, QPointF>> m_drag_start_positions; // Undo ids and positions of dragged items
+    bool m_drag_may_move; // Left button pressed on a movable item, not moved yet
 };
 
 #endif // INFINITECANVAS_H
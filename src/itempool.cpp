@@ -0,0 +1,173 @@
+#include "pch.h"
+
+#include "itempool.h"
+#include "infinitecanvas.h"
+#include "iconloader.h"
+#include "searchindex.h"
+#include "undocommands.h"
+
+namespace {
+// Pooled item of a kind, or null if there is none
+template <typename T>
+T *takeFrom(QVector<T*> *pool)
+{
+    return pool->isEmpty() ? nullptr : pool->takeLast();
+}
+
+// Pool an item unless its kind is full
+template <typename T>
+bool addTo(QVector<T*> *pool, T *item)
+{
+    if (pool->size() >= ItemPool::kMaxPooledItems) {
+        return false;
+    }
+    pool->append(item);
+    return true;
+}
+}
+
+ItemPool &ItemPool::instance()
+{
+    static ItemPool pool;
+    return pool;
+}
+
+bool ItemPool::isGuiThread()
+{
+    return QCoreApplication::instance() &&
+           QThread::currentThread() == QCoreApplication::instance()->thread();
+}
+
+bool ItemPool::recycle(QGraphicsItem *item)
+{
+    if (!isGuiThread() || item->parentItem()) {
+        return false;
+    }
+
+    // Find the item's kind and check there is room for it
+    bool pooled = false;
+    if (EditableTextItem *node = dynamic_cast<EditableTextItem*>(item)) {
+        pooled = addTo(&m_nodes, node);
+    } else if (ConnectionLine *line = dynamic_cast<ConnectionLine*>(item)) {
+        pooled = addTo(&m_lines, line);
+    } else if (ShortcutItem *shortcut_item = dynamic_cast<ShortcutItem*>(item)) {
+        pooled = addTo(&m_shortcut_items, shortcut_item);
+    } else if (UrlItem *url_item = dynamic_cast<UrlItem*>(item)) {
+        pooled = addTo(&m_url_items, url_item);
+    } else if (DirectoryItem *dir_item = dynamic_cast<DirectoryItem*>(item)) {
+        pooled = addTo(&m_directory_items, dir_item);
+    } else if (MediaItem *media_item = dynamic_cast<MediaItem*>(item)) {
+        pooled = addTo(&m_media_items, media_item);
+    }
+    if (!pooled) {
+        return false;
+    }
+
+    // Leave the scene and everything that tracks items, as if deleted
+    if (item->scene()) {
+        item->scene()->removeItem(item);
+    }
+    IconLoader::cancelRequests(item);
+    SearchIndex::instance().removeItem(item);
+    ItemRegistry::instance().removeItem(item);
+    item->setSelected(false);
+    item->setToolTip(QString());
+
+    if (EditableTextItem *node = dynamic_cast<EditableTextItem*>(item)) {
+        node->resetForReuse();
+    } else if (ConnectionLine *line = dynamic_cast<ConnectionLine*>(item)) {
+        line->setItems(nullptr, nullptr);
+    }
+    return true;
+}
+
+EditableTextItem *ItemPool::takeNode()
+{
+    EditableTextItem *node = isGuiThread() ? takeFrom(&m_nodes) : nullptr;
+    if (!node) {
+        return new EditableTextItem(QString());
+    }
+    SearchIndex::instance().markDirty(node);
+    return node;
+}
+
+ConnectionLine *ItemPool::takeLine(EditableTextItem *from_item, EditableTextItem *to_item)
+{
+    ConnectionLine *line = isGuiThread() ? takeFrom(&m_lines) : nullptr;
+    if (!line) {
+        return new ConnectionLine(from_item, to_item);
+    }
+    line->setItems(from_item, to_item);
+    return line;
+}
+
+ShortcutItem *ItemPool::takeShortcutItem(const QPixmap &pixmap, const QString &target_path)
+{
+    ShortcutItem *item = isGuiThread() ? takeFrom(&m_shortcut_items) : nullptr;
+    if (!item) {
+        return new ShortcutItem(pixmap, target_path);
+    }
+    item->setTarget(pixmap, target_path);
+    SearchIndex::instance().markDirty(item);
+    return item;
+}
+
+UrlItem *ItemPool::takeUrlItem(const QPixmap &pixmap, const QUrl &url)
+{
+    UrlItem *item = isGuiThread() ? takeFrom(&m_url_items) : nullptr;
+    if (!item) {
+        return new UrlItem(pixmap, url);
+    }
+    item->setUrl(pixmap, url);
+    SearchIndex::instance().markDirty(item);
+    return item;
+}
+
+DirectoryItem *ItemPool::takeDirectoryItem(const QPixmap &pixmap, const QString &dir_path)
+{
+    DirectoryItem *item = isGuiThread() ? takeFrom(&m_directory_items) : nullptr;
+    if (!item) {
+        return new DirectoryItem(pixmap, dir_path);
+    }
+    item->setDirPath(pixmap, dir_path);
+    SearchIndex::instance().markDirty(item);
+    return item;
+}
+
+MediaItem *ItemPool::takeMediaItem(const QPixmap &pixmap, const QString &media_path)
+{
+    MediaItem *item = isGuiThread() ? takeFrom(&m_media_items) : nullptr;
+    if (!item) {
+        return new MediaItem(pixmap, media_path);
+    }
+    item->setMediaPath(pixmap, media_path);
+    SearchIndex::instance().markDirty(item);
+    return item;
+}
+
+int ItemPool::size() const
+{
+    return m_nodes.size() + m_lines.size() + m_shortcut_items.size() + m_url_items.size() +
+           m_directory_items.size() + m_media_items.size();
+}
+
+void ItemPool::clear()
+{
+    if (size() > 0) {
+        qDebug() << "Deleting" << size() << "unused pooled items";
+    }
+
+    // Pooled items are in no scene and have nothing left to unlink
+    qDeleteAll(m_nodes);
+    qDeleteAll(m_lines);
+    qDeleteAll(m_shortcut_items);
+    qDeleteAll(m_url_items);
+    qDeleteAll(m_directory_items);
+    qDeleteAll(m_media_items);
+    m_nodes.clear();
+    m_lines.clear();
+    m_shortcut_items.clear();
+    m_url_items.clear();
+    m_directory_items.clear();
+    m_media_items.clear();
+}
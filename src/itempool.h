@@ -0,0 +1,63 @@
+#ifndef ITEMPOOL_H
+#define ITEMPOOL_H
+
+#include "pch.h"
+
+class EditableTextItem;
+class ConnectionLine;
+class ShortcutItem;
+class UrlItem;
+class DirectoryItem;
+class MediaItem;
+
+// Scene items of a closed map kept for building the next one.
+//
+// Opening a map used to delete every node, line and icon item of the old
+// one and allocate them all again. Items the pool can reuse are instead
+// taken out of the scene, reset and handed out again by the take*()
+// functions, keeping their text documents, paths and other buffers, so the
+// next map mostly skips the allocator. Whatever the next map does not use
+// is deleted once it has loaded. The pool is not thread-safe, so items are
+// only pooled and reused on the GUI thread. The command line tool runs
+// parallel jobs as separate processes, each with its own pool.
+class ItemPool
+{
+public:
+    static ItemPool &instance();
+
+    // Most items of each kind kept
+    static constexpr int kMaxPooledItems = 100000;
+
+    // Take an item out of its scene into the pool; false if it cannot be
+    // reused or its kind is full. Its node links must be dropped already.
+    bool recycle(QGraphicsItem *item);
+
+    // Items from the pool, reset to show the given data, or new ones
+    EditableTextItem *takeNode();
+    ConnectionLine *takeLine(EditableTextItem *from_item, EditableTextItem *to_item);
+    ShortcutItem *takeShortcutItem(const QPixmap &pixmap, const QString &target_path);
+    UrlItem *takeUrlItem(const QPixmap &pixmap, const QUrl &url);
+    DirectoryItem *takeDirectoryItem(const QPixmap &pixmap, const QString &dir_path);
+    MediaItem *takeMediaItem(const QPixmap &pixmap, const QString &media_path);
+
+    // Number of pooled items
+    int size() const;
+
+    // Delete the pooled items
+    void clear();
+
+private:
+    ItemPool() = default;
+
+    // Pooling is not thread-safe; loads on worker threads bypass it
+    static bool isGuiThread();
+
+    QVector<EditableTextItem*> m_nodes;
+    QVector<ConnectionLine*> m_lines;
+    QVector<ShortcutItem*> m_shortcut_items;
+    QVector<UrlItem*> m_url_items;
+    QVector<DirectoryItem*> m_directory_items;
+    QVector<MediaItem*> m_media_items;
+};
+
+#endif // ITEMPOOL_H
@@ -1,15 +1,70 @@
 #include "pch.h"
 
+#include "iconcache.h"
 #include "mainwindow.h"
+#include "singleinstance.h"
+#include "trace.h"
+
+// Get the map file passed on the command line, if any
+static QString fileArgument(int argc, char *argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    QString arg = QString::fromLocal8Bit(argv[i]);
+    if (arg == "--trace") {
+      ++i;  // Skip the trace file
+    } else if (!arg.startsWith("-")) {
+      // Resolve relative paths here, the running instance has another working directory
+      return QFileInfo(arg).absoluteFilePath();
+    }
+  }
+  return QString();
+}
 
 int main(int argc, char *argv[]) {
+  // Start tracing first so the whole startup is covered
+  Trace::startFromEnvironment(argc, argv);
+
+  QString file_path = fileArgument(argc, argv);
+
   QSharedMemory sharedMemory("QtMindMap");
   if (sharedMemory.attach()) {
-    return 0;
+    // Hand the file to the running instance instead of starting a second one
+    QCoreApplication forward_app(argc, argv);
+    if (SingleInstance::forward(file_path)) {
+      return 0;
+    }
+    qWarning() << "No running instance answered, starting normally";
   }
   sharedMemory.create(1);
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+  // Let icons and pixmaps carry the screen's device pixel ratio
+  QApplication::setAttribute(Qt::AA_UseHighDpiPixmaps);
+#endif
+  qint64 app_start_us = Trace::now();
   QApplication a(argc, argv);
+  Trace::record("QApplication", "startup", app_start_us, Trace::now() - app_start_us);
+
+  // Accept open requests of later launches as early as possible
+  SingleInstance single_instance;
+  single_instance.listen();
+
   MainWindow w;
-  w.show();
-  return a.exec();
+  QObject::connect(&single_instance, &SingleInstance::openRequested, &w,
+                   &MainWindow::openRequestedFile);
+  {
+    TRACE_SCOPE("MainWindow::show", "startup");
+    w.show();
+  }
+
+  // Open the map passed on the command line instead of the recent one
+  if (!file_path.isEmpty()) {
+    w.openRequestedFile(file_path);
+  }
+  int result = a.exec();
+
+  // Persist newly resolved icons while QApplication still exists
+  IconCache::instance().shutdown();
+
+  // Write the trace collected while running
+  Trace::stop();
+  return result;
 }
@@ -2,14 +2,36 @@
 
 #include "mainwindow.h"
 #include "infinitecanvas.h"
+#include "imageresidency.h"
+#include "itempool.h"
+#include "maploader.h"
+#include "mapwriter.h"
+#include "mapimporter.h"
+#include "outlineexporter.h"
+#include "sceneexporter.h"
+#include "searchbar.h"
+#include "styletable.h"
+#include "trace.h"
+#include "undocommands.h"
 
 static constexpr char kTranslationPath[] = ":/translations/";
 
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
+  TRACE_SCOPE("MainWindow::MainWindow", "startup");
+
   setWindowTitle(tr("QtMindMap"));
 
   // Initialize member variables
   m_tray_message_shown = false;
+  m_search_bar = nullptr;
+  m_map_requested = false;
+
+  // Undo history of the map, created before the Edit menu needs it
+  m_undo_stack = new QUndoStack(this);
+
+  // Load the image embedding option
+  QSettings settings(getSettingsFilePath(), QSettings::IniFormat);
+  m_embed_images = settings.value("Images/EmbedInMap", false).toBool();
 
   // Initialize translator
   m_translator = new QTranslator(this);
@@ -41,6 +63,22 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
   m_scene->setSceneRect(0, 0, 10000, 10000);
 
   m_graphics_view = new InfiniteCanvas(m_scene, this);
+
+  // Edits of the scene are recorded within the configured memory budget
+  UndoHistory::instance().attach(m_scene, m_undo_stack);
+  loadUndoMemoryLimit();
+
+  // Maps are loaded progressively into the scene
+  m_map_loader = new MapLoader(m_scene, this);
+  connect(m_map_loader, &MapLoader::parsed, this, &MainWindow::replaceMap);
+  connect(m_map_loader, &MapLoader::viewStateLoaded, this,
+          &MainWindow::restoreViewState);
+  connect(m_map_loader, &MapLoader::failed, this,
+          &MainWindow::showMapLoadError);
+
+  // Items of the previous map that the new one did not reuse
+  connect(m_map_loader, &MapLoader::finished, this, []() { ItemPool::instance().clear(); });
+  connect(m_map_loader, &MapLoader::failed, this, []() { ItemPool::instance().clear(); });
   
   // Initialize view scrollbar position, set the view center to scene position (0,0)
   m_graphics_view->centerOn(0, 0);
@@ -48,6 +86,9 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
   m_graphics_view->horizontalScrollBar()->setValue(0);
   m_graphics_view->verticalScrollBar()->setValue(0);
 
+  // Search bar above the canvas, shown by Edit > Find
+  m_search_bar = new SearchBar(m_graphics_view, this);
+  layout->addWidget(m_search_bar);
   layout->addWidget(m_graphics_view);
 
   resize(1200, 800);
@@ -61,14 +102,20 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
   // Setup system tray icon
   setupTrayIcon();
 
-  // Try to load the most recent file
-  tryLoadRecentFile();
+  // Bound the memory used by decoded images before any are loaded
+  loadImageMemoryBudget();
+
+  // Load the most recent file once the event loop runs, so the window
+  // is shown and painted before any map data is touched
+  QTimer::singleShot(0, this, &MainWindow::tryLoadRecentFile);
   
   // Update window title based on the loaded file
   updateWindowTitle();
 }
 
 void MainWindow::setupTrayIcon() {
+  TRACE_SCOPE("MainWindow::setupTrayIcon", "startup");
+
   // Check if system tray is supported
   if (!QSystemTrayIcon::isSystemTrayAvailable()) {
     qWarning() << "System tray is not available on this system";
@@ -211,6 +258,8 @@ void MainWindow::hideMainWindow() {
 }
 
 void MainWindow::setupMenus() {
+  TRACE_SCOPE("MainWindow::setupMenus", "startup");
+
   // Create File menu
   QMenu *file_menu = menuBar()->addMenu(tr("File"));
 
@@ -224,12 +273,24 @@ void MainWindow::setupMenus() {
   file_menu->addAction(open_action);
   connect(open_action, &QAction::triggered, this, &MainWindow::openFile);
 
+  // Add Import action (FreeMind and OPML)
+  QAction *import_action = new QAction(tr("Import..."), this);
+  file_menu->addAction(import_action);
+  connect(import_action, &QAction::triggered, this, &MainWindow::importFile);
+
   // Add Save action
   QAction *save_action = new QAction(tr("Save"), this);
   file_menu->addAction(save_action);
   connect(save_action, &QAction::triggered, this, &MainWindow::saveFile);
   save_action->setShortcut(QKeySequence(Qt::CTRL + Qt::Key_S));  // Add Ctrl+S shortcut
 
+  // Add Embed Images option
+  QAction *embed_images_action = new QAction(tr("Embed Images in Map"), this);
+  embed_images_action->setCheckable(true);
+  embed_images_action->setChecked(m_embed_images);
+  file_menu->addAction(embed_images_action);
+  connect(embed_images_action, &QAction::toggled, this, &MainWindow::setEmbedImages);
+
   file_menu->addSeparator();
   
   // Add Export to PNG action
@@ -242,6 +303,11 @@ void MainWindow::setupMenus() {
   file_menu->addAction(export_pdf_action);
   connect(export_pdf_action, &QAction::triggered, this, &MainWindow::exportToPdf);
 
+  // Add Export Outline action (OPML, Markdown, plain text)
+  QAction *export_outline_action = new QAction(tr("Export Outline..."), this);
+  file_menu->addAction(export_outline_action);
+  connect(export_outline_action, &QAction::triggered, this, &MainWindow::exportOutline);
+
   file_menu->addSeparator();
 
   // Add Exit action
@@ -253,6 +319,15 @@ void MainWindow::setupMenus() {
   // Create Edit menu
   QMenu *edit_menu = menuBar()->addMenu(tr("Edit"));
 
+  // Add Undo and Redo actions, named after the step they undo or redo
+  QAction *undo_action = m_undo_stack->createUndoAction(this, tr("Undo"));
+  undo_action->setShortcuts(QKeySequence::Undo);  // Ctrl+Z
+  edit_menu->addAction(undo_action);
+  QAction *redo_action = m_undo_stack->createRedoAction(this, tr("Redo"));
+  redo_action->setShortcuts(QKeySequence::Redo);  // Ctrl+Y or Ctrl+Shift+Z, by platform
+  edit_menu->addAction(redo_action);
+  edit_menu->addSeparator();
+
   // Add Copy action
   QAction *copy_action = new QAction(tr("Copy"), this);
   edit_menu->addAction(copy_action);
@@ -279,15 +354,22 @@ void MainWindow::setupMenus() {
   connect(delete_action, &QAction::triggered, [this]() {
     if (m_graphics_view) {
       // Call canvas's method to delete selected items
-      QList<QGraphicsItem*> selected_items = m_scene->selectedItems();
-      for (QGraphicsItem *item : selected_items) {
-        m_scene->removeItem(item);
-        delete item;
-      }
+      m_graphics_view->deleteSelection();
     }
   });
   delete_action->setShortcut(QKeySequence(Qt::Key_Delete));  // Add Delete key shortcut
 
+  // Add Find action
+  edit_menu->addSeparator();
+  QAction *find_action = new QAction(tr("Find..."), this);
+  edit_menu->addAction(find_action);
+  connect(find_action, &QAction::triggered, [this]() {
+    if (m_search_bar) {
+      m_search_bar->activate();
+    }
+  });
+  find_action->setShortcut(QKeySequence(Qt::CTRL + Qt::Key_F));  // Add Ctrl+F shortcut
+
   // Create View menu
   QMenu *view_menu = menuBar()->addMenu(tr("View"));
 
@@ -320,8 +402,15 @@ void MainWindow::setupMenus() {
 }
 
 void MainWindow::newFile() {
-  // Clear the scene
-  m_scene->clear();
+  // Clear the scene and its history
+  m_map_loader->cancel();
+  m_undo_stack->clear();
+  EditableTextItem::clearScene(m_scene);
+  
+  // New maps start without styles per depth, and without the closed map's styles
+  StyleTable::instance().setDepthStyles(QVector<int>());
+  StyleTable::instance().beginDocument();
+  StyleTable::instance().reclaim();
   
   // Reset current file path since this is a new file
   m_current_file = "";
@@ -341,15 +430,36 @@ void MainWindow::openFile() {
   QString file_name = QFileDialog::getOpenFileName(
       this, tr("Open File"), "", tr("JSON Files (*.json);;All Files (*)"));
   if (!file_name.isEmpty()) {
-    // Load the file
+    // Load the file; it becomes the current and most recent file once it
+    // was read successfully. Outlines picked through "All Files" are
+    // imported, so saving does not overwrite them with JSON.
+    loadFromFile(file_name, MapImporter::formatForFile(file_name) != MapImporter::Format::None);
+  }
+}
+
+void MainWindow::importFile() {
+  // Show import file dialog
+  QString file_name = QFileDialog::getOpenFileName(
+      this, tr("Import File"), "",
+      tr("Outlines (*.mm *.opml);;FreeMind Maps (*.mm);;OPML Files (*.opml);;All Files (*)"));
+  if (!file_name.isEmpty()) {
+    // Imported maps are saved in the native format under a new name
+    loadFromFile(file_name, true);
+  }
+}
+
+void MainWindow::openRequestedFile(const QString &file_name) {
+  // Bring the window to the front, also when it was hidden to the tray
+  showMainWindow();
+
+  // Outlines are imported, so saving does not overwrite them with JSON
+  if (MapImporter::formatForFile(file_name) != MapImporter::Format::None) {
+    loadFromFile(file_name, true);
+    return;
+  }
+
+  if (!file_name.isEmpty()) {
     loadFromFile(file_name);
-    // Save this file as the most recent
-    saveRecentFilePath(file_name);
-    // Store current file
-    m_current_file = file_name;
-    
-    // Update window title
-    updateWindowTitle();
   }
 }
 
@@ -376,8 +486,10 @@ void MainWindow::saveFile() {
 }
 
 void MainWindow::saveToFile(const QString &file_name) {
-  // Create a JSON object to store all data
-  QJsonObject json_data;
+  TRACE_SCOPE("MainWindow::saveToFile", "save");
+
+  // Items of a map that is still loading must not be lost
+  m_map_loader->finishNow();
 
   // Log file save operation
   qDebug() << "Saving file to:" << file_name;
@@ -390,227 +502,19 @@ void MainWindow::saveToFile(const QString &file_name) {
     return;
   }
 
-  // Save canvas view state
-  QJsonObject view_state;
-  view_state["scale_factor"] = m_graphics_view->getScaleFactor();
+  // Save the current view along with the items
   QPointF center_point =
       m_graphics_view->mapToScene(m_graphics_view->viewport()->rect().center());
-  view_state["center_x"] = center_point.x();
-  view_state["center_y"] = center_point.y();
-  json_data["view_state"] = view_state;
 
-  // Save items
-  QJsonArray items_array;
-  
-  // Get all top-level items (exclude child items from item groups)
-  QList<QGraphicsItem*> all_items = m_scene->items();
-  QSet<QGraphicsItem*> processed_items;
-  QSet<QGraphicsItem*> child_items;
-  
-  // First identify all child items of QGraphicsItemGroup to avoid processing them separately
-  for (QGraphicsItem *item : all_items) {
-    // Check if the item is a QGraphicsItemGroup
-    QGraphicsItemGroup *group = dynamic_cast<QGraphicsItemGroup*>(item);
-    if (group) {
-      // Get all child items in the group
-      QList<QGraphicsItem*> children = group->childItems();
-      for (QGraphicsItem *child : children) {
-        child_items.insert(child);
-      }
-    }
-  }
-  
-  qDebug() << "Total scene items:" << all_items.size() 
-           << "Child items to exclude:" << child_items.size();
-
-  // Iterate through all items in the scene
-  for (QGraphicsItem *item : all_items) {
-    // Skip if already processed or is a child item
-    if (processed_items.contains(item) || child_items.contains(item)) {
-      continue;
-    }
-    
-    QJsonObject item_data;
-
-    // Save position for all items
-    item_data["x"] = item->pos().x();
-    item_data["y"] = item->pos().y();
-
-    // Handle text items
-    if (QGraphicsTextItem *text_item =
-            dynamic_cast<QGraphicsTextItem *>(item)) {
-      // Skip if it's a ConnectionLine or other item type we don't want to save directly
-      if (dynamic_cast<ConnectionLine*>(item)) {
-        continue;
-      }
-      
-      // Check if it's our custom EditableTextItem
-      EditableTextItem *editable_text = dynamic_cast<EditableTextItem *>(text_item);
-      if (editable_text) {
-        item_data["type"] = "text_node";
-        item_data["content"] = editable_text->toPlainText();
-        item_data["font_family"] = editable_text->font().family();
-        item_data["font_size"] = editable_text->font().pointSize();
-        item_data["color"] = editable_text->defaultTextColor().name();
-        
-        // Save item ID (its pointer as a string) for connections
-        QString item_id = QString::number((quintptr)editable_text);
-        item_data["id"] = item_id;
-        
-        // Save child node references
-        QJsonArray child_nodes;
-        for (EditableTextItem *child : editable_text->childNodes()) {
-          QString child_id = QString::number((quintptr)child);
-          child_nodes.append(child_id);
-        }
-        
-        if (!child_nodes.isEmpty()) {
-          item_data["child_nodes"] = child_nodes;
-        }
-        
-        items_array.append(item_data);
-        processed_items.insert(item);
-        qDebug() << "Saved text node at" << item->pos() << "with ID" << item_id;
-      } else {
-        // Standard text item
-        item_data["type"] = "text";
-        item_data["content"] = text_item->toPlainText();
-        item_data["font_family"] = text_item->font().family();
-        item_data["font_size"] = text_item->font().pointSize();
-        item_data["color"] = text_item->defaultTextColor().name();
-        
-        items_array.append(item_data);
-        processed_items.insert(item);
-        qDebug() << "Saved text item at" << item->pos();
-      }
-    }
-    // Handle custom item types
-    else if (MediaItem *media_item = dynamic_cast<MediaItem*>(item)) {
-      item_data["type"] = "media";
-      item_data["media_path"] = media_item->getMediaPath();
-      
-      items_array.append(item_data);
-      processed_items.insert(item);
-      
-      // Mark all children as processed
-      for (QGraphicsItem *child : media_item->childItems()) {
-        processed_items.insert(child);
-      }
-      qDebug() << "Saved media item at" << item->pos();
-    }
-    else if (DirectoryItem *dir_item = dynamic_cast<DirectoryItem*>(item)) {
-      item_data["type"] = "directory";
-      item_data["dir_path"] = dir_item->getDirPath();
-      
-      items_array.append(item_data);
-      processed_items.insert(item);
-      
-      // Mark all children as processed
-      for (QGraphicsItem *child : dir_item->childItems()) {
-        processed_items.insert(child);
-      }
-      qDebug() << "Saved directory item at" << item->pos();
-    }
-    else if (UrlItem *url_item = dynamic_cast<UrlItem*>(item)) {
-      item_data["type"] = "url";
-      item_data["url"] = url_item->getUrl().toString();
-      
-      items_array.append(item_data);
-      processed_items.insert(item);
-      
-      // Mark all children as processed
-      for (QGraphicsItem *child : url_item->childItems()) {
-        processed_items.insert(child);
-      }
-      qDebug() << "Saved URL item at" << item->pos();
-    }
-    // Handle shortcut items - not a group but has custom data
-    else if (ShortcutItem *shortcut_item = dynamic_cast<ShortcutItem*>(item)) {
-      item_data["type"] = "shortcut";
-      item_data["target_path"] = shortcut_item->getTargetPath();
-      
-      items_array.append(item_data);
-      processed_items.insert(item);
-      qDebug() << "Saved shortcut item at" << item->pos();
-    }
-    // Alternative detection based on data() for non-dynamic items
-    else if (item->data(1).toString() == "shortcut") {
-      item_data["type"] = "shortcut";
-      item_data["target_path"] = item->data(0).toString();
-      
-      items_array.append(item_data);
-      processed_items.insert(item);
-    }
-    else if (item->data(1).toString() == "url") {
-      item_data["type"] = "url";
-      item_data["url"] = item->data(0).toString();
-      
-      items_array.append(item_data);
-      processed_items.insert(item);
-    }
-    else if (item->data(1).toString() == "directory") {
-      item_data["type"] = "directory";
-      item_data["dir_path"] = item->data(0).toString();
-      
-      items_array.append(item_data);
-      processed_items.insert(item);
-    }
-    else if (item->data(1).toString() == "media") {
-      item_data["type"] = "media";
-      item_data["media_path"] = item->data(0).toString();
-      
-      items_array.append(item_data);
-      processed_items.insert(item);
-    }
-    // Handle pixmap items (images)
-    else if (QGraphicsPixmapItem *pixmap_item =
-                 dynamic_cast<QGraphicsPixmapItem *>(item)) {
-      // Check if this pixmap is part of a group - should have been handled by parent group
-      if (pixmap_item->group()) {
-        continue;
-      }
-      
-      item_data["type"] = "image";
-      // We need to store image path, but QGraphicsPixmapItem doesn't store it
-      // We'll use an object property to store file path when loading an image
-      QVariant path_variant = pixmap_item->data(0);
-      if (path_variant.isValid() && !path_variant.toString().isEmpty()) {
-        item_data["file_path"] = path_variant.toString();
-        
-        items_array.append(item_data);
-        processed_items.insert(item);
-        qDebug() << "Saved image item at" << item->pos();
-      } else {
-        qWarning() << "Skipping image with empty file path at" << item->pos();
-      }
-    }
-    // Skip other item types
-    else {
-      qDebug() << "Skipping unknown item type at" << item->pos();
-      continue;
-    }
-  }
-
-  json_data["items"] = items_array;
-  qDebug() << "Saved" << items_array.size() << "items out of" << all_items.size() << "scene items";
-
-  // Write JSON data to file
-  QFile save_file(file_name);
-  if (!save_file.open(QIODevice::WriteOnly)) {
-    qCritical() << "Failed to open file for writing:" << file_name << "Error:" << save_file.errorString();
+  QString error_string;
+  if (!MapWriter::write(m_scene, file_name, m_graphics_view->getScaleFactor(), center_point,
+                        m_embed_images, &error_string)) {
     QMessageBox::warning(this, tr("Save Error"),
                          tr("Could not open file for writing."));
-    return;
   }
-
-  QJsonDocument save_doc(json_data);
-  save_file.write(save_doc.toJson());
-  save_file.close();
-  
-  qDebug() << "Successfully saved file:" << file_name << "Items saved:" << items_array.size();
 }
 
-void MainWindow::loadFromFile(const QString &file_name) {
+void MainWindow::loadFromFile(const QString &file_name, bool import) {
   // Log file load operation
   qDebug() << "Loading file from:" << file_name;
   
@@ -622,453 +526,65 @@ void MainWindow::loadFromFile(const QString &file_name) {
     return;
   }
 
-  // Check if file exists
-  QFileInfo file_info(file_name);
-  if (!file_info.exists() || !file_info.isFile()) {
-    qCritical() << "Error: File does not exist or is not a regular file:" << file_name;
-    QMessageBox::warning(this, tr("Load Error"),
-                         tr("File does not exist or is not a regular file."));
-    return;
-  }
+  // Items are created progressively while the window stays responsive.
+  // The current map stays until the file is parsed, so a missing or
+  // invalid file leaves it (and the current file) untouched.
+  m_loading_file = import ? QString() : file_name;
+  m_map_requested = true;
+  m_map_loader->load(file_name);
+}
 
-  // Read the JSON file
-  QFile load_file(file_name);
-  if (!load_file.open(QIODevice::ReadOnly)) {
-    qCritical() << "Failed to open file for reading:" << file_name << "Error:" << load_file.errorString();
-    QMessageBox::warning(this, tr("Load Error"),
-                         tr("Could not open file for reading."));
-    return;
-  }
+void MainWindow::replaceMap() {
+  // Clear current scene and its history; its items are reused for the new map
+  m_undo_stack->clear();
+  EditableTextItem::clearScene(m_scene, &ItemPool::instance());
 
-  QByteArray file_data = load_file.readAll();
-  load_file.close();
+  // Styles only the previous map used are no longer needed
+  StyleTable::instance().reclaim();
 
-  QJsonDocument load_doc(QJsonDocument::fromJson(file_data));
-  if (load_doc.isNull() || !load_doc.isObject()) {
-    qCritical() << "Invalid JSON format in file:" << file_name;
-    QMessageBox::warning(this, tr("Load Error"),
-                         tr("File contains invalid JSON data."));
-    return;
+  // The loaded file becomes the current and most recent one
+  m_current_file = m_loading_file;
+  if (!m_current_file.isEmpty()) {
+    saveRecentFilePath(m_current_file);
   }
-  
-  QJsonObject json_data = load_doc.object();
-
-  // Clear current scene
-  m_scene->clear();
-  qDebug() << "Scene cleared. Initial item count:" << m_scene->items().count();
-
-  // Restore items
-  QJsonArray items_array = json_data["items"].toArray();
-  qDebug() << "Loading" << items_array.size() << "items from file";
-  
-  int logical_items_count = 0; // Count of logical/high-level items
-  
-  for (int i = 0; i < items_array.size(); ++i) {
-    QJsonObject item_data = items_array[i].toObject();
-    QString type = item_data["type"].toString();
-    QPointF pos(item_data["x"].toDouble(), item_data["y"].toDouble());
-
-    qDebug() << "Processing item" << i+1 << "of" << items_array.size() 
-             << "- Type:" << type 
-             << "Position:" << pos 
-             << "Current scene items:" << m_scene->items().count();
-
-    if (type == "text_node") {
-      // Create text item
-      QString content = item_data["content"].toString();
-      EditableTextItem *text_item = m_graphics_view->createTextNode(pos, content);
-      text_item->setSelected(false);
-
-      // Set font properties if available
-      if (item_data.contains("font_family") &&
-          item_data.contains("font_size")) {
-        QFont font(item_data["font_family"].toString(),
-                   item_data["font_size"].toInt());
-        text_item->setFont(font);
-      }
-
-      // Set color if available
-      if (item_data.contains("color")) {
-        text_item->setDefaultTextColor(QColor(item_data["color"].toString()));
-      }
-
-      // Store original ID for later connecting nodes
-      if (item_data.contains("id")) {
-        QString id = item_data["id"].toString();
-        text_item->setData(0, id);
-      }
-
-      logical_items_count++;
-      qDebug() << "  - Added text node:" << content.left(20) << "..." 
-               << "Logical items:" << logical_items_count 
-               << "Total scene items:" << m_scene->items().count();
-    } else if (type == "text") {
-      // Create text item
-      QString content = item_data["content"].toString();
-      EditableTextItem *text_item = new EditableTextItem(content);
-
-      // Set font properties if available
-      if (item_data.contains("font_family") &&
-          item_data.contains("font_size")) {
-        QFont font(item_data["font_family"].toString(),
-                   item_data["font_size"].toInt());
-        text_item->setFont(font);
-      }
-
-      // Set color if available
-      if (item_data.contains("color")) {
-        text_item->setDefaultTextColor(QColor(item_data["color"].toString()));
-      }
-
-      // Set position
-      text_item->setPos(pos);
-
-      // Get current count before adding
-      int before_count = m_scene->items().count();
-      
-      // Add to scene
-      m_scene->addItem(text_item);
-      logical_items_count++;
-      
-      // Get current count after adding
-      int after_count = m_scene->items().count();
-      int added_count = after_count - before_count;
-      
-      qDebug() << "  - Added text item:" << content.left(20) << "..." 
-               << "Logical items:" << logical_items_count 
-               << "Added" << added_count << "actual scene items"
-               << "Total scene items:" << after_count;
-    } else if (type == "shortcut") {
-      // Create shortcut item
-      QString target_path = item_data["target_path"].toString();
-
-      if (!target_path.isEmpty()) {
-        // Get icon for the shortcut
-        QFileIconProvider icon_provider;
-        QFileInfo file_info(target_path);
-        QIcon icon = icon_provider.icon(file_info);
-        QPixmap pixmap = icon.pixmap(64, 64);
-
-        // If we got an empty pixmap, use a default
-        if (pixmap.isNull()) {
-          pixmap = QPixmap(64, 64);
-          pixmap.fill(Qt::transparent);
-        }
-
-        // Get current count before adding
-        int before_count = m_scene->items().count();
-        
-        // Create the shortcut item
-        ShortcutItem *shortcut_item = new ShortcutItem(pixmap, target_path);
-
-        // Position at the saved location
-        shortcut_item->setPos(pos);
-
-        // Set tooltip to show target path
-        shortcut_item->setToolTip(target_path);
-
-        // Add to scene
-        m_scene->addItem(shortcut_item);
-        logical_items_count++;
-        
-        // Get current count after adding
-        int after_count = m_scene->items().count();
-        int added_count = after_count - before_count;
-        
-        qDebug() << "  - Added shortcut item:" << target_path 
-                 << "Logical items:" << logical_items_count 
-                 << "Added" << added_count << "actual scene items"
-                 << "Total scene items:" << after_count;
-      } else {
-        qWarning() << "Empty target path for shortcut item at position" << pos;
-      }
-    } else if (type == "url") {
-      // Create URL item
-      QString url_str = item_data["url"].toString();
-
-      if (!url_str.isEmpty()) {
-        QUrl url(url_str);
-        if (url.isValid()) {
-          // Get current count before adding
-          int before_count = m_scene->items().count();
-          
-          // Get icon for the website
-          QPixmap icon = m_graphics_view->getWebsiteIcon(url);
-          
-          // Create the URL item
-          UrlItem *url_item = new UrlItem(icon, url);
-          
-          // Position at the saved location
-          url_item->setPos(pos);
-          
-          // Set tooltip to show URL
-          url_item->setToolTip(url_str);
-          
-          // Add to scene
-          m_scene->addItem(url_item);
-          logical_items_count++;
-          
-          // Get current count after adding
-          int after_count = m_scene->items().count();
-          int added_count = after_count - before_count;
-          
-          qDebug() << "  - Added URL item:" << url_str 
-                   << "Logical items:" << logical_items_count 
-                   << "Added" << added_count << "actual scene items"
-                   << "Total scene items:" << after_count;
-        } else {
-          qWarning() << "Invalid URL:" << url_str;
-        }
-      } else {
-        qWarning() << "Empty URL for URL item at position" << pos;
-      }
-    } else if (type == "directory") {
-      // Create directory item
-      QString dir_path = item_data["dir_path"].toString();
-
-      if (!dir_path.isEmpty()) {
-        // Get current count before adding
-        int before_count = m_scene->items().count();
-        
-        // Get icon for the directory
-        QFileIconProvider icon_provider;
-        QFileInfo dir_info(dir_path);
-        QIcon icon = icon_provider.icon(QFileIconProvider::Folder);
-
-        // For specific folder, use its actual icon if it exists
-        if (dir_info.exists()) {
-          icon = icon_provider.icon(dir_info);
-        }
+  updateWindowTitle();
+}
 
-        QPixmap pixmap = icon.pixmap(64, 64);
+void MainWindow::restoreViewState(qreal scale_factor, const QPointF &center,
+                                  bool has_center) {
+  // Restore scale factor
+  m_graphics_view->resetTransform();
+  m_graphics_view->scale(scale_factor, scale_factor);
+  m_graphics_view->setScaleFactor(scale_factor);
 
-        // If we got an empty pixmap, use a default
-        if (pixmap.isNull()) {
-          pixmap = QPixmap(64, 64);
-          pixmap.fill(Qt::transparent);
-        }
-
-        // Create the directory item with label
-        DirectoryItem *dir_item = new DirectoryItem(pixmap, dir_path);
-
-        // Position at the saved location
-        dir_item->setPos(pos);
-
-        // Set tooltip to show directory path
-        dir_item->setToolTip(dir_path);
-
-        // Add to scene
-        m_scene->addItem(dir_item);
-        logical_items_count++;
-        
-        // Get current count after adding
-        int after_count = m_scene->items().count();
-        int added_count = after_count - before_count;
-        
-        qDebug() << "  - Added directory item:" << dir_path 
-                 << "Logical items:" << logical_items_count 
-                 << "Added" << added_count << "actual scene items"
-                 << "Total scene items:" << after_count;
-      } else {
-        qWarning() << "Empty directory path for directory item at position" << pos;
-      }
-    } else if (type == "media") {
-      // Create media item
-      QString media_path = item_data["media_path"].toString();
-
-      if (!media_path.isEmpty()) {
-        // Get current count before adding
-        int before_count = m_scene->items().count();
-        
-        // Get icon for the media file
-        QPixmap icon = m_graphics_view->getMediaIcon(media_path);
-        
-        // Create the media item
-        MediaItem *media_item = new MediaItem(icon, media_path);
-        
-        // Position at the saved location
-        media_item->setPos(pos);
-        
-        // Set tooltip to show media path
-        media_item->setToolTip(media_path);
-        
-        // Add to scene
-        m_scene->addItem(media_item);
-        logical_items_count++;
-        
-        // Get current count after adding
-        int after_count = m_scene->items().count();
-        int added_count = after_count - before_count;
-        
-        qDebug() << "  - Added media item:" << media_path 
-                 << "Logical items:" << logical_items_count 
-                 << "Added" << added_count << "actual scene items"
-                 << "Total scene items:" << after_count;
-      } else {
-        qWarning() << "Empty media path for media item at position" << pos;
-      }
-    } else if (type == "image") {
-      // Load image from file path
-      QString file_path = item_data["file_path"].toString();
-      
-      if (file_path.isEmpty()) {
-        qWarning() << "Empty file path for image item at position" << pos;
-        continue;
-      }
-      
-      QFileInfo img_file_info(file_path);
-      if (!img_file_info.exists()) {
-        qWarning() << "Image file does not exist:" << file_path;
-        continue;
-      }
-      
-      qDebug() << "  - Loading image file:" << file_path;
-      QImage image(file_path);
-
-      if (!image.isNull()) {
-        // Get current count before adding
-        int before_count = m_scene->items().count();
-        
-        QGraphicsPixmapItem *pixmap_item =
-            new QGraphicsPixmapItem(QPixmap::fromImage(image));
-        pixmap_item->setPos(pos);
-        pixmap_item->setFlag(QGraphicsItem::ItemIsSelectable, true);
-        pixmap_item->setFlag(QGraphicsItem::ItemIsMovable, true);
-
-        // Store the file path for later saving
-        pixmap_item->setData(0, file_path);
-
-        // Add to scene
-        m_scene->addItem(pixmap_item);
-        logical_items_count++;
-        
-        // Get current count after adding
-        int after_count = m_scene->items().count();
-        int added_count = after_count - before_count;
-        
-        qDebug() << "  - Added image item:" << file_path 
-                 << "Logical items:" << logical_items_count 
-                 << "Added" << added_count << "actual scene items"
-                 << "Total scene items:" << after_count;
-      } else {
-        qWarning() << "Failed to load image from:" << file_path;
-      }
-    } else {
-      qWarning() << "Unknown item type:" << type << "at position" << pos;
-    }
+  // Restore view center position
+  if (has_center) {
+    m_graphics_view->centerOn(center);
   }
 
-  int actual_item_count = m_scene->items().count();
-  qDebug() << "Successfully loaded" << logical_items_count << "logical items out of" << items_array.size() << "items from file";
-  qDebug() << "Final scene item count:" << actual_item_count << "(includes group component items)";
-  
-  // Explain any discrepancy between logical items and actual scene items
-  if (logical_items_count != items_array.size()) {
-    qWarning() << "LOGICAL ITEMS DISCREPANCY: Loaded" << logical_items_count 
-               << "logical items but the file contained" << items_array.size() << "items";
-  }
-  
-  // Process node connections after all items are loaded
-  // Create a map of saved IDs to actual node objects
-  QMap<QString, EditableTextItem*> node_map;
-  foreach(QGraphicsItem* item, m_scene->items()) {
-    EditableTextItem* text_node = dynamic_cast<EditableTextItem*>(item);
-    if (text_node && text_node->data(0).isValid()) {
-      QString id = text_node->data(0).toString();
-      if (!id.isEmpty()) {
-        node_map[id] = text_node;
-      }
-    }
-  }
-  
-  // Now create connections based on the saved relationships
-  for (int i = 0; i < items_array.size(); ++i) {
-    QJsonObject item_data = items_array[i].toObject();
-    if (item_data["type"].toString() == "text_node" && 
-        item_data.contains("id") && 
-        item_data.contains("child_nodes")) {
-      
-      QString parent_id = item_data["id"].toString();
-      if (node_map.contains(parent_id)) {
-        EditableTextItem* parent_node = node_map[parent_id];
-        
-        // Process each child reference
-        QJsonArray child_nodes = item_data["child_nodes"].toArray();
-        for (int j = 0; j < child_nodes.size(); ++j) {
-          QString child_id = child_nodes[j].toString();
-          if (node_map.contains(child_id)) {
-            EditableTextItem* child_node = node_map[child_id];
-            // Create connection
-            parent_node->addChildNode(child_node);
-            qDebug() << "Created connection from" << parent_id << "to" << child_id;
-          }
-        }
-      }
-    }
-  }
-  
-  qDebug() << "Finished processing node connections";
-  
-  if (logical_items_count != actual_item_count) {
-    qDebug() << "NOTE: The difference between logical items (" << logical_items_count 
-             << ") and scene items (" << actual_item_count 
-             << ") is expected due to item groups (like MediaItem, DirectoryItem, etc.)";
-    
-    
-    // List all items for debugging if requested
-    bool list_all_items = false;  // Set to true to enable detailed listing
-    if (list_all_items) {
-      int idx = 0;
-      foreach (QGraphicsItem *item, m_scene->items()) {
-        QString itemType = "Unknown";
-        
-        if (dynamic_cast<QGraphicsTextItem*>(item))
-          itemType = "Text";
-        else if (dynamic_cast<ShortcutItem*>(item))
-          itemType = "Shortcut";
-        else if (dynamic_cast<UrlItem*>(item))
-          itemType = "URL";
-        else if (dynamic_cast<DirectoryItem*>(item))
-          itemType = "Directory";
-        else if (dynamic_cast<MediaItem*>(item))
-          itemType = "Media";
-        else if (dynamic_cast<QGraphicsPixmapItem*>(item))
-          itemType = "Image";
-        else if (dynamic_cast<QGraphicsSimpleTextItem*>(item))
-          itemType = "Label";
-        else if (dynamic_cast<QGraphicsItemGroup*>(item))
-          itemType = "Group";
-        
-        qDebug() << "  Scene item" << ++idx << ":" << itemType << "at" << item->pos();
-      }
-    }
-  }
+  qDebug() << "Restored view state: scale =" << scale_factor
+           << "center =" << center;
+}
 
-  // Restore view state
-  if (json_data.contains("view_state")) {
-    QJsonObject view_state = json_data["view_state"].toObject();
-
-    // Restore scale factor
-    double scale_factor = view_state["scale_factor"].toDouble();
-    m_graphics_view->resetTransform();
-    m_graphics_view->scale(scale_factor, scale_factor);
-    m_graphics_view->setScaleFactor(scale_factor);
-
-    // Restore view center position
-    if (view_state.contains("center_x") && view_state.contains("center_y")) {
-      double center_x = view_state["center_x"].toDouble();
-      double center_y = view_state["center_y"].toDouble();
-      m_graphics_view->centerOn(center_x, center_y);
-    }
-    
-    qDebug() << "Restored view state: scale =" << scale_factor
-             << "center =(" << view_state["center_x"].toDouble()
-             << "," << view_state["center_y"].toDouble() << ")";
-  } else {
-    qDebug() << "No view state found in file, using defaults";
+void MainWindow::showMapLoadError(MapLoader::Error error) {
+  switch (error) {
+    case MapLoader::Error::FileNotFound:
+      QMessageBox::warning(this, tr("Load Error"),
+                           tr("File does not exist or is not a regular file."));
+      break;
+    case MapLoader::Error::OpenFailed:
+      QMessageBox::warning(this, tr("Load Error"),
+                           tr("Could not open file for reading."));
+      break;
+    case MapLoader::Error::InvalidJson:
+      QMessageBox::warning(this, tr("Load Error"),
+                           tr("File contains invalid JSON data."));
+      break;
+    case MapLoader::Error::InvalidOutline:
+      QMessageBox::warning(this, tr("Import Error"),
+                           tr("File is not a valid FreeMind or OPML outline."));
+      break;
   }
-  
-  qDebug() << "File loading complete:" << file_name;
 }
 
 void MainWindow::showAbout() {
@@ -1078,6 +594,11 @@ void MainWindow::showAbout() {
 }
 
 MainWindow::~MainWindow() {
+  // Delete the map in one pass before the scene would unlink it node by node
+  m_map_loader->cancel();
+  EditableTextItem::clearScene(m_scene);
+  ItemPool::instance().clear();
+
   // Release tray icon resources
   if (m_tray_icon) {
     m_tray_icon->hide();
@@ -1118,15 +639,16 @@ QString MainWindow::getSettingsFilePath() {
 
 // Try to load the most recent file
 void MainWindow::tryLoadRecentFile() {
+  // A map passed on the command line (opened or imported) takes precedence
+  if (m_map_requested) {
+    return;
+  }
+
   QString recent_file = loadRecentFilePath();
   if (!recent_file.isEmpty()) {
     QFile file(recent_file);
     if (file.exists()) {
       loadFromFile(recent_file);
-      m_current_file = recent_file;
-      
-      // Update window title
-      updateWindowTitle();
     }
   }
 }
@@ -1212,37 +734,12 @@ void MainWindow::exportToPng()
         file_name += ".png";
     }
     
-    // Get the scene rectangle or the current view if scene is empty
-    QRectF export_rect = m_scene->itemsBoundingRect();
+    // Export the whole map, even if it is still loading
+    m_map_loader->finishNow();
+    TRACE_SCOPE("MainWindow::exportToPng", "export");
     
-    // If the scene is empty or very small, use a reasonable default size
-    if (export_rect.isEmpty() || (export_rect.width() < 10 && export_rect.height() < 10)) {
-        export_rect = QRectF(0, 0, 800, 600);
-    } else {
-        // Add some margin
-        export_rect.adjust(-10, -10, 10, 10);
-    }
-    
-    // Create a pixmap to render the scene onto
-    QPixmap pixmap(export_rect.width(), export_rect.height());
-    pixmap.fill(Qt::white);  // White background
-    
-    // Create a painter for the pixmap
-    QPainter painter(&pixmap);
-    
-    // Enable antialiasing for better quality
-    painter.setRenderHint(QPainter::Antialiasing);
-    painter.setRenderHint(QPainter::TextAntialiasing);
-    painter.setRenderHint(QPainter::SmoothPixmapTransform);
-    
-    // Render the scene onto the pixmap
-    m_scene->render(&painter, QRectF(), export_rect);
-    
-    // End painting
-    painter.end();
-    
-    // Save the pixmap to file
-    bool success = pixmap.save(file_name, "PNG");
+    // Render the scene to the file
+    bool success = SceneExporter::exportToFile(m_scene, file_name, SceneExporter::Format::Png);
     
     if (!success) {
         QMessageBox::warning(this, tr("Export Error"),
@@ -1270,48 +767,68 @@ void MainWindow::exportToPdf()
         file_name += ".pdf";
     }
     
-    // Get the scene rectangle
-    QRectF export_rect = m_scene->itemsBoundingRect();
+    // Export the whole map, even if it is still loading
+    m_map_loader->finishNow();
+    TRACE_SCOPE("MainWindow::exportToPdf", "export");
     
-    // If the scene is empty or very small, use a reasonable default size
-    if (export_rect.isEmpty() || (export_rect.width() < 10 && export_rect.height() < 10)) {
-        export_rect = QRectF(0, 0, 800, 600);
-    } else {
-        // Add some margin
-        export_rect.adjust(-10, -10, 10, 10);
+    // Render the scene to the file
+    if (!SceneExporter::exportToFile(m_scene, file_name, SceneExporter::Format::Pdf)) {
+        QMessageBox::warning(this, tr("Export Error"),
+                             tr("Failed to save PDF to file."));
+        return;
     }
     
-    // Setup printer
-    QPrinter printer(QPrinter::HighResolution);
-    printer.setOutputFormat(QPrinter::PdfFormat);
-    printer.setOutputFileName(file_name);
-    
-    // Set paper size to match the scene (convert from pixels to millimeters)
-    const qreal millimetersPerInch = 25.4;
-    const int dotsPerInch = 96; // Standard screen DPI
-    
-    qreal width_mm = (export_rect.width() / dotsPerInch) * millimetersPerInch;
-    qreal height_mm = (export_rect.height() / dotsPerInch) * millimetersPerInch;
-    
-    printer.setPageSize(QPageSize(QSizeF(width_mm, height_mm), QPageSize::Millimeter));
-    printer.setPageMargins(QMarginsF(0, 0, 0, 0));
+    QMessageBox::information(this, tr("Export Successful"),
+                             tr("Canvas has been exported to PDF successfully."));
+}
+
+// Export the node trees as a text outline
+void MainWindow::exportOutline()
+{
+    // Show save file dialog, the filter picks the format
+    QString opml_filter = tr("OPML Files (*.opml)");
+    QString markdown_filter = tr("Markdown Files (*.md)");
+    QString text_filter = tr("Text Files (*.txt)");
+    QString selected_filter;
+    QString file_name = QFileDialog::getSaveFileName(
+        this, tr("Export Outline"), "",
+        opml_filter + ";;" + markdown_filter + ";;" + text_filter, &selected_filter);
     
-    // Create painter
-    QPainter painter(&printer);
+    if (file_name.isEmpty()) {
+        return;
+    }
     
-    // Enable high quality rendering
-    painter.setRenderHint(QPainter::Antialiasing);
-    painter.setRenderHint(QPainter::TextAntialiasing);
-    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    // Use the typed extension, or add the one of the selected filter
+    OutlineExporter::Format format;
+    if (!OutlineExporter::formatForFile(file_name, &format)) {
+        if (selected_filter == markdown_filter) {
+            file_name += ".md";
+        } else if (selected_filter == text_filter) {
+            file_name += ".txt";
+        } else {
+            file_name += ".opml";
+        }
+        OutlineExporter::formatForFile(file_name, &format);
+    }
     
-    // Render the scene to the printer
-    m_scene->render(&painter, QRectF(), export_rect);
+    // Export the whole map, even if it is still loading
+    m_map_loader->finishNow();
     
-    // End painting
-    painter.end();
+    // Nodes are written straight to the file as the trees are walked
+    QSaveFile export_file(file_name);
+    bool success = export_file.open(QIODevice::WriteOnly) &&
+                   OutlineExporter::write(OutlineExporter::rootNodes(m_scene), format, &export_file,
+                                          QFileInfo(file_name).completeBaseName()) &&
+                   export_file.commit();
     
-    QMessageBox::information(this, tr("Export Successful"),
-                             tr("Canvas has been exported to PDF successfully."));
+    if (!success) {
+        qWarning() << "Failed to export outline:" << file_name << export_file.errorString();
+        QMessageBox::warning(this, tr("Export Error"),
+                             tr("Failed to save outline to file."));
+    } else {
+        QMessageBox::information(this, tr("Export Successful"),
+                                 tr("Map has been exported as an outline successfully."));
+    }
 }
 
 // Setup language menu
@@ -1359,6 +876,8 @@ void MainWindow::changeLanguage(const QString &locale_code) {
 
 // Load language
 void MainWindow::loadLanguage(const QString &locale_code) {
+  TRACE_SCOPE("MainWindow::loadLanguage", "startup");
+
   // Remove current translator if it exists
   if (m_translator) {
     qApp->removeTranslator(m_translator);
@@ -1468,6 +987,50 @@ void MainWindow::saveLanguageSetting(const QString &locale_code) {
   qDebug() << "Saved language setting:" << locale_code << "to" << settings_path;
 }
 
+// Choose whether saved maps embed their images and remember the choice
+void MainWindow::setEmbedImages(bool embed) {
+  m_embed_images = embed;
+
+  QString settings_path = getSettingsFilePath();
+  QSettings settings(settings_path, QSettings::IniFormat);
+  settings.setValue("Images/EmbedInMap", embed);
+}
+
+// Load the decoded image memory budget from the configuration file
+void MainWindow::loadImageMemoryBudget() {
+  QString settings_path = getSettingsFilePath();
+  QSettings settings(settings_path, QSettings::IniFormat);
+
+  // Write the default so the option can be found and edited in the file
+  if (!settings.contains("Images/MemoryBudgetMB")) {
+    settings.setValue("Images/MemoryBudgetMB", ImageResidency::kDefaultBudgetMB);
+  }
+
+  int budget_mb = settings.value("Images/MemoryBudgetMB").toInt();
+  if (budget_mb <= 0) {
+    budget_mb = ImageResidency::kDefaultBudgetMB;
+  }
+  ImageResidency::instance().setBudget(qint64(budget_mb) * 1024 * 1024);
+  qDebug() << "Image memory budget:" << budget_mb << "MB";
+}
+
+void MainWindow::loadUndoMemoryLimit() {
+  QString settings_path = getSettingsFilePath();
+  QSettings settings(settings_path, QSettings::IniFormat);
+
+  // Write the default so the option can be found and edited in the file
+  if (!settings.contains("Undo/MemoryLimitMB")) {
+    settings.setValue("Undo/MemoryLimitMB", UndoHistory::kDefaultMemoryLimitMB);
+  }
+
+  int limit_mb = settings.value("Undo/MemoryLimitMB").toInt();
+  if (limit_mb <= 0) {
+    limit_mb = UndoHistory::kDefaultMemoryLimitMB;
+  }
+  UndoHistory::instance().setMemoryLimit(qint64(limit_mb) * 1024 * 1024);
+  qDebug() << "Undo history memory limit:" << limit_mb << "MB";
+}
+
 // Load language setting from configuration file
 QString MainWindow::loadLanguageSetting() {
   QString settings_path = getSettingsFilePath();
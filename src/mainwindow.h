@@ -2,8 +2,10 @@
 #define MAINWINDOW_H
 
 #include "pch.h"
+#include "maploader.h"
 
 class InfiniteCanvas;
+class SearchBar;
 class ShortcutItem;
 class UrlItem;
 
@@ -14,9 +16,14 @@ class MainWindow : public QMainWindow {
   MainWindow(QWidget *parent = nullptr);
   ~MainWindow();
 
+ public slots:
+  // Open a map on behalf of the command line or another instance
+  void openRequestedFile(const QString &file_name);
+
  private slots:
   void newFile();
   void openFile();
+  void importFile();
   void saveFile();
   void showAbout();
   void resetZoom();
@@ -25,18 +32,25 @@ class MainWindow : public QMainWindow {
   void showMainWindow();
   void hideMainWindow();
   void changeLanguage(const QString &locale_code);
+  void setEmbedImages(bool embed);
+  void restoreViewState(qreal scale_factor, const QPointF &center, bool has_center);
+  void showMapLoadError(MapLoader::Error error);
+  void replaceMap();
 
  protected:
   void closeEvent(QCloseEvent *event) override;
   void changeEvent(QEvent *event) override;
   void exportToPng();
   void exportToPdf();
+  void exportOutline();
 
  private:
   void setupMenus();
   void setupTrayIcon();
   void saveToFile(const QString &file_name);
-  void loadFromFile(const QString &file_name);
+  // Load a map; imported maps are not tied to their file, so saving asks
+  // for a new name
+  void loadFromFile(const QString &file_name, bool import = false);
 
   // Recent file handling
   void saveRecentFilePath(const QString &file_path);
@@ -48,13 +62,25 @@ class MainWindow : public QMainWindow {
   void saveLanguageSetting(const QString &locale_code);
   QString loadLanguageSetting();
 
+  // Memory budget for decoded images
+  void loadImageMemoryBudget();
+
+  // Memory limit of the undo history
+  void loadUndoMemoryLimit();
+
   // Window title handling
   void updateWindowTitle();
 
   InfiniteCanvas *m_graphics_view;
+  SearchBar *m_search_bar;
   QGraphicsScene *m_scene;
+  MapLoader *m_map_loader;
+  QUndoStack *m_undo_stack;
   QString m_current_file;
+  QString m_loading_file;  // Becomes the current file once its map is parsed
+  bool m_map_requested;    // A map was loaded, so the recent one is not opened at startup
   QAction *m_always_on_top_action;
+  bool m_embed_images;  // Store image data in the map instead of file paths
 
   // Tray icon related
   QSystemTrayIcon *m_tray_icon;
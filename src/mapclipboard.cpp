@@ -0,0 +1,331 @@
+#include "pch.h"
+
+#include "mapclipboard.h"
+#include "infinitecanvas.h"
+#include "maploader.h"
+#include "mapwriter.h"
+#include "outlineexporter.h"
+#include "trace.h"
+#include "undocommands.h"
+
+const QString MapClipboard::kMimeType = QStringLiteral("application/x-qtmindmap-items");
+
+namespace {
+// Formats other applications understand
+const QString kTextFormat = QStringLiteral("text/plain");
+const QString kUrlFormat = QStringLiteral("text/uri-list");
+const QString kImageFormat = QStringLiteral("application/x-qt-image");
+
+// Data copied last, while it still refers to its items
+QPointer<MapMimeData> s_pending;
+}
+
+QMimeData *MapClipboard::mimeData(QGraphicsScene *scene, const QList<QGraphicsItem*> &items)
+{
+    MapMimeData *mime_data = new MapMimeData(scene, items);
+    s_pending = mime_data;
+    return mime_data;
+}
+
+void MapClipboard::aboutToChangeItems(const QList<QGraphicsItem*> &items)
+{
+    if (!s_pending || !s_pending->isPending()) {
+        return;
+    }
+    MapMimeData *pending = s_pending;
+    if (std::any_of(items.cbegin(), items.cend(),
+                    [pending](QGraphicsItem *item) { return pending->refersTo(item); })) {
+        pending->materialize();
+    }
+}
+
+void MapClipboard::aboutToChangeItem(QGraphicsItem *item)
+{
+    if (s_pending && s_pending->isPending() && s_pending->refersTo(item)) {
+        s_pending->materialize();
+    }
+}
+
+void MapClipboard::aboutToClearScene(const QGraphicsScene *scene)
+{
+    if (s_pending && s_pending->isPending() && s_pending->scene() == scene) {
+        s_pending->materialize();
+    }
+}
+
+QList<QGraphicsItem*> MapClipboard::withDescendants(const QList<QGraphicsItem*> &items)
+{
+    QList<QGraphicsItem*> result;
+    QSet<QGraphicsItem*> seen;
+    QVector<QGraphicsItem*> pending(items.cbegin(), items.cend());
+    std::reverse(pending.begin(), pending.end());
+
+    // Depth first, so trees keep their order
+    while (!pending.isEmpty()) {
+        QGraphicsItem *item = pending.takeLast();
+        if (seen.contains(item)) {
+            continue;
+        }
+        seen.insert(item);
+        result.append(item);
+
+        if (EditableTextItem *node = dynamic_cast<EditableTextItem*>(item)) {
+            NodeLinks::Children children = node->childNodes();
+            for (int i = children.size() - 1; i >= 0; --i) {
+                pending.append(children[i]);
+            }
+        }
+    }
+    return result;
+}
+
+QByteArray MapClipboard::encode(const QList<QGraphicsItem*> &items)
+{
+    TRACE_SCOPE("MapClipboard::encode", "clipboard");
+
+    if (items.isEmpty()) {
+        return QByteArray();
+    }
+
+    // Positions are stored relative to the top-left item position
+    QPointF origin = items.first()->pos();
+    for (QGraphicsItem *item : items) {
+        origin.setX(qMin(origin.x(), item->x()));
+        origin.setY(qMin(origin.y(), item->y()));
+    }
+
+    QJsonObject document = MapWriter::itemsToJson(items, origin, false);
+    return QCborValue::fromJsonValue(document).toCbor();
+}
+
+QList<QGraphicsItem*> MapClipboard::paste(QGraphicsScene *scene, const QByteArray &data,
+                                          const QPointF &pos)
+{
+    TRACE_SCOPE("MapClipboard::paste", "clipboard");
+
+    QCborValue value = QCborValue::fromCbor(data);
+    if (!value.isMap()) {
+        qWarning() << "Invalid map items on the clipboard";
+        return QList<QGraphicsItem*>();
+    }
+    return MapLoader::insertItems(scene, value.toMap().toJsonObject(), pos);
+}
+
+MapMimeData::MapMimeData(QGraphicsScene *scene, const QList<QGraphicsItem*> &items)
+    : m_scene(scene), m_outline(false)
+{
+    if (items.isEmpty()) {
+        return;
+    }
+
+    ItemRegistry &registry = ItemRegistry::instance();
+    m_item_ids.reserve(items.size());
+    for (QGraphicsItem *item : items) {
+        m_item_ids.append(registry.idOf(item));
+    }
+    m_copied_ids = QSet<quint64>(m_item_ids.cbegin(), m_item_ids.cend());
+
+    m_formats.append(MapClipboard::kMimeType);
+
+    // Other applications get the first item as text, a URL or an image
+    QGraphicsItem *item = items.first();
+    QString kind = item->data(1).toString();
+    if (dynamic_cast<QGraphicsTextItem*>(item)) {
+        m_formats.append(kTextFormat);
+    } else if (kind == "url" || kind == "shortcut" || kind == "directory" || kind == "media") {
+        m_formats.append(kUrlFormat);
+        m_formats.append(kTextFormat);
+    } else if (ImageItem *image_item = dynamic_cast<ImageItem*>(item)) {
+        if (!image_item->filePath().isEmpty()) {
+            m_formats.append(kUrlFormat);
+            m_formats.append(kTextFormat);
+        }
+        m_formats.append(kImageFormat);
+    }
+
+    // ...or the copied trees as an outline, when there is more than one node
+    EditableTextItem *first_node = dynamic_cast<EditableTextItem*>(item);
+    if (items.size() > 1 || (first_node && !first_node->childNodes().isEmpty())) {
+        m_outline = std::any_of(items.cbegin(), items.cend(), [](QGraphicsItem *copied_item) {
+            return dynamic_cast<EditableTextItem*>(copied_item) != nullptr;
+        });
+    }
+    if (m_outline && !m_formats.contains(kTextFormat)) {
+        m_formats.append(kTextFormat);
+    }
+
+    // URLs and single texts are small, take them right away
+    for (const QString &format : qAsConst(m_formats)) {
+        if (!isDeferred(format)) {
+            m_data.insert(format, produce(format));
+        }
+    }
+    if (std::none_of(m_formats.cbegin(), m_formats.cend(),
+                     [this](const QString &format) { return isDeferred(format); })) {
+        m_item_ids.clear();
+        m_copied_ids.clear();
+        return;
+    }
+
+    // The items are gone once the application quits
+    connect(qApp, &QCoreApplication::aboutToQuit, this, &MapMimeData::materialize);
+}
+
+QStringList MapMimeData::formats() const
+{
+    QStringList formats = m_formats;
+    for (const QString &format : QMimeData::formats()) {
+        if (!formats.contains(format)) {
+            formats.append(format);
+        }
+    }
+    return formats;
+}
+
+bool MapMimeData::hasFormat(const QString &mime_type) const
+{
+    return m_formats.contains(mime_type) || QMimeData::hasFormat(mime_type);
+}
+
+void MapMimeData::materialize()
+{
+    if (!isPending()) {
+        return;
+    }
+
+    TRACE_SCOPE("MapMimeData::materialize", "clipboard");
+
+    for (const QString &format : m_formats) {
+        if (!m_data.contains(format)) {
+            m_data.insert(format, produce(format));
+        }
+    }
+    m_item_ids.clear();
+    m_copied_ids.clear();
+}
+
+bool MapMimeData::refersTo(QGraphicsItem *item) const
+{
+    // The copy holds the nodes below the copied ones as well
+    ItemRegistry &registry = ItemRegistry::instance();
+    while (item) {
+        quint64 id = registry.existingId(item);
+        if (id && m_copied_ids.contains(id)) {
+            return true;
+        }
+        EditableTextItem *node = dynamic_cast<EditableTextItem*>(item);
+        item = node ? node->parentNode() : nullptr;
+    }
+    return false;
+}
+
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+QVariant MapMimeData::retrieveData(const QString &mime_type, QVariant::Type type) const
+#else
+QVariant MapMimeData::retrieveData(const QString &mime_type, QMetaType type) const
+#endif
+{
+    if (!m_formats.contains(mime_type)) {
+        return QMimeData::retrieveData(mime_type, type);
+    }
+
+    // Build each format once, on first request
+    auto it = m_data.constFind(mime_type);
+    if (it == m_data.constEnd()) {
+        it = m_data.insert(mime_type, isPending() ? produce(mime_type) : QVariant());
+    }
+    return it.value();
+}
+
+QVariant MapMimeData::produce(const QString &mime_type) const
+{
+    QList<QGraphicsItem*> copied_items = items();
+    if (copied_items.isEmpty()) {
+        return QVariant();
+    }
+
+    if (mime_type == MapClipboard::kMimeType) {
+        return MapClipboard::encode(MapClipboard::withDescendants(copied_items));
+    }
+    if (mime_type == kTextFormat) {
+        return text(copied_items);
+    }
+
+    QGraphicsItem *item = copied_items.first();
+    ImageItem *image_item = dynamic_cast<ImageItem*>(item);
+    if (mime_type == kUrlFormat) {
+        QString kind = item->data(1).toString();
+        if (kind == "url") {
+            return QVariantList() << QUrl(item->data(0).toString());
+        }
+        if (kind == "shortcut" || kind == "directory" || kind == "media") {
+            return QVariantList() << QUrl::fromLocalFile(item->data(0).toString());
+        }
+        if (image_item && !image_item->filePath().isEmpty()) {
+            return QVariantList() << QUrl::fromLocalFile(image_item->filePath());
+        }
+    }
+    if (mime_type == kImageFormat && image_item) {
+        // The full resolution image, decoded only now
+        return image_item->fullImage();
+    }
+    return QVariant();
+}
+
+bool MapMimeData::isDeferred(const QString &mime_type) const
+{
+    return mime_type == MapClipboard::kMimeType || mime_type == kImageFormat ||
+           (mime_type == kTextFormat && m_outline);
+}
+
+QList<QGraphicsItem*> MapMimeData::items() const
+{
+    // Items deleted meanwhile are left out
+    ItemRegistry &registry = ItemRegistry::instance();
+    QList<QGraphicsItem*> items;
+    items.reserve(m_item_ids.size());
+    for (quint64 id : m_item_ids) {
+        if (QGraphicsItem *item = registry.item(id)) {
+            items.append(item);
+        }
+    }
+    return items;
+}
+
+QString MapMimeData::text(const QList<QGraphicsItem*> &items) const
+{
+    if (m_outline) {
+        QList<EditableTextItem*> roots = rootNodes(MapClipboard::withDescendants(items));
+        if (!roots.isEmpty()) {
+            QBuffer buffer;
+            buffer.open(QIODevice::WriteOnly);
+            OutlineExporter::write(roots, OutlineExporter::Format::PlainText, &buffer);
+            return QString::fromUtf8(buffer.data());
+        }
+    }
+
+    QGraphicsItem *item = items.first();
+    if (QGraphicsTextItem *text_item = dynamic_cast<QGraphicsTextItem*>(item)) {
+        return text_item->toPlainText();
+    }
+    if (ImageItem *image_item = dynamic_cast<ImageItem*>(item)) {
+        return image_item->filePath();
+    }
+    return item->data(0).toString();
+}
+
+QList<EditableTextItem*> MapMimeData::rootNodes(const QList<QGraphicsItem*> &items)
+{
+    QSet<QGraphicsItem*> copied(items.cbegin(), items.cend());
+    QList<EditableTextItem*> roots;
+    for (QGraphicsItem *item : items) {
+        EditableTextItem *node = dynamic_cast<EditableTextItem*>(item);
+        if (node && !copied.contains(node->parentNode())) {
+            roots.append(node);
+        }
+    }
+    std::stable_sort(roots.begin(), roots.end(), [](const EditableTextItem *a, const EditableTextItem *b) {
+        return a->y() < b->y();
+    });
+    return roots;
+}
@@ -0,0 +1,106 @@
+#ifndef MAPCLIPBOARD_H
+#define MAPCLIPBOARD_H
+
+#include "pch.h"
+
+class EditableTextItem;
+
+// The map's own clipboard format.
+//
+// Copied items travel as a small map document in CBOR: the selected items
+// with the descendants of their text nodes, parent/child links by saved id
+// and positions relative to the top-left item. Pasting creates the items
+// in one batch with fresh ids, so a branch can be pasted any number of
+// times and between windows without losing its structure. Images keep
+// their file path; images without a file are embedded once each.
+class MapClipboard
+{
+public:
+    // MIME type of copied items
+    static const QString kMimeType;
+
+    // Clipboard data for copied items. URLs and single texts are taken
+    // right away, the other formats when they are first requested.
+    static QMimeData *mimeData(QGraphicsScene *scene, const QList<QGraphicsItem*> &items);
+
+    // Produce the pending clipboard data before items are edited, moved,
+    // linked differently or deleted, if they or a node above them were copied
+    static void aboutToChangeItems(const QList<QGraphicsItem*> &items);
+    static void aboutToChangeItem(QGraphicsItem *item);
+
+    // Produce the pending clipboard data before all items of a scene are deleted
+    static void aboutToClearScene(const QGraphicsScene *scene);
+
+    // The items with all descendants of their text nodes, each once
+    static QList<QGraphicsItem*> withDescendants(const QList<QGraphicsItem*> &items);
+
+    // Encode exactly these items for the clipboard; whole trees are copied
+    // by passing withDescendants()
+    static QByteArray encode(const QList<QGraphicsItem*> &items);
+
+    // Add encoded items to the scene with their top-left at pos; returns
+    // the new items, or none if the data is invalid
+    static QList<QGraphicsItem*> paste(QGraphicsScene *scene, const QByteArray &data,
+                                       const QPointF &pos);
+};
+
+// Clipboard data that refers to the copied items instead of holding their
+// data.
+//
+// Copying takes only URLs and single texts right away and records the ids
+// of the copied items. The native items, the outline text of several nodes
+// and the full image are built in retrieveData() when a paste or another
+// application asks for them, and kept afterwards. Before a copied item or a
+// node below one changes, the remaining formats are produced (see
+// MapClipboard::aboutToChangeItems()), so pasting later still gives the
+// content as it was copied.
+class MapMimeData : public QMimeData
+{
+    Q_OBJECT
+public:
+    MapMimeData(QGraphicsScene *scene, const QList<QGraphicsItem*> &items);
+
+    QStringList formats() const override;
+    bool hasFormat(const QString &mime_type) const override;
+
+    const QGraphicsScene *scene() const { return m_scene; }
+
+    // Whether some formats still refer to the items
+    bool isPending() const { return !m_item_ids.isEmpty(); }
+
+    // Whether the item, or a node above it, was copied
+    bool refersTo(QGraphicsItem *item) const;
+
+    // Produce all formats and let go of the items
+    void materialize();
+
+protected:
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+    QVariant retrieveData(const QString &mime_type, QVariant::Type type) const override;
+#else
+    QVariant retrieveData(const QString &mime_type, QMetaType type) const override;
+#endif
+
+private:
+    // Build one format from the items that still exist
+    QVariant produce(const QString &mime_type) const;
+
+    // Whether a format is only built on request
+    bool isDeferred(const QString &mime_type) const;
+    QList<QGraphicsItem*> items() const;
+
+    // Plain text of the copy: the trees as an outline, or the first item
+    QString text(const QList<QGraphicsItem*> &items) const;
+
+    // Text nodes among copied items whose parent is not copied, top to bottom
+    static QList<EditableTextItem*> rootNodes(const QList<QGraphicsItem*> &items);
+
+    QPointer<QGraphicsScene> m_scene;
+    QVector<quint64> m_item_ids;    // Copied items, until the deferred formats are built
+    QSet<quint64> m_copied_ids;     // The same, for lookups
+    QStringList m_formats;
+    bool m_outline;                 // Text is the outline of several nodes
+    mutable QHash<QString, QVariant> m_data; // Formats produced so far
+};
+
+#endif // MAPCLIPBOARD_H
@@ -0,0 +1,182 @@
+#include "pch.h"
+
+#include "mapgenerator.h"
+
+namespace {
+// Layout of generated trees
+constexpr qreal kColumnWidth = 220.0;
+constexpr qreal kRowHeight = 50.0;
+
+// Grid for the non-text items below the trees
+constexpr int kGridColumns = 50;
+constexpr qreal kGridCellWidth = 160.0;
+constexpr qreal kGridCellHeight = 130.0;
+
+const char *const kWords[] = {
+    "idea", "plan", "review", "design", "budget", "research", "draft", "meeting",
+    "release", "feature", "question", "summary", "risk", "goal", "task", "note",
+    "customer", "schedule", "prototype", "metrics", "follow-up", "decision", "topic", "outline"
+};
+
+QString randomText(QRandomGenerator &random, int index)
+{
+    int word_count = random.bounded(1, 5);
+    QStringList words;
+    for (int i = 0; i < word_count; ++i) {
+        words.append(QLatin1String(kWords[random.bounded(int(sizeof(kWords) / sizeof(kWords[0])))]));
+    }
+    return QString("%1 %2").arg(words.join(' ')).arg(index);
+}
+}
+
+bool MapGenerator::parseMix(const QString &mix, Options *options)
+{
+    for (const QString &part : mix.split(',', Qt::SkipEmptyParts)) {
+        QStringList key_value = part.split('=');
+        bool ok = false;
+        int percent = key_value.size() == 2 ? key_value[1].trimmed().toInt(&ok) : 0;
+        if (!ok || percent < 0) {
+            return false;
+        }
+
+        QString key = key_value[0].trimmed().toLower();
+        if (key == "url") {
+            options->url_percent = percent;
+        } else if (key == "directory") {
+            options->directory_percent = percent;
+        } else if (key == "media") {
+            options->media_percent = percent;
+        } else if (key == "image") {
+            options->image_percent = percent;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+QJsonObject MapGenerator::generate(const Options &options)
+{
+    QRandomGenerator random(options.seed);
+    int node_count = qMax(0, options.node_count);
+    int fan_out = qMax(1, options.fan_out);
+
+    // Grow the trees breadth-first; a new root starts when the depth limit
+    // leaves no node that may get children
+    QVector<int> depths;
+    QVector<QVector<int>> children(node_count);
+    QVector<int> roots;
+    QVector<int> open; // Nodes that still get children, in creation order
+    int next_open = 0;
+    depths.reserve(node_count);
+
+    while (depths.size() < node_count) {
+        if (next_open == open.size()) {
+            roots.append(depths.size());
+            open.append(depths.size());
+            depths.append(0);
+            continue;
+        }
+
+        int parent = open[next_open++];
+        int child_count = random.bounded(1, fan_out + 1);
+        for (int i = 0; i < child_count && depths.size() < node_count; ++i) {
+            int child = depths.size();
+            depths.append(depths[parent] + 1);
+            children[parent].append(child);
+            if (depths[child] < options.max_depth) {
+                open.append(child);
+            }
+        }
+    }
+
+    // Leaves take consecutive rows, parents are centered on their children
+    QVector<qreal> y_positions(node_count);
+    qreal next_row_y = 0;
+    for (int root : roots) {
+        // Post-order walk with an explicit stack of (node, next child)
+        QVector<QPair<int, int>> stack;
+        stack.append(qMakePair(root, 0));
+        while (!stack.isEmpty()) {
+            QPair<int, int> &top = stack.last();
+            const QVector<int> &node_children = children[top.first];
+            if (top.second < node_children.size()) {
+                int child = node_children[top.second++];
+                stack.append(qMakePair(child, 0));
+                continue;
+            }
+
+            int node = top.first;
+            if (node_children.isEmpty()) {
+                y_positions[node] = next_row_y;
+                next_row_y += kRowHeight;
+            } else {
+                y_positions[node] = (y_positions[node_children.first()] +
+                                     y_positions[node_children.last()]) / 2;
+            }
+            stack.removeLast();
+        }
+    }
+
+    QJsonArray items;
+    for (int i = 0; i < node_count; ++i) {
+        QJsonObject item;
+        item["type"] = "text_node";
+        item["id"] = QString::number(i);
+        item["content"] = randomText(random, i);
+        item["x"] = depths[i] * kColumnWidth;
+        item["y"] = y_positions[i];
+        if (!children[i].isEmpty()) {
+            QJsonArray child_ids;
+            for (int child : children[i]) {
+                child_ids.append(QString::number(child));
+            }
+            item["child_nodes"] = child_ids;
+        }
+        items.append(item);
+    }
+
+    // Other item types go into a grid below the trees
+    int url_count = node_count * options.url_percent / 100;
+    int directory_count = node_count * options.directory_percent / 100;
+    int media_count = node_count * options.media_percent / 100;
+    int image_count = node_count * options.image_percent / 100;
+    int extra_count = url_count + directory_count + media_count + image_count;
+    qreal grid_top = next_row_y + kGridCellHeight;
+
+    for (int i = 0; i < extra_count; ++i) {
+        QJsonObject item;
+        item["x"] = (i % kGridColumns) * kGridCellWidth;
+        item["y"] = grid_top + (i / kGridColumns) * kGridCellHeight;
+
+        if (i < url_count) {
+            item["type"] = "url";
+            item["url"] = QString("https://site%1.example.com/page%2").arg(i % 500).arg(i);
+        } else if (i < url_count + directory_count) {
+            item["type"] = "directory";
+            item["dir_path"] = QString("/generated/folder%1").arg(i);
+        } else if (i < url_count + directory_count + media_count) {
+            static const char *const media_suffixes[] = {"mp3", "mp4", "wav", "mkv"};
+            item["type"] = "media";
+            item["media_path"] = QString("/generated/clip%1.%2").arg(i).arg(media_suffixes[i % 4]);
+        } else {
+            // Missing files show the placeholder at their stored size
+            item["type"] = "image";
+            item["file_path"] = QString("/generated/image%1.png").arg(i);
+            item["width"] = 320;
+            item["height"] = 240;
+        }
+        items.append(item);
+    }
+
+    // Open the map at its first root
+    QJsonObject view_state;
+    view_state["scale_factor"] = 1.0;
+    view_state["center_x"] = 0.0;
+    view_state["center_y"] = roots.isEmpty() ? 0.0 : y_positions[roots.first()];
+
+    QJsonObject json_data;
+    json_data["items"] = items;
+    json_data["view_state"] = view_state;
+    return json_data;
+}
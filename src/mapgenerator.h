@@ -0,0 +1,37 @@
+#ifndef MAPGENERATOR_H
+#define MAPGENERATOR_H
+
+#include "pch.h"
+
+// Builds synthetic maps for benchmarks and stress tests.
+//
+// The same options always give the same map: trees are grown breadth-first
+// with a seeded random generator, node texts are drawn from a fixed word
+// list and positions follow a left-to-right tree layout. Besides text nodes
+// a map can hold a mix of URL, folder, media and image items, laid out in a
+// grid below the trees; their paths are synthetic, so loading them never
+// touches the file system or network. The result is a native map document
+// that can be saved or fed to MapLoader.
+class MapGenerator
+{
+public:
+    struct Options
+    {
+        int node_count = 1000;    // Text nodes
+        int max_depth = 8;        // Deepest level below a root
+        int fan_out = 6;          // Most children per node
+        int url_percent = 0;      // Extra items, relative to node_count
+        int directory_percent = 0;
+        int media_percent = 0;
+        int image_percent = 0;
+        quint32 seed = 1;
+    };
+
+    // Parse an item mix such as "url=5,directory=5,media=5,image=5"
+    static bool parseMix(const QString &mix, Options *options);
+
+    // Generate a map document
+    static QJsonObject generate(const Options &options);
+};
+
+#endif // MAPGENERATOR_H
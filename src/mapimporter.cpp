@@ -0,0 +1,161 @@
+#include "pch.h"
+
+#include "mapimporter.h"
+#include "styletable.h"
+#include "trace.h"
+
+namespace {
+// Horizontal gap between a node and its children (as in Organize Layout)
+constexpr qreal kHorizontalGap = 100.0;
+
+// Vertical distance between leaf rows
+constexpr qreal kRowHeight = 50.0;
+
+// Document margin plus border padding on both sides of a text node
+constexpr qreal kNodeMargins = 20.0;
+
+// A node whose element has not been closed yet
+struct OpenNode
+{
+    QString id;
+    QString text;
+    qreal x = 0;
+    qreal width = 0;
+    bool folded = false;
+    QJsonArray child_ids;
+    qreal first_child_y = 0;
+    qreal last_child_y = 0;
+};
+
+// Width of a text node showing this text
+qreal nodeWidth(const QFontMetricsF &metrics, const QString &text)
+{
+    qreal width = 0;
+    for (const QString &line : text.split(QLatin1Char('\n'))) {
+        width = qMax(width, metrics.horizontalAdvance(line));
+    }
+    return width + kNodeMargins;
+}
+}
+
+MapImporter::Format MapImporter::formatForFile(const QString &file_name)
+{
+    QString suffix = QFileInfo(file_name).suffix().toLower();
+    if (suffix == "mm") {
+        return Format::FreeMind;
+    }
+    if (suffix == "opml") {
+        return Format::Opml;
+    }
+    return Format::None;
+}
+
+bool MapImporter::read(QIODevice *device, Format format, QJsonObject *json_data,
+                       QString *error_string)
+{
+    TRACE_SCOPE("MapImporter::read", "load");
+
+    // FreeMind uses <node TEXT="...">, OPML <outline text="...">
+    const QLatin1String node_element(format == Format::FreeMind ? "node" : "outline");
+    const QLatin1String text_attribute(format == Format::FreeMind ? "TEXT" : "text");
+
+    // Same font as the text nodes created from the items
+    QFontMetricsF metrics(StyleTable::instance().style(0).font);
+
+    QXmlStreamReader xml(device);
+    QJsonArray items;
+    QVector<OpenNode> open_nodes;
+    int next_id = 0;
+    qreal next_row_y = 0;
+    QPointF first_root_pos;
+    bool has_root = false;
+
+    while (!xml.atEnd()) {
+        QXmlStreamReader::TokenType token = xml.readNext();
+
+        if (token == QXmlStreamReader::StartElement) {
+            if (xml.name() == node_element) {
+                // Children start right of their parent
+                OpenNode node;
+                node.id = QString::number(next_id++);
+                node.text = xml.attributes().value(text_attribute).toString();
+                node.width = nodeWidth(metrics, node.text);
+                node.folded = format == Format::FreeMind &&
+                              xml.attributes().value(QLatin1String("FOLDED")) == QLatin1String("true");
+                if (!open_nodes.isEmpty()) {
+                    node.x = open_nodes.last().x + open_nodes.last().width + kHorizontalGap;
+                }
+                open_nodes.append(node);
+            } else if (format == Format::FreeMind && xml.name() == QLatin1String("richcontent") &&
+                       xml.attributes().value(QLatin1String("TYPE")) == QLatin1String("NODE") &&
+                       !open_nodes.isEmpty() && open_nodes.last().text.isEmpty()) {
+                // Formatted FreeMind nodes keep their text as HTML, take the plain text
+                OpenNode &node = open_nodes.last();
+                node.text = xml.readElementText(QXmlStreamReader::IncludeChildElements).trimmed();
+                node.width = nodeWidth(metrics, node.text);
+            }
+        } else if (token == QXmlStreamReader::EndElement && xml.name() == node_element) {
+            if (open_nodes.isEmpty()) {
+                continue;
+            }
+            OpenNode node = open_nodes.takeLast();
+
+            // Leaves take the next row, parents are centered on their children
+            qreal y = 0;
+            if (node.child_ids.isEmpty()) {
+                y = next_row_y;
+                next_row_y += kRowHeight;
+            } else {
+                y = (node.first_child_y + node.last_child_y) / 2;
+            }
+
+            QJsonObject item;
+            item["type"] = "text_node";
+            item["id"] = node.id;
+            item["content"] = node.text;
+            item["x"] = node.x;
+            item["y"] = y;
+            if (!node.child_ids.isEmpty()) {
+                item["child_nodes"] = node.child_ids;
+
+                // Folded FreeMind branches stay collapsed
+                if (node.folded) {
+                    item["collapsed"] = true;
+                }
+            }
+            items.append(item);
+
+            // Report the node to its parent, or remember where the map starts
+            if (!open_nodes.isEmpty()) {
+                OpenNode &parent = open_nodes.last();
+                if (parent.child_ids.isEmpty()) {
+                    parent.first_child_y = y;
+                }
+                parent.last_child_y = y;
+                parent.child_ids.append(node.id);
+            } else if (!has_root) {
+                first_root_pos = QPointF(node.x, y);
+                has_root = true;
+            }
+        }
+    }
+
+    if (xml.hasError()) {
+        *error_string = QString("%1 (line %2)").arg(xml.errorString()).arg(xml.lineNumber());
+        return false;
+    }
+    if (items.isEmpty()) {
+        *error_string = "No outline nodes found";
+        return false;
+    }
+
+    // Open the map at its first root
+    QJsonObject view_state;
+    view_state["scale_factor"] = 1.0;
+    view_state["center_x"] = first_root_pos.x();
+    view_state["center_y"] = first_root_pos.y();
+
+    json_data->insert("items", items);
+    json_data->insert("view_state", view_state);
+    return true;
+}
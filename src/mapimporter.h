@@ -0,0 +1,27 @@
+#ifndef MAPIMPORTER_H
+#define MAPIMPORTER_H
+
+#include "pch.h"
+
+// Imports FreeMind (.mm) and OPML outlines as map data.
+//
+// The XML is read with QXmlStreamReader in a single forward pass, keeping
+// only the chain of currently open nodes. Each node is written as a text
+// node record of the native map format when its element closes, so the
+// result goes through the same chunked item creation as a saved map.
+// Positions are assigned while reading: leaves take consecutive rows and
+// every parent is centered on its children, left of them.
+class MapImporter
+{
+public:
+    enum class Format { None, FreeMind, Opml };
+
+    // Format of a file, judged by its suffix
+    static Format formatForFile(const QString &file_name);
+
+    // Read an outline into map data with "items" and "view_state" (thread safe)
+    static bool read(QIODevice *device, Format format, QJsonObject *json_data,
+                     QString *error_string);
+};
+
+#endif // MAPIMPORTER_H
@@ -0,0 +1,588 @@
+#include "pch.h"
+
+#include "maploader.h"
+#include "infinitecanvas.h"
+#include "iconcache.h"
+#include "iconloader.h"
+#include "itempool.h"
+#include "mapimporter.h"
+#include "mapwriter.h"
+#include "sceneindexsuspender.h"
+#include "styletable.h"
+#include "trace.h"
+
+MapLoader::MapLoader(QGraphicsScene *scene, QObject *parent)
+    : QObject(parent), m_scene(scene), m_state(State::Idle), m_generation(0),
+      m_next(0), m_loaded_items(0), m_trace_start(0)
+{
+}
+
+void MapLoader::load(const QString &file_name)
+{
+    cancel();
+
+    m_file_name = file_name;
+    m_state = State::Parsing;
+    m_trace_start = Trace::now();
+    int generation = m_generation;
+    StyleTable::instance().beginDocument();
+
+    // Reading and parsing a large map takes a while, keep it off the GUI thread
+    QPointer<MapLoader> guard(this);
+    QThreadPool::globalInstance()->start([guard, generation, file_name]() {
+        QJsonObject json_data;
+        QVector<int> order;
+        QHash<QString, CollapsedSubtree> collapsed_subtrees;
+        Error error = Error::InvalidJson;
+        bool ok = parseFile(file_name, &json_data, &order, &collapsed_subtrees, &error);
+
+        QMetaObject::invokeMethod(qApp, [guard, generation, ok, json_data, order,
+                                         collapsed_subtrees, error]() {
+            // Drop results of loads that were cancelled meanwhile
+            if (!guard || guard->m_generation != generation) {
+                return;
+            }
+            if (ok) {
+                guard->onParsed(generation, json_data, order, collapsed_subtrees);
+            } else {
+                guard->m_state = State::Idle;
+                emit guard->failed(error);
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+void MapLoader::cancel()
+{
+    if (m_state == State::Idle) {
+        return;
+    }
+
+    qDebug() << "Cancelled loading" << m_file_name << "after" << m_loaded_items << "items";
+
+    // Invalidate queued chunks and parse results
+    ++m_generation;
+    m_state = State::Idle;
+    m_items = QJsonArray();
+    m_order.clear();
+    m_nodes.clear();
+    m_collapsed_subtrees.clear();
+    m_blob_store.fromJson(QJsonObject());
+    m_style_map.clear();
+}
+
+bool MapLoader::loadNow(const QString &file_name)
+{
+    cancel();
+
+    m_file_name = file_name;
+    m_state = State::Parsing;
+    m_trace_start = Trace::now();
+    StyleTable::instance().beginDocument();
+
+    if (!parseNow()) {
+        return false;
+    }
+    finishNow();
+    return true;
+}
+
+void MapLoader::finishNow()
+{
+    if (m_state == State::Parsing && !parseNow()) {
+        return;
+    }
+
+    if (m_state == State::Creating) {
+        while (m_next < m_order.size()) {
+            if (createItem(m_items[m_order[m_next]].toObject())) {
+                m_loaded_items++;
+            }
+            m_next++;
+        }
+        finishLoading();
+    }
+}
+
+bool MapLoader::parseNow()
+{
+    // Parse here instead of waiting for the worker
+    QJsonObject json_data;
+    QVector<int> order;
+    QHash<QString, CollapsedSubtree> collapsed_subtrees;
+    Error error = Error::InvalidJson;
+    int generation = ++m_generation;
+    if (!parseFile(m_file_name, &json_data, &order, &collapsed_subtrees, &error)) {
+        m_state = State::Idle;
+        emit failed(error);
+        return false;
+    }
+    onParsed(generation, json_data, order, collapsed_subtrees);
+    return true;
+}
+
+bool MapLoader::parseFile(const QString &file_name, QJsonObject *json_data, QVector<int> *order,
+                          QHash<QString, CollapsedSubtree> *collapsed_subtrees, Error *error)
+{
+    TRACE_SCOPE("MapLoader::parseFile", "load");
+
+    QFileInfo file_info(file_name);
+    if (!file_info.exists() || !file_info.isFile()) {
+        qCritical() << "Error: File does not exist or is not a regular file:" << file_name;
+        *error = Error::FileNotFound;
+        return false;
+    }
+
+    // Read the JSON file
+    QFile load_file(file_name);
+    if (!load_file.open(QIODevice::ReadOnly)) {
+        qCritical() << "Failed to open file for reading:" << file_name << "Error:" << load_file.errorString();
+        *error = Error::OpenFailed;
+        return false;
+    }
+
+    // FreeMind and OPML outlines are streamed into the native item format
+    MapImporter::Format format = MapImporter::formatForFile(file_name);
+    if (format != MapImporter::Format::None) {
+        QString error_string;
+        if (!MapImporter::read(&load_file, format, json_data, &error_string)) {
+            qCritical() << "Invalid outline in file:" << file_name << "Error:" << error_string;
+            *error = Error::InvalidOutline;
+            return false;
+        }
+    } else if (MapWriter::formatForFile(file_name) == MapWriter::Format::Cbor) {
+        // Binary maps hold the same document as CBOR
+        QCborValue map_value = QCborValue::fromCbor(load_file.readAll());
+        if (!map_value.isMap()) {
+            qCritical() << "Invalid binary map format in file:" << file_name;
+            *error = Error::InvalidJson;
+            return false;
+        }
+        *json_data = map_value.toMap().toJsonObject();
+    } else {
+        QJsonDocument load_doc(QJsonDocument::fromJson(load_file.readAll()));
+        if (load_doc.isNull() || !load_doc.isObject()) {
+            qCritical() << "Invalid JSON format in file:" << file_name;
+            *error = Error::InvalidJson;
+            return false;
+        }
+        *json_data = load_doc.object();
+    }
+
+    // Create the items around the saved view center first
+    QJsonArray items_array = (*json_data)["items"].toArray();
+    QJsonObject view_state = (*json_data)["view_state"].toObject();
+    QPointF center(view_state["center_x"].toDouble(), view_state["center_y"].toDouble());
+
+    // Hidden descendants of collapsed nodes are left out
+    QVector<int> style_map = StyleTable::instance().intern((*json_data)["styles"].toArray());
+    QVector<bool> hidden;
+    collectCollapsedSubtrees(items_array, style_map, collapsed_subtrees, &hidden);
+
+    QVector<qreal> distances(items_array.size());
+    order->reserve(items_array.size());
+    for (int i = 0; i < items_array.size(); ++i) {
+        if (!hidden.isEmpty() && hidden[i]) {
+            continue;
+        }
+        QJsonObject item_data = items_array[i].toObject();
+        QPointF offset = QPointF(item_data["x"].toDouble(), item_data["y"].toDouble()) - center;
+        distances[i] = QPointF::dotProduct(offset, offset);
+        order->append(i);
+    }
+    std::stable_sort(order->begin(), order->end(), [&distances](int a, int b) {
+        return distances[a] < distances[b];
+    });
+
+    return true;
+}
+
+void MapLoader::collectCollapsedSubtrees(const QJsonArray &items_array, const QVector<int> &style_map,
+                                         QHash<QString, CollapsedSubtree> *collapsed_subtrees,
+                                         QVector<bool> *hidden)
+{
+    // Text nodes by id, and the collapsed ones
+    QHash<QString, int> indexes;
+    QHash<QString, QJsonObject> nodes;
+    QVector<int> collapsed_items;
+    for (int i = 0; i < items_array.size(); ++i) {
+        QJsonObject item_data = items_array[i].toObject();
+        QString type = item_data["type"].toString();
+        if ((type != "text_node" && type != "text") || !item_data.contains("id")) {
+            continue;
+        }
+        indexes.insert(item_data["id"].toString(), i);
+        nodes.insert(item_data["id"].toString(), item_data);
+        if (item_data["collapsed"].toBool()) {
+            collapsed_items.append(i);
+        }
+    }
+    if (collapsed_items.isEmpty()) {
+        return;
+    }
+
+    // Everything below a collapsed node is hidden
+    hidden->fill(false, items_array.size());
+    for (int collapsed_item : collapsed_items) {
+        QVector<QString> pending;
+        for (const QJsonValue &child_id : items_array[collapsed_item].toObject()["child_nodes"].toArray()) {
+            pending.append(child_id.toString());
+        }
+        while (!pending.isEmpty()) {
+            int index = indexes.value(pending.takeLast(), -1);
+            if (index < 0 || (*hidden)[index]) {
+                continue;
+            }
+            (*hidden)[index] = true;
+            for (const QJsonValue &child_id : items_array[index].toObject()["child_nodes"].toArray()) {
+                pending.append(child_id.toString());
+            }
+        }
+    }
+
+    // Records refer to styles by their index in the shared table
+    for (auto it = nodes.begin(); it != nodes.end(); ++it) {
+        if ((*hidden)[indexes.value(it.key())]) {
+            QJsonObject &record = it.value();
+            record["style"] = StyleTable::instance().resolve(record, style_map);
+            record.remove("font_family");
+            record.remove("font_size");
+            record.remove("color");
+        }
+    }
+
+    // The outermost collapsed nodes keep the records, nested ones inside them
+    for (int collapsed_item : collapsed_items) {
+        if ((*hidden)[collapsed_item]) {
+            continue;
+        }
+        QJsonObject item_data = items_array[collapsed_item].toObject();
+        QPointF origin(item_data["x"].toDouble(), item_data["y"].toDouble());
+        CollapsedSubtree subtree = CollapsedSubtree::fromMapItems(nodes, item_data["child_nodes"].toArray(),
+                                                                  origin);
+        if (!subtree.isEmpty()) {
+            collapsed_subtrees->insert(item_data["id"].toString(), subtree);
+        }
+    }
+}
+
+void MapLoader::onParsed(int generation, const QJsonObject &json_data, const QVector<int> &order,
+                         const QHash<QString, CollapsedSubtree> &collapsed_subtrees)
+{
+    // The load can no longer fail, replace the previous map
+    emit parsed();
+
+    m_items = json_data["items"].toArray();
+    m_order = order;
+    m_next = 0;
+    m_loaded_items = 0;
+    m_nodes.clear();
+    m_collapsed_subtrees = collapsed_subtrees;
+
+    // Images embedded in the map
+    m_blob_store.fromJson(json_data["image_blobs"].toObject());
+
+    // Styles of the map, already interned while parsing, and the styles of
+    // its new nodes
+    m_style_map = StyleTable::instance().intern(json_data["styles"].toArray());
+    QVector<int> depth_styles;
+    for (const QJsonValue &depth_style : json_data["depth_styles"].toArray()) {
+        depth_styles.append(m_style_map.value(depth_style.toInt()));
+    }
+    StyleTable::instance().setDepthStyles(depth_styles);
+
+    qDebug() << "Loading" << m_items.size() << "items from" << m_file_name;
+
+    // Restore the view first so the items appear where the user left off
+    if (json_data.contains("view_state")) {
+        QJsonObject view_state = json_data["view_state"].toObject();
+        bool has_center = view_state.contains("center_x") && view_state.contains("center_y");
+        QPointF center(view_state["center_x"].toDouble(), view_state["center_y"].toDouble());
+        emit viewStateLoaded(view_state["scale_factor"].toDouble(), center, has_center);
+    } else {
+        qDebug() << "No view state found in file, using defaults";
+    }
+
+    m_state = State::Creating;
+    QTimer::singleShot(0, this, [this, generation]() {
+        if (m_generation == generation) {
+            processChunk();
+        }
+    });
+}
+
+void MapLoader::processChunk()
+{
+    TRACE_SCOPE("MapLoader::processChunk", "load");
+
+    // Create items until the time budget of this chunk is used up
+    QElapsedTimer timer;
+    timer.start();
+    while (m_next < m_order.size() && timer.elapsed() < kChunkBudgetMs) {
+        if (createItem(m_items[m_order[m_next]].toObject())) {
+            m_loaded_items++;
+        }
+        m_next++;
+    }
+
+    emit progress(m_next, m_order.size());
+
+    if (m_next < m_order.size()) {
+        // Let the event loop paint and handle input before the next chunk
+        int generation = m_generation;
+        QTimer::singleShot(0, this, [this, generation]() {
+            if (m_generation == generation) {
+                processChunk();
+            }
+        });
+    } else {
+        finishLoading();
+    }
+}
+
+void MapLoader::finishLoading()
+{
+    connectNodes();
+
+    qDebug() << "Successfully loaded" << m_loaded_items << "logical items out of"
+             << m_items.size() << "items from file";
+    if (m_loaded_items != m_order.size()) {
+        qWarning() << "LOGICAL ITEMS DISCREPANCY: Loaded" << m_loaded_items
+                   << "logical items but the file contained" << m_order.size()
+                   << "visible items";
+    }
+    qDebug() << "File loading complete:" << m_file_name;
+    Trace::record("MapLoader::load", "load", m_trace_start, Trace::now() - m_trace_start);
+
+    int loaded_items = m_loaded_items;
+
+    // Release the parsed document
+    ++m_generation;
+    m_state = State::Idle;
+    m_items = QJsonArray();
+    m_order.clear();
+    m_nodes.clear();
+    m_collapsed_subtrees.clear();
+    m_blob_store.fromJson(QJsonObject());
+    m_style_map.clear();
+
+    emit finished(loaded_items);
+}
+
+bool MapLoader::createItem(const QJsonObject &item_data)
+{
+    QGraphicsItem *item = itemFromJson(item_data, &m_blob_store, m_style_map);
+    if (!item) {
+        return false;
+    }
+
+    // Remember the saved ID of text nodes for connecting nodes later
+    EditableTextItem *text_item = dynamic_cast<EditableTextItem*>(item);
+    if (text_item && item_data.contains("id")) {
+        QString id = item_data["id"].toString();
+        m_nodes.insert(id, text_item);
+
+        // Collapsed nodes keep their descendants as records
+        auto subtree = m_collapsed_subtrees.find(id);
+        if (subtree != m_collapsed_subtrees.end()) {
+            text_item->setCollapsedSubtree(subtree.value());
+            m_collapsed_subtrees.erase(subtree);
+        }
+    }
+
+    m_scene->addItem(item);
+    return true;
+}
+
+QGraphicsItem *MapLoader::itemFromJson(const QJsonObject &item_data, ImageBlobStore *blob_store,
+                                       const QVector<int> &style_map)
+{
+    QString type = item_data["type"].toString();
+    QPointF pos(item_data["x"].toDouble(), item_data["y"].toDouble());
+
+    if (type == "text_node" || type == "text") {
+        // Create text item with its saved style
+        EditableTextItem *text_item = EditableTextItem::fromRecord(item_data, style_map);
+        text_item->setPos(pos);
+        return text_item;
+    } else if (type == "shortcut") {
+        QString target_path = item_data["target_path"].toString();
+        if (target_path.isEmpty()) {
+            qWarning() << "Empty target path for shortcut item at position" << pos;
+            return nullptr;
+        }
+
+        // Create the shortcut item with a placeholder icon
+        ShortcutItem *shortcut_item =
+            ItemPool::instance().takeShortcutItem(IconCache::instance().placeholderIcon(), target_path);
+
+        // Resolve the real icon in the background
+        IconLoader::instance().requestFileIcon(shortcut_item, target_path);
+
+        shortcut_item->setPos(pos);
+        shortcut_item->setToolTip(target_path);
+        return shortcut_item;
+    } else if (type == "url") {
+        QString url_str = item_data["url"].toString();
+        QUrl url(url_str);
+        if (url_str.isEmpty() || !url.isValid()) {
+            qWarning() << "Invalid URL:" << url_str << "at position" << pos;
+            return nullptr;
+        }
+
+        // Create the URL item with the letter glyph
+        UrlItem *url_item = ItemPool::instance().takeUrlItem(IconCache::instance().websiteIcon(url), url);
+
+        // Fetch the site's favicon in the background
+        IconLoader::instance().requestWebsiteIcon(url_item, url);
+
+        url_item->setPos(pos);
+        url_item->setToolTip(url_str);
+        return url_item;
+    } else if (type == "directory") {
+        QString dir_path = item_data["dir_path"].toString();
+        if (dir_path.isEmpty()) {
+            qWarning() << "Empty directory path for directory item at position" << pos;
+            return nullptr;
+        }
+
+        DirectoryItem *dir_item =
+            ItemPool::instance().takeDirectoryItem(IconCache::instance().directoryIcon(dir_path), dir_path);
+        dir_item->setPos(pos);
+        dir_item->setToolTip(dir_path);
+        return dir_item;
+    } else if (type == "media") {
+        QString media_path = item_data["media_path"].toString();
+        if (media_path.isEmpty()) {
+            qWarning() << "Empty media path for media item at position" << pos;
+            return nullptr;
+        }
+
+        MediaItem *media_item =
+            ItemPool::instance().takeMediaItem(IconCache::instance().mediaIcon(media_path), media_path);
+        media_item->setPos(pos);
+        media_item->setToolTip(media_path);
+        return media_item;
+    } else if (type == "image") {
+        // Load image from the embedded blob, or from its file path
+        QString file_path = item_data["file_path"].toString();
+        QString blob_key = item_data["blob"].toString();
+        bool is_embedded = blob_store && !blob_key.isEmpty() && blob_store->contains(blob_key);
+
+        if (file_path.isEmpty() && !is_embedded) {
+            qWarning() << "Empty file path for image item at position" << pos;
+            return nullptr;
+        }
+
+        // Decoding happens in the background, missing files show a placeholder
+        QSize size_hint(item_data["width"].toInt(), item_data["height"].toInt());
+        ImageSource source = is_embedded ? blob_store->source(blob_key, file_path)
+                                         : ImageSource::fromFile(file_path);
+
+        ImageItem *image_item = new ImageItem(source, size_hint);
+        image_item->setPos(pos);
+        return image_item;
+    }
+
+    qWarning() << "Unknown item type:" << type << "at position" << pos;
+    return nullptr;
+}
+
+void MapLoader::connectNodes()
+{
+    TRACE_SCOPE("MapLoader::connectNodes", "load");
+
+    // Skip the nodes that were deleted while the map was loading
+    QHash<QString, EditableTextItem*> nodes;
+    nodes.reserve(m_nodes.size());
+    for (auto it = m_nodes.cbegin(); it != m_nodes.cend(); ++it) {
+        if (it.value()) {
+            nodes.insert(it.key(), it.value());
+        }
+    }
+    linkNodes(m_items, nodes);
+
+    qDebug() << "Finished processing node connections";
+}
+
+void MapLoader::linkNodes(const QJsonArray &items_array, const QHash<QString, EditableTextItem*> &nodes)
+{
+    // Create connections based on the saved relationships
+    for (int i = 0; i < items_array.size(); ++i) {
+        QJsonObject item_data = items_array[i].toObject();
+        if (!item_data.contains("child_nodes")) {
+            continue;
+        }
+
+        EditableTextItem *parent_node = nodes.value(item_data["id"].toString());
+        if (!parent_node) {
+            continue;
+        }
+
+        // Process each child reference
+        QJsonArray child_nodes = item_data["child_nodes"].toArray();
+        for (int j = 0; j < child_nodes.size(); ++j) {
+            EditableTextItem *child_node = nodes.value(child_nodes[j].toString());
+            if (child_node) {
+                parent_node->addChildNode(child_node);
+            }
+        }
+    }
+}
+
+QList<QGraphicsItem*> MapLoader::insertItems(QGraphicsScene *scene, const QJsonObject &document,
+                                             const QPointF &offset)
+{
+    TRACE_SCOPE("MapLoader::insertItems", "load");
+
+    QJsonArray items_array = document["items"].toArray();
+    ImageBlobStore blob_store;
+    blob_store.fromJson(document["image_blobs"].toObject());
+
+    // Styles of the document join the shared table
+    QVector<int> style_map = StyleTable::instance().intern(document["styles"].toArray());
+
+    // Hidden descendants of collapsed nodes stay records
+    QHash<QString, CollapsedSubtree> collapsed_subtrees;
+    QVector<bool> hidden;
+    collectCollapsedSubtrees(items_array, style_map, &collapsed_subtrees, &hidden);
+
+    // Create all items first; the saved ids only live on in the links
+    QList<QGraphicsItem*> items;
+    QHash<QString, EditableTextItem*> nodes;
+    items.reserve(items_array.size());
+    for (int i = 0; i < items_array.size(); ++i) {
+        if (!hidden.isEmpty() && hidden[i]) {
+            continue;
+        }
+        QJsonObject item_data = items_array[i].toObject();
+        item_data["x"] = item_data["x"].toDouble() + offset.x();
+        item_data["y"] = item_data["y"].toDouble() + offset.y();
+        QGraphicsItem *item = itemFromJson(item_data, &blob_store, style_map);
+        if (!item) {
+            continue;
+        }
+
+        EditableTextItem *text_item = dynamic_cast<EditableTextItem*>(item);
+        if (text_item && item_data.contains("id")) {
+            QString id = item_data["id"].toString();
+            nodes.insert(id, text_item);
+            if (collapsed_subtrees.contains(id)) {
+                text_item->setCollapsedSubtree(collapsed_subtrees.take(id));
+            }
+        }
+        items.append(item);
+    }
+
+    // Add them in one batch, then link the nodes
+    {
+        SceneIndexSuspender suspender(scene, items.size());
+        for (QGraphicsItem *item : items) {
+            scene->addItem(item);
+        }
+    }
+    linkNodes(items_array, nodes);
+
+    qDebug() << "Inserted" << items.size() << "items";
+    return items;
+}
@@ -0,0 +1,123 @@
+#ifndef MAPLOADER_H
+#define MAPLOADER_H
+
+#include "pch.h"
+#include "imageblobstore.h"
+#include "collapsedsubtree.h"
+
+class EditableTextItem;
+
+// Loads a map file into a scene without blocking the event loop.
+// FreeMind and OPML files are imported through MapImporter, .cbor files
+// hold the map document in binary form.
+//
+// The file is read and parsed on a worker thread. Items are then created
+// in chunks that each stay within a small time budget, starting with the
+// ones closest to the saved view center, so the window keeps painting and
+// the visible part of a large map appears first. Parent/child links are
+// restored once all nodes exist. Descendants of collapsed nodes are not
+// created at all; they are handed to their node as records.
+class MapLoader : public QObject
+{
+    Q_OBJECT
+public:
+    // Time spent creating items before yielding to the event loop
+    static constexpr int kChunkBudgetMs = 8;
+
+    enum class Error { FileNotFound, OpenFailed, InvalidJson, InvalidOutline };
+    Q_ENUM(Error)
+
+    explicit MapLoader(QGraphicsScene *scene, QObject *parent = nullptr);
+
+    // Start loading a map into the scene. The scene is left alone until the
+    // file is parsed (see parsed()), so a load that fails does not touch the
+    // open map. A load that is still running is cancelled.
+    void load(const QString &file_name);
+
+    // Stop the running load, keeping the items created so far
+    void cancel();
+
+    // Create all remaining items right away (e.g. before saving)
+    void finishNow();
+
+    // Load a map completely before returning, for use without an event
+    // loop (e.g. the command line tool); returns false if it failed
+    bool loadNow(const QString &file_name);
+
+    bool isLoading() const { return m_state != State::Idle; }
+
+    // Create the item for one saved item without adding it to a scene, or
+    // null if the item is invalid. Embedded images are looked up in
+    // blob_store if given, node styles through the style_map of the map's
+    // style table (see StyleTable::resolve).
+    static QGraphicsItem *itemFromJson(const QJsonObject &item_data, ImageBlobStore *blob_store,
+                                       const QVector<int> &style_map = QVector<int>());
+
+    // Add the items of a map document (e.g. from the clipboard) to a scene,
+    // moved by offset, with their links restored. The saved ids are only
+    // used for linking, so the same document can be inserted many times.
+    static QList<QGraphicsItem*> insertItems(QGraphicsScene *scene, const QJsonObject &document,
+                                             const QPointF &offset);
+
+signals:
+    // The file was parsed and its items are about to be created; the
+    // previous map is cleared from the scene here
+    void parsed();
+
+    // Saved view of the map, emitted before the first items are created
+    void viewStateLoaded(qreal scale_factor, const QPointF &center, bool has_center);
+
+    void progress(int loaded_items, int total_items);
+    void finished(int loaded_items);
+    void failed(MapLoader::Error error);
+
+private:
+    enum class State { Idle, Parsing, Creating };
+
+    // Parse the file on the calling thread
+    bool parseNow();
+
+    void onParsed(int generation, const QJsonObject &json_data, const QVector<int> &order,
+                  const QHash<QString, CollapsedSubtree> &collapsed_subtrees);
+    void processChunk();
+    void finishLoading();
+
+    // Create the scene item for one saved item
+    bool createItem(const QJsonObject &item_data);
+
+    // Restore the parent/child links between text nodes
+    void connectNodes();
+    // Link the text nodes of saved items by their saved ids
+    static void linkNodes(const QJsonArray &items_array, const QHash<QString, EditableTextItem*> &nodes);
+
+    // Parse a map file and order its items by distance to the saved view center,
+    // leaving out the descendants of collapsed nodes (runs on a worker thread)
+    static bool parseFile(const QString &file_name, QJsonObject *json_data, QVector<int> *order,
+                          QHash<QString, CollapsedSubtree> *collapsed_subtrees, Error *error);
+
+    // Gather the descendants of collapsed nodes as subtrees of the outermost
+    // collapsed node, by its id, and flag the items they came from. Their
+    // records get their style resolved through style_map.
+    static void collectCollapsedSubtrees(const QJsonArray &items_array, const QVector<int> &style_map,
+                                         QHash<QString, CollapsedSubtree> *collapsed_subtrees,
+                                         QVector<bool> *hidden);
+
+    QGraphicsScene *m_scene;
+    QString m_file_name;
+    State m_state;
+    int m_generation;         // Identifies the current load for queued callbacks
+
+    QJsonArray m_items;
+    QVector<int> m_order;     // Creation order of m_items
+    int m_next;               // Position in m_order
+    int m_loaded_items;
+    qint64 m_trace_start;     // Start of the whole load, for tracing
+    ImageBlobStore m_blob_store;
+    QVector<int> m_style_map; // Style indexes of the map's style table
+    // Text nodes by saved id. The map can be edited while it loads, so
+    // nodes deleted meanwhile (e.g. by Delete or Collapse) turn null.
+    QHash<QString, QPointer<EditableTextItem>> m_nodes;
+    QHash<QString, CollapsedSubtree> m_collapsed_subtrees; // Hidden descendants by node id
+};
+
+#endif // MAPLOADER_H
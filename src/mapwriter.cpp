@@ -0,0 +1,299 @@
+#include "pch.h"
+
+#include "mapwriter.h"
+#include "infinitecanvas.h"
+#include "collapsedsubtree.h"
+#include "imageblobstore.h"
+#include "styletable.h"
+#include "trace.h"
+
+namespace {
+// Style table of a document being written. Styles are numbered in order of
+// first use after the default style, which nodes refer to by leaving
+// "style" out.
+class DocumentStyles
+{
+public:
+    DocumentStyles() : m_indexes({0}) { m_positions.insert(0, 0); }
+
+    // Position of a style of the shared table in the document's table
+    int positionOf(int index)
+    {
+        auto it = m_positions.constFind(index);
+        if (it != m_positions.constEnd()) {
+            return it.value();
+        }
+        m_indexes.append(index);
+        m_positions.insert(index, m_indexes.size() - 1);
+        return m_indexes.size() - 1;
+    }
+
+    // Make a text node record refer to the document's table
+    void localize(QJsonObject *record)
+    {
+        int position = positionOf(record->value("style").toInt());
+        if (position) {
+            (*record)["style"] = position;
+        } else {
+            record->remove("style");
+        }
+    }
+
+    QJsonArray toJson() const { return StyleTable::instance().toJson(m_indexes); }
+
+private:
+    QVector<int> m_indexes;      // Shared table indexes by position
+    QHash<int, int> m_positions; // Positions by shared table index
+};
+}
+
+MapWriter::Format MapWriter::formatForFile(const QString &file_name)
+{
+    return QFileInfo(file_name).suffix().toLower() == "cbor" ? Format::Cbor : Format::Json;
+}
+
+QJsonObject MapWriter::toJson(const QGraphicsScene *scene, qreal scale_factor,
+                              const QPointF &center, bool embed_images)
+{
+    // Every logical item is a single top-level scene item
+    QList<QGraphicsItem*> all_items = scene->items();
+    QJsonObject json_data = itemsToJson(all_items, QPointF(), embed_images);
+
+    // Styles of new nodes, as positions in the map's style table
+    QVector<int> depth_styles = StyleTable::instance().depthStyles();
+    if (!depth_styles.isEmpty()) {
+        QJsonArray styles = json_data["styles"].toArray();
+        QJsonArray depth_positions;
+        for (int index : depth_styles) {
+            QJsonObject style = StyleTable::instance().style(index).toJson();
+            int position = 0;
+            while (position < styles.size() && styles[position].toObject() != style) {
+                ++position;
+            }
+            if (position == styles.size()) {
+                styles.append(style);
+            }
+            depth_positions.append(position);
+        }
+        json_data["styles"] = styles;
+        json_data["depth_styles"] = depth_positions;
+    }
+
+    // Save canvas view state
+    QJsonObject view_state;
+    view_state["scale_factor"] = scale_factor;
+    view_state["center_x"] = center.x();
+    view_state["center_y"] = center.y();
+    json_data["view_state"] = view_state;
+
+    qDebug() << "Saved" << json_data["items"].toArray().size() << "items out of"
+             << all_items.size() << "scene items";
+
+    return json_data;
+}
+
+QJsonObject MapWriter::itemsToJson(const QList<QGraphicsItem*> &items, const QPointF &origin,
+                                   bool embed_images)
+{
+    // Create a JSON object to store all data
+    QJsonObject json_data;
+    QJsonArray items_array;
+    QSet<QGraphicsItem*> processed_items;
+
+    // Embedded images and node styles are written once
+    ImageBlobStore blob_store;
+    DocumentStyles styles;
+
+    // Iterate through all items
+    for (QGraphicsItem *item : items) {
+        // Skip if already processed
+        if (processed_items.contains(item)) {
+            continue;
+        }
+
+        QJsonObject item_data = itemToJson(item, embed_images, &blob_store);
+        if (item_data.isEmpty()) {
+            continue;
+        }
+        if (!origin.isNull()) {
+            item_data["x"] = item->x() - origin.x();
+            item_data["y"] = item->y() - origin.y();
+        }
+        const EditableTextItem *editable_text = dynamic_cast<const EditableTextItem*>(item);
+        if (editable_text) {
+            styles.localize(&item_data);
+        }
+        items_array.append(item_data);
+        processed_items.insert(item);
+
+        // Hidden descendants are saved as ordinary nodes, with ids scoped
+        // to their collapsed node
+        if (editable_text && editable_text->collapsedSubtree()) {
+            QString id_prefix = item_data["id"].toString() + "/";
+            for (const QJsonValue &hidden_item :
+                 editable_text->collapsedSubtree()->toMapItems(id_prefix, item->pos() - origin)) {
+                QJsonObject record = hidden_item.toObject();
+                styles.localize(&record);
+                items_array.append(record);
+            }
+        }
+    }
+
+    json_data["items"] = items_array;
+    json_data["styles"] = styles.toJson();
+    if (!blob_store.isEmpty()) {
+        json_data["image_blobs"] = blob_store.toJson();
+    }
+
+    return json_data;
+}
+
+QJsonObject MapWriter::itemToJson(QGraphicsItem *item, bool embed_images, ImageBlobStore *blob_store)
+{
+    QJsonObject item_data;
+
+    // Save position for all items
+    item_data["x"] = item->pos().x();
+    item_data["y"] = item->pos().y();
+
+    // Handle text items
+    if (QGraphicsTextItem *text_item =
+            dynamic_cast<QGraphicsTextItem *>(item)) {
+        // Check if it's our custom EditableTextItem
+        EditableTextItem *editable_text = dynamic_cast<EditableTextItem *>(text_item);
+        if (editable_text) {
+            QJsonObject record = editable_text->toRecord();
+            for (auto it = record.constBegin(); it != record.constEnd(); ++it) {
+                item_data.insert(it.key(), it.value());
+            }
+
+            // Save item ID (its pointer as a string) for connections
+            QString item_id = QString::number((quintptr)editable_text);
+            item_data["id"] = item_id;
+
+            // Save child node references
+            QJsonArray child_nodes;
+            for (EditableTextItem *child : editable_text->childNodes()) {
+                QString child_id = QString::number((quintptr)child);
+                child_nodes.append(child_id);
+            }
+
+            // The hidden children of collapsed nodes follow the node
+            if (const CollapsedSubtree *hidden = editable_text->collapsedSubtree()) {
+                item_data["collapsed"] = true;
+                for (const QJsonValue &child_id : hidden->childIds(item_id + "/")) {
+                    child_nodes.append(child_id);
+                }
+            }
+
+            if (!child_nodes.isEmpty()) {
+                item_data["child_nodes"] = child_nodes;
+            }
+
+        } else {
+            // Standard text item
+            item_data["type"] = "text";
+            item_data["content"] = text_item->toPlainText();
+            item_data["font_family"] = text_item->font().family();
+            item_data["font_size"] = text_item->font().pointSize();
+            item_data["color"] = text_item->defaultTextColor().name();
+
+        }
+    }
+    // Handle custom item types
+    else if (MediaItem *media_item = dynamic_cast<MediaItem*>(item)) {
+        item_data["type"] = "media";
+        item_data["media_path"] = media_item->getMediaPath();
+    }
+    else if (DirectoryItem *dir_item = dynamic_cast<DirectoryItem*>(item)) {
+        item_data["type"] = "directory";
+        item_data["dir_path"] = dir_item->getDirPath();
+    }
+    else if (UrlItem *url_item = dynamic_cast<UrlItem*>(item)) {
+        item_data["type"] = "url";
+        item_data["url"] = url_item->getUrl().toString();
+    }
+    // Handle shortcut items - not a group but has custom data
+    else if (ShortcutItem *shortcut_item = dynamic_cast<ShortcutItem*>(item)) {
+        item_data["type"] = "shortcut";
+        item_data["target_path"] = shortcut_item->getTargetPath();
+    }
+    // Alternative detection based on data() for non-dynamic items
+    else if (item->data(1).toString() == "shortcut") {
+        item_data["type"] = "shortcut";
+        item_data["target_path"] = item->data(0).toString();
+    }
+    else if (item->data(1).toString() == "url") {
+        item_data["type"] = "url";
+        item_data["url"] = item->data(0).toString();
+    }
+    else if (item->data(1).toString() == "directory") {
+        item_data["type"] = "directory";
+        item_data["dir_path"] = item->data(0).toString();
+    }
+    else if (item->data(1).toString() == "media") {
+        item_data["type"] = "media";
+        item_data["media_path"] = item->data(0).toString();
+    }
+    // Handle image items
+    else if (ImageItem *image_item = dynamic_cast<ImageItem *>(item)) {
+        item_data["type"] = "image";
+        QString file_path = image_item->filePath();
+
+        // Images without a file (or already embedded) are always embedded
+        if (blob_store && (embed_images || file_path.isEmpty() ||
+                           image_item->source().isEmbedded())) {
+            QString blob_key = blob_store->add(image_item);
+            if (!blob_key.isEmpty()) {
+                item_data["blob"] = blob_key;
+            }
+        }
+
+        if (file_path.isEmpty() && !item_data.contains("blob")) {
+            qWarning() << "Skipping image without file path or data at" << item->pos();
+            return QJsonObject();
+        }
+        if (!file_path.isEmpty()) {
+            item_data["file_path"] = file_path;
+        }
+
+        // Store the size so the image can be laid out before it is decoded
+        if (image_item->imageSize().isValid()) {
+            item_data["width"] = image_item->imageSize().width();
+            item_data["height"] = image_item->imageSize().height();
+        }
+    }
+    // Skip other item types (e.g. connection lines)
+    else {
+        qDebug() << "Skipping unknown item type at" << item->pos();
+        return QJsonObject();
+    }
+
+    return item_data;
+}
+
+bool MapWriter::write(const QGraphicsScene *scene, const QString &file_name, qreal scale_factor,
+                      const QPointF &center, bool embed_images, QString *error_string)
+{
+    TRACE_SCOPE("MapWriter::write", "save");
+
+    QJsonObject json_data = toJson(scene, scale_factor, center, embed_images);
+
+    // Write the map data to file
+    QFile save_file(file_name);
+    if (!save_file.open(QIODevice::WriteOnly)) {
+        qCritical() << "Failed to open file for writing:" << file_name << "Error:" << save_file.errorString();
+        *error_string = save_file.errorString();
+        return false;
+    }
+
+    if (formatForFile(file_name) == Format::Cbor) {
+        save_file.write(QCborValue::fromJsonValue(json_data).toCbor());
+    } else {
+        save_file.write(QJsonDocument(json_data).toJson());
+    }
+    save_file.close();
+
+    qDebug() << "Successfully saved file:" << file_name << "Items saved:" << json_data["items"].toArray().size();
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef MAPWRITER_H
+#define MAPWRITER_H
+
+#include "pch.h"
+
+class ImageBlobStore;
+
+// Serializes a scene in the native map format.
+//
+// Shared by the main window and the command line tool. Maps are written as
+// JSON, or as the same document in CBOR when the file name ends in .cbor,
+// which is smaller and faster to parse; MapLoader reads both.
+class MapWriter
+{
+public:
+    enum class Format { Json, Cbor };
+
+    // Format of a map file, judged by its suffix
+    static Format formatForFile(const QString &file_name);
+
+    // Build the map document; the view state is stored for reopening.
+    // Images are embedded if embed_images is set or they have no file.
+    static QJsonObject toJson(const QGraphicsScene *scene, qreal scale_factor,
+                              const QPointF &center, bool embed_images);
+
+    // The items and the hidden descendants of their collapsed nodes as a
+    // map document without view state, with positions relative to origin.
+    // The document carries the table of the node styles it uses.
+    static QJsonObject itemsToJson(const QList<QGraphicsItem*> &items, const QPointF &origin,
+                                   bool embed_images);
+
+    // One scene item in the map format, or an empty object for items that
+    // are not saved. Images are embedded into blob_store (if given) under
+    // the same rule as toJson(); hidden descendants of collapsed nodes are
+    // referenced but not included. Node styles are left as indexes of the
+    // shared StyleTable.
+    static QJsonObject itemToJson(QGraphicsItem *item, bool embed_images, ImageBlobStore *blob_store);
+
+    // Write the scene to a map file; returns false and sets error_string on failure
+    static bool write(const QGraphicsScene *scene, const QString &file_name, qreal scale_factor,
+                      const QPointF &center, bool embed_images, QString *error_string);
+};
+
+#endif // MAPWRITER_H
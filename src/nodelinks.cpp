@@ -0,0 +1,162 @@
+#include "pch.h"
+
+#include "nodelinks.h"
+
+namespace {
+// Spans of up to 1024 links (kClassCount size classes) come from chunks of
+// this size; bigger ones are allocated alone
+constexpr int kChunkBytes = 64 * 1024;
+constexpr int kClassCount = 11;
+
+using Link = NodeLinks::Link;
+
+// Size class of a capacity, which must be a power of two
+int sizeClass(int capacity)
+{
+    int size_class = 0;
+    while ((1 << size_class) < capacity) {
+        ++size_class;
+    }
+    return size_class;
+}
+
+class LinkArena
+{
+public:
+    static LinkArena &instance()
+    {
+        // Never destroyed, so nodes deleted at exit still find it
+        static LinkArena *arena = new LinkArena;
+        return *arena;
+    }
+
+    Link *allocate(int capacity)
+    {
+        QMutexLocker locker(&m_mutex);
+        ++m_stats.live_spans;
+        m_stats.used_bytes += capacity * qint64(sizeof(Link));
+
+        int size_class = sizeClass(capacity);
+        if (size_class >= kClassCount) {
+            ++m_stats.allocations;
+            m_stats.reserved_bytes += capacity * qint64(sizeof(Link));
+            return new Link[capacity];
+        }
+
+        // Reuse a freed span of the class; its first link holds the next one
+        if (Link *span = m_free[size_class]) {
+            m_free[size_class] = reinterpret_cast<Link*>(span->child);
+            return span;
+        }
+
+        if (m_chunk_used + capacity > kChunkLinks) {
+            m_chunks.push_back(std::unique_ptr<Link[]>(new Link[kChunkLinks]));
+            m_chunk_used = 0;
+            ++m_stats.allocations;
+            m_stats.reserved_bytes += kChunkBytes;
+        }
+        Link *span = m_chunks.back().get() + m_chunk_used;
+        m_chunk_used += capacity;
+        return span;
+    }
+
+    void release(Link *span, int capacity)
+    {
+        QMutexLocker locker(&m_mutex);
+        --m_stats.live_spans;
+        m_stats.used_bytes -= capacity * qint64(sizeof(Link));
+
+        int size_class = sizeClass(capacity);
+        if (size_class >= kClassCount) {
+            m_stats.reserved_bytes -= capacity * qint64(sizeof(Link));
+            delete[] span;
+        } else {
+            span->child = reinterpret_cast<EditableTextItem*>(m_free[size_class]);
+            m_free[size_class] = span;
+        }
+
+        // Nothing refers to the chunks anymore
+        if (m_stats.live_spans == 0) {
+            m_chunks.clear();
+            m_chunk_used = kChunkLinks;
+            std::fill(std::begin(m_free), std::end(m_free), nullptr);
+            m_stats = NodeLinks::Stats();
+        }
+    }
+
+    NodeLinks::Stats stats() const
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_stats;
+    }
+
+private:
+    static constexpr int kChunkLinks = kChunkBytes / int(sizeof(Link));
+
+    LinkArena() : m_chunk_used(kChunkLinks) { std::fill(std::begin(m_free), std::end(m_free), nullptr); }
+
+    mutable QMutex m_mutex;
+    std::vector<std::unique_ptr<Link[]>> m_chunks;
+    int m_chunk_used; // Links handed out of the last chunk
+    Link *m_free[kClassCount];
+    NodeLinks::Stats m_stats;
+};
+}
+
+int NodeLinks::Children::indexOf(const EditableTextItem *child) const
+{
+    for (int i = 0; i < m_size; ++i) {
+        if (m_begin[i].child == child) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void NodeLinks::insert(int index, EditableTextItem *child, ConnectionLine *line)
+{
+    // Grow into the next size class
+    if (m_size == m_capacity) {
+        int capacity = m_capacity ? m_capacity * 2 : 1;
+        Link *links = LinkArena::instance().allocate(capacity);
+        std::copy(m_links, m_links + m_size, links);
+        if (m_links) {
+            LinkArena::instance().release(m_links, m_capacity);
+        }
+        m_links = links;
+        m_capacity = capacity;
+    }
+
+    std::copy_backward(m_links + index, m_links + m_size, m_links + m_size + 1);
+    m_links[index] = Link{child, line};
+    ++m_size;
+}
+
+void NodeLinks::removeAt(int index)
+{
+    std::copy(m_links + index + 1, m_links + m_size, m_links + index);
+    truncate(m_size - 1);
+}
+
+void NodeLinks::truncate(int size)
+{
+    m_size = size;
+    if (m_size == 0) {
+        clear();
+    }
+}
+
+void NodeLinks::clear()
+{
+    if (m_links) {
+        LinkArena::instance().release(m_links, m_capacity);
+    }
+    m_links = nullptr;
+    m_size = 0;
+    m_capacity = 0;
+}
+
+NodeLinks::Stats NodeLinks::stats()
+{
+    return LinkArena::instance().stats();
+}
@@ -0,0 +1,124 @@
+#ifndef NODELINKS_H
+#define NODELINKS_H
+
+#include "pch.h"
+
+class EditableTextItem;
+class ConnectionLine;
+
+// Children of a node with the lines to them, in one contiguous span.
+//
+// A node used to keep a list of children and a list of lines, two heap
+// blocks that grew separately, and handed out copies of the child list.
+// Here each child sits next to its line (null while the node was not in a
+// scene when the child was linked) and the spans come from a shared arena
+// of power-of-two size classes carved out of large chunks, so a whole map
+// needs a few hundred allocations instead of several per node. Freed spans
+// are reused by their size class; the chunks are given back once no span
+// is in use, e.g. after a map is closed.
+class NodeLinks
+{
+public:
+    struct Link {
+        EditableTextItem *child;
+        ConnectionLine *line;
+    };
+
+    // Iterates the children of a span without copying them
+    class ChildIterator
+    {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = EditableTextItem*;
+        using difference_type = std::ptrdiff_t;
+        using pointer = EditableTextItem* const*;
+        using reference = EditableTextItem* const&;
+
+        explicit ChildIterator(const Link *link = nullptr) : m_link(link) {}
+
+        reference operator*() const { return m_link->child; }
+        reference operator[](difference_type n) const { return m_link[n].child; }
+        ChildIterator &operator++() { ++m_link; return *this; }
+        ChildIterator operator++(int) { ChildIterator it = *this; ++m_link; return it; }
+        ChildIterator &operator--() { --m_link; return *this; }
+        ChildIterator operator--(int) { ChildIterator it = *this; --m_link; return it; }
+        ChildIterator &operator+=(difference_type n) { m_link += n; return *this; }
+        ChildIterator &operator-=(difference_type n) { m_link -= n; return *this; }
+        ChildIterator operator+(difference_type n) const { return ChildIterator(m_link + n); }
+        ChildIterator operator-(difference_type n) const { return ChildIterator(m_link - n); }
+        difference_type operator-(const ChildIterator &other) const { return m_link - other.m_link; }
+        bool operator==(const ChildIterator &other) const { return m_link == other.m_link; }
+        bool operator!=(const ChildIterator &other) const { return m_link != other.m_link; }
+        bool operator<(const ChildIterator &other) const { return m_link < other.m_link; }
+
+    private:
+        const Link *m_link;
+    };
+
+    // View of the children. It stays valid until the node's children
+    // change; take toList() to keep them across changes.
+    class Children
+    {
+    public:
+        Children(const Link *begin, int size) : m_begin(begin), m_size(size) {}
+
+        ChildIterator begin() const { return ChildIterator(m_begin); }
+        ChildIterator end() const { return ChildIterator(m_begin + m_size); }
+        int size() const { return m_size; }
+        bool isEmpty() const { return m_size == 0; }
+        EditableTextItem *operator[](int i) const { return m_begin[i].child; }
+        EditableTextItem *first() const { return m_begin[0].child; }
+        EditableTextItem *last() const { return m_begin[m_size - 1].child; }
+        int indexOf(const EditableTextItem *child) const;
+        bool contains(const EditableTextItem *child) const { return indexOf(child) >= 0; }
+        QList<EditableTextItem*> toList() const { return QList<EditableTextItem*>(begin(), end()); }
+        QVector<EditableTextItem*> toVector() const { return QVector<EditableTextItem*>(begin(), end()); }
+
+    private:
+        const Link *m_begin;
+        int m_size;
+    };
+
+    // Totals of the shared arena
+    struct Stats {
+        qint64 reserved_bytes = 0;  // Chunks and oversized spans
+        qint64 used_bytes = 0;      // Spans handed out
+        qint64 allocations = 0;     // Heap allocations made since the arena was last empty
+        qint64 live_spans = 0;
+    };
+
+    NodeLinks() : m_links(nullptr), m_size(0), m_capacity(0) {}
+    ~NodeLinks() { clear(); }
+
+    NodeLinks(const NodeLinks &) = delete;
+    NodeLinks &operator=(const NodeLinks &) = delete;
+
+    int size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+    const Link &at(int i) const { return m_links[i]; }
+
+    Children children() const { return Children(m_links, m_size); }
+    int indexOf(const EditableTextItem *child) const { return children().indexOf(child); }
+
+    // Links in place, e.g. for filtering followed by truncate()
+    Link *begin() { return m_links; }
+    Link *end() { return m_links + m_size; }
+    const Link *begin() const { return m_links; }
+    const Link *end() const { return m_links + m_size; }
+
+    void insert(int index, EditableTextItem *child, ConnectionLine *line);
+    void removeAt(int index);
+    void truncate(int size);
+
+    // Drop all links and give the span back
+    void clear();
+
+    static Stats stats();
+
+private:
+    Link *m_links;
+    int m_size;
+    int m_capacity;
+};
+
+#endif // NODELINKS_H
@@ -0,0 +1,155 @@
+#include "pch.h"
+
+#include "outlineexporter.h"
+#include "infinitecanvas.h"
+#include "collapsedsubtree.h"
+#include "trace.h"
+
+bool OutlineExporter::formatForFile(const QString &file_name, Format *format)
+{
+    QString suffix = QFileInfo(file_name).suffix().toLower();
+    if (suffix == "opml") {
+        *format = Format::Opml;
+    } else if (suffix == "md" || suffix == "markdown") {
+        *format = Format::Markdown;
+    } else if (suffix == "txt") {
+        *format = Format::PlainText;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+QList<EditableTextItem*> OutlineExporter::rootNodes(const QGraphicsScene *scene)
+{
+    QList<EditableTextItem*> roots;
+    for (QGraphicsItem *item : scene->items()) {
+        EditableTextItem *node = dynamic_cast<EditableTextItem*>(item);
+        if (node && !node->parentNode()) {
+            roots.append(node);
+        }
+    }
+
+    // Read the map top to bottom, like the outline it came from
+    std::sort(roots.begin(), roots.end(), [](EditableTextItem *a, EditableTextItem *b) {
+        if (a->y() != b->y()) {
+            return a->y() < b->y();
+        }
+        return a->x() < b->x();
+    });
+    return roots;
+}
+
+bool OutlineExporter::write(const QList<EditableTextItem*> &roots, Format format,
+                            QIODevice *device, const QString &title)
+{
+    TRACE_SCOPE("OutlineExporter::write", "export");
+
+    if (format == Format::Opml) {
+        return writeOpml(roots, device, title);
+    }
+    return writeText(roots, format, device);
+}
+
+void OutlineExporter::walk(const QList<EditableTextItem*> &roots,
+                           const std::function<void(const QString &, int)> &visit)
+{
+    // Nodes still to be visited with their depth, next one last
+    QVector<QPair<EditableTextItem*, int>> pending;
+
+    for (int i = roots.size() - 1; i >= 0; --i) {
+        pending.append(qMakePair(roots.at(i), 0));
+    }
+
+    while (!pending.isEmpty()) {
+        QPair<EditableTextItem*, int> entry = pending.takeLast();
+        EditableTextItem *node = entry.first;
+        int depth = entry.second;
+        visit(node->toPlainText(), depth);
+
+        // Collapsed nodes only have records below them
+        if (const CollapsedSubtree *hidden = node->collapsedSubtree()) {
+            hidden->forEachRecord([&visit, depth](const QJsonObject &record, int record_depth) {
+                visit(record["content"].toString(), depth + record_depth);
+            });
+        }
+
+        // Push the children in reverse so the first one is visited next
+        const NodeLinks::Children children = node->childNodes();
+        for (int i = children.size() - 1; i >= 0; --i) {
+            pending.append(qMakePair(children[i], depth + 1));
+        }
+    }
+}
+
+bool OutlineExporter::writeOpml(const QList<EditableTextItem*> &roots, QIODevice *device,
+                                const QString &title)
+{
+    QXmlStreamWriter xml(device);
+    xml.setAutoFormatting(true);
+    xml.setAutoFormattingIndent(2);
+
+    xml.writeStartDocument();
+    xml.writeStartElement("opml");
+    xml.writeAttribute("version", "2.0");
+    xml.writeStartElement("head");
+    xml.writeTextElement("title", title);
+    xml.writeEndElement(); // head
+    xml.writeStartElement("body");
+
+    // Close the outlines of earlier nodes that are not ancestors of the next one
+    int open_outlines = 0;
+    walk(roots, [&xml, &open_outlines](const QString &text, int depth) {
+        for (; open_outlines > depth; --open_outlines) {
+            xml.writeEndElement(); // outline
+        }
+        xml.writeStartElement("outline");
+        xml.writeAttribute("text", text);
+        ++open_outlines;
+    });
+    for (; open_outlines > 0; --open_outlines) {
+        xml.writeEndElement(); // outline
+    }
+
+    xml.writeEndElement(); // body
+    xml.writeEndElement(); // opml
+    xml.writeEndDocument();
+
+    return !xml.hasError();
+}
+
+bool OutlineExporter::writeText(const QList<EditableTextItem*> &roots, Format format,
+                                QIODevice *device)
+{
+    QTextStream stream(device);
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+    stream.setCodec("UTF-8");
+#endif
+
+    bool first_root = true;
+    walk(roots, [&stream, &first_root, format](const QString &node_text, int depth) {
+        // Outlines are line based, keep each node on one line
+        QString text = node_text.simplified();
+
+        if (format == Format::Markdown) {
+            if (depth == 0) {
+                // Roots become headings with their trees as lists below
+                if (!first_root) {
+                    stream << '\n';
+                }
+                first_root = false;
+                stream << "# " << text << "\n\n";
+            } else {
+                stream << QString((depth - 1) * 2, QLatin1Char(' ')) << "- " << text << '\n';
+            }
+        } else {
+            stream << QString(depth, QLatin1Char('\t')) << text << '\n';
+        }
+    });
+    if (format == Format::Markdown && !first_root) {
+        stream << '\n';
+    }
+
+    stream.flush();
+    return stream.status() == QTextStream::Ok;
+}
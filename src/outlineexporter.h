@@ -0,0 +1,44 @@
+#ifndef OUTLINEEXPORTER_H
+#define OUTLINEEXPORTER_H
+
+#include "pch.h"
+
+class EditableTextItem;
+
+// Writes the node trees of a map as OPML, a Markdown outline or indented
+// plain text.
+//
+// The trees are walked depth-first with an explicit stack and every node is
+// written straight to the device as it is visited (QXmlStreamWriter for
+// OPML, QTextStream otherwise), so no document is built in memory and the
+// cost is linear in the number of nodes. Only text nodes are exported,
+// including the hidden descendants of collapsed nodes.
+// Markdown output puts roots in headings and nests list items under them,
+// which the outline paste reads back into the same tree.
+class OutlineExporter
+{
+public:
+    enum class Format { Opml, Markdown, PlainText };
+
+    // Format for a file name by suffix (.opml, .md/.markdown, .txt); false if unknown
+    static bool formatForFile(const QString &file_name, Format *format);
+
+    // Text nodes without a parent node, top to bottom
+    static QList<EditableTextItem*> rootNodes(const QGraphicsScene *scene);
+
+    // Write the trees below the roots; title is used for the OPML head
+    static bool write(const QList<EditableTextItem*> &roots, Format format,
+                      QIODevice *device, const QString &title = QString());
+
+private:
+    // Visit the nodes below the roots depth-first in child order (roots have depth 0)
+    static void walk(const QList<EditableTextItem*> &roots,
+                     const std::function<void(const QString &text, int depth)> &visit);
+
+    static bool writeOpml(const QList<EditableTextItem*> &roots, QIODevice *device,
+                          const QString &title);
+    static bool writeText(const QList<EditableTextItem*> &roots, Format format,
+                          QIODevice *device);
+};
+
+#endif // OUTLINEEXPORTER_H
@@ -0,0 +1,82 @@
+#include "pch.h"
+
+#include "outlineparser.h"
+
+namespace {
+// Columns a tab advances the indentation by
+constexpr int kTabWidth = 4;
+
+// Headings nest above any indented line: "#" gets the smallest key
+constexpr int kHeadingKeyBase = -7;
+}
+
+QVector<OutlineEntry> OutlineParser::parse(const QString &text, bool *structured)
+{
+    // "# Heading", "- item", "* item", "+ item", "1. item", "1) item", "- [x] task"
+    static const QRegularExpression heading_pattern("^(#{1,6})\\s+(.*?)(\\s+#+)?\\s*$");
+    static const QRegularExpression bullet_pattern("^(?:[-*+]|\\d+[.)])\\s+(?:\\[[ xX]\\]\\s+)?(.*)$");
+    static const QRegularExpression rule_pattern("^([-*_])(\\s*\\1){2,}\\s*$");
+
+    QVector<OutlineEntry> entries;
+    QVector<int> open_keys; // Indentation keys of the open ancestors
+    bool has_structure = false;
+
+    const QStringList lines = text.split(QLatin1Char('\n'));
+    entries.reserve(lines.size());
+
+    for (const QString &raw_line : lines) {
+        // Measure the indentation
+        int indent = 0;
+        int start = 0;
+        while (start < raw_line.size()) {
+            QChar c = raw_line.at(start);
+            if (c == QLatin1Char('\t')) {
+                indent += kTabWidth - indent % kTabWidth;
+            } else if (c == QLatin1Char(' ')) {
+                ++indent;
+            } else {
+                break;
+            }
+            ++start;
+        }
+
+        QString line = raw_line.mid(start).trimmed();
+        if (line.isEmpty() || rule_pattern.match(line).hasMatch()) {
+            continue;
+        }
+
+        // Headings rank by level, list items and plain lines by indentation
+        int key = indent;
+        QRegularExpressionMatch match = heading_pattern.match(line);
+        if (match.hasMatch()) {
+            key = kHeadingKeyBase + match.capturedLength(1);
+            line = match.captured(2);
+            has_structure = true;
+        } else {
+            match = bullet_pattern.match(line);
+            if (match.hasMatch()) {
+                line = match.captured(1);
+                has_structure = true;
+            }
+            if (indent > 0) {
+                has_structure = true;
+            }
+        }
+        if (line.isEmpty()) {
+            continue;
+        }
+
+        // Close ancestors that are not shallower than this line
+        while (!open_keys.isEmpty() && open_keys.last() >= key) {
+            open_keys.removeLast();
+        }
+
+        entries.append({open_keys.size(), line});
+        open_keys.append(key);
+    }
+
+    if (structured) {
+        *structured = has_structure;
+    }
+    return entries;
+}
@@ -0,0 +1,29 @@
+#ifndef OUTLINEPARSER_H
+#define OUTLINEPARSER_H
+
+#include "pch.h"
+
+// One line of an outline
+struct OutlineEntry
+{
+    int depth;    // Nesting depth, 0 for top level entries
+    QString text;
+};
+
+// Turns pasted outlines into a flat list of entries in document order.
+//
+// Understands indented plain text (tabs or any consistent number of
+// spaces), Markdown bullet and numbered lists and Markdown headings.
+// Headings nest by their level and everything below a heading nests under
+// it. Depths are normalized so every entry is at most one level deeper than
+// the entry before it, which lets callers build the tree with a simple
+// stack of open ancestors.
+class OutlineParser
+{
+public:
+    // Parse text in a single pass. Sets structured if any line was indented,
+    // a list item or a heading, i.e. the text really is an outline.
+    static QVector<OutlineEntry> parse(const QString &text, bool *structured = nullptr);
+};
+
+#endif // OUTLINEPARSER_H
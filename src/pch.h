@@ -9,6 +9,9 @@
 #include <set>
 #include <algorithm>
 #include <functional>
+#include <list>
+#include <atomic>
+#include <numeric>
 
 // Qt Core
 #include <QObject>
@@ -23,16 +26,35 @@
 #include <QFileInfo>
 #include <QDateTime>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QMutex>
+#include <QThread>
+#include <QThreadPool>
+#include <QSharedPointer>
+#include <QAtomicInt>
 #include <QSettings>
 #include <QStandardPaths>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QCborValue>
+#include <QCborMap>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+#include <QCryptographicHash>
 #include <QTextStream>
 #include <QtMath>
+#include <QRandomGenerator>
 #include <QProcess>
 #include <QCoreApplication>
+#include <QCommandLineParser>
 #include <QSharedMemory>
+#include <QSaveFile>
+#include <QTemporaryDir>
+#include <QDataStream>
+#include <QBuffer>
+#include <QSysInfo>
 
 // Qt Internationalization
 #include <QTranslator>
@@ -52,6 +74,7 @@
 #include <QPainter>
 #include <QColor>
 #include <QFont>
+#include <QFontMetricsF>
 #include <QFileIconProvider>
 #include <QFileDialog>
 #include <QMessageBox>
@@ -59,6 +82,11 @@
 #include <QKeySequence>
 #include <QScrollBar>
 #include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QLineEdit>
+#include <QLabel>
+#include <QToolButton>
+#include <QListWidget>
 #include <QClipboard>
 #include <QImageReader>
 #include <QCloseEvent>
@@ -67,6 +95,7 @@
 #include <QContextMenuEvent>
 #include <QTextCursor>
 #include <QTextDocument>
+#include <QUndoStack>
 
 // Qt Graphics
 #include <QGraphicsScene>
@@ -79,9 +108,15 @@
 #include <QGraphicsItemGroup>
 #include <QGraphicsSceneMouseEvent>
 #include <QGraphicsSimpleTextItem>
+#include <QStyleOptionGraphicsItem>
 
 // Qt Network
 #include <QUrl>
+#include <QNetworkAccessManager>
+#include <QNetworkRequest>
+#include <QNetworkReply>
+#include <QLocalServer>
+#include <QLocalSocket>
 #include <QDesktopServices>
 
 // Qt Drag & Drop
@@ -93,6 +128,9 @@
 // Qt Print Support
 #include <QPrinter>
 
+// Qt SVG
+#include <QSvgGenerator>
+
 // Qt Regular Expressions
 #include <QRegularExpression>
 
@@ -103,6 +141,7 @@
 #include <shlwapi.h>
 #include <objbase.h>
 #include <shobjidl.h>
+#include <commoncontrols.h>
 #include <objidl.h>
 #endif
 
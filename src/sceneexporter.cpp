@@ -0,0 +1,122 @@
+#include "pch.h"
+
+#include "sceneexporter.h"
+#include "trace.h"
+
+bool SceneExporter::formatForFile(const QString &file_name, Format *format)
+{
+    QString suffix = QFileInfo(file_name).suffix().toLower();
+    if (suffix == "png") {
+        *format = Format::Png;
+    } else if (suffix == "pdf") {
+        *format = Format::Pdf;
+    } else if (suffix == "svg") {
+        *format = Format::Svg;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+QRectF SceneExporter::exportRect(const QGraphicsScene *scene)
+{
+    // Get the scene rectangle
+    QRectF export_rect = scene->itemsBoundingRect();
+
+    // If the scene is empty or very small, use a reasonable default size
+    if (export_rect.isEmpty() || (export_rect.width() < 10 && export_rect.height() < 10)) {
+        export_rect = QRectF(0, 0, 800, 600);
+    } else {
+        // Add some margin
+        export_rect.adjust(-10, -10, 10, 10);
+    }
+    return export_rect;
+}
+
+bool SceneExporter::exportToFile(QGraphicsScene *scene, const QString &file_name, Format format)
+{
+    TRACE_SCOPE("SceneExporter::exportToFile", "export");
+
+    switch (format) {
+    case Format::Png:
+        return exportToPng(scene, file_name);
+    case Format::Pdf:
+        return exportToPdf(scene, file_name);
+    case Format::Svg:
+        return exportToSvg(scene, file_name);
+    }
+    return false;
+}
+
+void SceneExporter::setRenderHints(QPainter *painter)
+{
+    painter->setRenderHint(QPainter::Antialiasing);
+    painter->setRenderHint(QPainter::TextAntialiasing);
+    painter->setRenderHint(QPainter::SmoothPixmapTransform);
+}
+
+bool SceneExporter::exportToPng(QGraphicsScene *scene, const QString &file_name)
+{
+    QRectF export_rect = exportRect(scene);
+
+    // QImage instead of QPixmap, so no windowing system is involved
+    QImage image(export_rect.size().toSize(), QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::white);  // White background
+
+    QPainter painter(&image);
+    setRenderHints(&painter);
+    scene->render(&painter, QRectF(), export_rect);
+    painter.end();
+
+    return image.save(file_name, "PNG");
+}
+
+bool SceneExporter::exportToPdf(QGraphicsScene *scene, const QString &file_name)
+{
+    QRectF export_rect = exportRect(scene);
+
+    // Setup printer
+    QPrinter printer(QPrinter::HighResolution);
+    printer.setOutputFormat(QPrinter::PdfFormat);
+    printer.setOutputFileName(file_name);
+
+    // Set paper size to match the scene (convert from pixels to millimeters)
+    const qreal millimetersPerInch = 25.4;
+    const int dotsPerInch = 96; // Standard screen DPI
+
+    qreal width_mm = (export_rect.width() / dotsPerInch) * millimetersPerInch;
+    qreal height_mm = (export_rect.height() / dotsPerInch) * millimetersPerInch;
+
+    printer.setPageSize(QPageSize(QSizeF(width_mm, height_mm), QPageSize::Millimeter));
+    printer.setPageMargins(QMarginsF(0, 0, 0, 0));
+
+    QPainter painter;
+    if (!painter.begin(&printer)) {
+        qWarning() << "Failed to open PDF for writing:" << file_name;
+        return false;
+    }
+    setRenderHints(&painter);
+    scene->render(&painter, QRectF(), export_rect);
+    return painter.end();
+}
+
+bool SceneExporter::exportToSvg(QGraphicsScene *scene, const QString &file_name)
+{
+    QRectF export_rect = exportRect(scene);
+    QRectF target_rect(QPointF(0, 0), export_rect.size());
+
+    QSvgGenerator generator;
+    generator.setFileName(file_name);
+    generator.setSize(export_rect.size().toSize());
+    generator.setViewBox(target_rect);
+    generator.setTitle(QFileInfo(file_name).completeBaseName());
+
+    QPainter painter;
+    if (!painter.begin(&generator)) {
+        qWarning() << "Failed to open SVG for writing:" << file_name;
+        return false;
+    }
+    setRenderHints(&painter);
+    scene->render(&painter, target_rect, export_rect);
+    return painter.end();
+}
@@ -0,0 +1,34 @@
+#ifndef SCENEEXPORTER_H
+#define SCENEEXPORTER_H
+
+#include "pch.h"
+
+// Renders the whole scene to a PNG, PDF or SVG file.
+//
+// Needs no window, so it works the same from the main window and from the
+// command line tool running on the offscreen platform. Image items decode
+// the level they need synchronously when painted without a view.
+class SceneExporter
+{
+public:
+    enum class Format { Png, Pdf, Svg };
+
+    // Format for a file name by suffix; false if unknown
+    static bool formatForFile(const QString &file_name, Format *format);
+
+    // Area exported: all items plus a margin, or a default page when empty
+    static QRectF exportRect(const QGraphicsScene *scene);
+
+    // Render the scene to a file
+    static bool exportToFile(QGraphicsScene *scene, const QString &file_name, Format format);
+
+private:
+    static bool exportToPng(QGraphicsScene *scene, const QString &file_name);
+    static bool exportToPdf(QGraphicsScene *scene, const QString &file_name);
+    static bool exportToSvg(QGraphicsScene *scene, const QString &file_name);
+
+    // Quality settings shared by all formats
+    static void setRenderHints(QPainter *painter);
+};
+
+#endif // SCENEEXPORTER_H
@@ -0,0 +1,38 @@
+#ifndef SCENEINDEXSUSPENDER_H
+#define SCENEINDEXSUSPENDER_H
+
+#include "pch.h"
+
+// Batches of at least this many items are added with the scene index suspended
+constexpr int kBatchIndexThreshold = 32;
+
+// Turns the scene's BSP index off while a large batch of items is added,
+// moved or removed; building the tree once afterwards is cheaper than
+// updating it item by item
+class SceneIndexSuspender
+{
+public:
+    SceneIndexSuspender(QGraphicsScene *scene, int item_count)
+        : m_scene(scene && item_count >= kBatchIndexThreshold &&
+                  scene->itemIndexMethod() == QGraphicsScene::BspTreeIndex ? scene : nullptr)
+    {
+        if (m_scene) {
+            m_scene->setItemIndexMethod(QGraphicsScene::NoIndex);
+        }
+    }
+
+    ~SceneIndexSuspender()
+    {
+        if (m_scene) {
+            m_scene->setItemIndexMethod(QGraphicsScene::BspTreeIndex);
+        }
+    }
+
+    SceneIndexSuspender(const SceneIndexSuspender &) = delete;
+    SceneIndexSuspender &operator=(const SceneIndexSuspender &) = delete;
+
+private:
+    QGraphicsScene *m_scene;
+};
+
+#endif // SCENEINDEXSUSPENDER_H
@@ -0,0 +1,158 @@
+#include "pch.h"
+
+#include "searchbar.h"
+#include "infinitecanvas.h"
+#include "searchindex.h"
+
+namespace {
+// Result rows shown before the list scrolls
+constexpr int kVisibleResultRows = 8;
+}
+
+SearchBar::SearchBar(InfiniteCanvas *canvas, QWidget *parent)
+    : QWidget(parent),
+      m_canvas(canvas),
+      m_query_edit(new QLineEdit(this)),
+      m_status_label(new QLabel(this)),
+      m_close_button(new QToolButton(this)),
+      m_results_list(new QListWidget(this)),
+      m_total_matches(0)
+{
+    QHBoxLayout *query_layout = new QHBoxLayout;
+    query_layout->addWidget(m_query_edit);
+    query_layout->addWidget(m_status_label);
+    query_layout->addWidget(m_close_button);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(4, 4, 4, 4);
+    layout->addLayout(query_layout);
+    layout->addWidget(m_results_list);
+
+    m_query_edit->setClearButtonEnabled(true);
+    m_query_edit->installEventFilter(this);
+    m_close_button->setText(QStringLiteral("✕"));
+    m_close_button->setAutoRaise(true);
+
+    // Long texts are shown on one line, hidden until there are results
+    m_results_list->setUniformItemSizes(true);
+    m_results_list->setTextElideMode(Qt::ElideRight);
+    m_results_list->hide();
+
+    connect(m_query_edit, &QLineEdit::textChanged, this, &SearchBar::updateResults);
+    connect(m_query_edit, &QLineEdit::returnPressed, this, [this]() {
+        revealResult(qMax(0, m_results_list->currentRow()));
+        close();
+    });
+    connect(m_results_list, &QListWidget::currentRowChanged, this, &SearchBar::revealResult);
+    connect(m_results_list, &QListWidget::itemActivated, this, [this](QListWidgetItem *item) {
+        revealResult(m_results_list->row(item));
+        close();
+    });
+    connect(m_close_button, &QToolButton::clicked, this, &SearchBar::close);
+
+    retranslateUi();
+    hide();
+}
+
+void SearchBar::activate()
+{
+    show();
+    m_query_edit->setFocus();
+    m_query_edit->selectAll();
+
+    // The map may have changed since the last search
+    updateResults();
+}
+
+void SearchBar::updateResults()
+{
+    QString query = m_query_edit->text();
+    m_results = SearchIndex::instance().search(query, m_canvas->scene(), SearchIndex::kMaxResults,
+                                               &m_total_matches);
+
+    // Fill the list without jumping to each row as it is added
+    QSignalBlocker blocker(m_results_list);
+    m_results_list->clear();
+    for (QGraphicsItem *item : qAsConst(m_results)) {
+        m_results_list->addItem(SearchIndex::searchableText(item).simplified());
+    }
+    if (!m_results.isEmpty()) {
+        int rows = qMin(m_results.size(), kVisibleResultRows);
+        m_results_list->setFixedHeight(m_results_list->sizeHintForRow(0) * rows +
+                                       2 * m_results_list->frameWidth());
+    }
+    m_results_list->setVisible(!m_results.isEmpty());
+
+    if (query.trimmed().isEmpty()) {
+        m_status_label->clear();
+    } else if (m_total_matches == 0) {
+        m_status_label->setText(tr("No matches"));
+    } else if (m_total_matches > m_results.size()) {
+        m_status_label->setText(tr("%1 of %2 matches").arg(m_results.size()).arg(m_total_matches));
+    } else {
+        m_status_label->setText(tr("%1 matches").arg(m_total_matches));
+    }
+}
+
+void SearchBar::revealResult(int row)
+{
+    if (row < 0 || row >= m_results.size()) {
+        return;
+    }
+
+    // The item may have been deleted since the search
+    QGraphicsItem *item = m_results[row];
+    if (!SearchIndex::instance().contains(item)) {
+        updateResults();
+        return;
+    }
+    m_canvas->revealItem(item);
+}
+
+void SearchBar::close()
+{
+    hide();
+    m_results.clear();
+    m_results_list->clear();
+    m_canvas->setFocus();
+}
+
+bool SearchBar::eventFilter(QObject *watched, QEvent *event)
+{
+    // Navigate the results and close the bar from the query field
+    if (watched == m_query_edit && event->type() == QEvent::KeyPress) {
+        QKeyEvent *key_event = static_cast<QKeyEvent*>(event);
+        int row = m_results_list->currentRow();
+        switch (key_event->key()) {
+        case Qt::Key_Down:
+            m_results_list->setCurrentRow(qMin(row + 1, m_results_list->count() - 1));
+            return true;
+        case Qt::Key_Up:
+            m_results_list->setCurrentRow(qMax(row - 1, 0));
+            return true;
+        case Qt::Key_Escape:
+            close();
+            return true;
+        default:
+            break;
+        }
+    }
+    return QWidget::eventFilter(watched, event);
+}
+
+void SearchBar::changeEvent(QEvent *event)
+{
+    if (event->type() == QEvent::LanguageChange) {
+        retranslateUi();
+    }
+    QWidget::changeEvent(event);
+}
+
+void SearchBar::retranslateUi()
+{
+    m_query_edit->setPlaceholderText(tr("Find nodes, links and paths"));
+    m_close_button->setToolTip(tr("Close"));
+    if (isVisible()) {
+        updateResults();
+    }
+}
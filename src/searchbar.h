@@ -0,0 +1,48 @@
+#ifndef SEARCHBAR_H
+#define SEARCHBAR_H
+
+#include "pch.h"
+
+class InfiniteCanvas;
+
+// Find-as-you-type bar above the canvas.
+//
+// Every keystroke queries the SearchIndex and lists the best matches below
+// the query field. Moving through the list centers the canvas on each match
+// and selects it; Enter keeps the current match and closes the bar, Escape
+// just closes it.
+class SearchBar : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit SearchBar(InfiniteCanvas *canvas, QWidget *parent = nullptr);
+
+    // Show the bar and focus the query field
+    void activate();
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+    void changeEvent(QEvent *event) override;
+
+private:
+    // Run the query and list the results
+    void updateResults();
+
+    // Jump to the result in a list row
+    void revealResult(int row);
+
+    // Hide the bar and give the focus back to the canvas
+    void close();
+
+    void retranslateUi();
+
+    InfiniteCanvas *m_canvas;
+    QLineEdit *m_query_edit;
+    QLabel *m_status_label;
+    QToolButton *m_close_button;
+    QListWidget *m_results_list;
+    QList<QGraphicsItem*> m_results; // Items of the list rows
+    int m_total_matches;
+};
+
+#endif // SEARCHBAR_H
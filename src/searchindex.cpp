@@ -0,0 +1,240 @@
+#include "pch.h"
+
+#include "searchindex.h"
+#include "infinitecanvas.h"
+#include "trace.h"
+
+namespace {
+// Dead entries tolerated before the index is compacted
+constexpr int kMinDeadForCompact = 1024;
+
+// Whether the word occurs in the text at the start of a word
+bool startsWord(const QString &text, const QString &word)
+{
+    for (int pos = text.indexOf(word); pos >= 0; pos = text.indexOf(word, pos + 1)) {
+        if (pos == 0 || !text[pos - 1].isLetterOrNumber()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Rank of a match: the whole text, its beginning, word starts, anywhere
+int matchRank(const QString &text, const QString &query, const QStringList &words)
+{
+    if (text == query) {
+        return 3;
+    }
+    if (text.startsWith(query)) {
+        return 2;
+    }
+    for (const QString &word : words) {
+        if (!startsWord(text, word)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+}
+
+SearchIndex &SearchIndex::instance()
+{
+    static SearchIndex index;
+    return index;
+}
+
+SearchIndex::SearchIndex()
+    : m_dead_count(0)
+{
+}
+
+void SearchIndex::markDirty(QGraphicsItem *item)
+{
+    m_dirty_items.insert(item);
+}
+
+void SearchIndex::removeItem(QGraphicsItem *item)
+{
+    m_dirty_items.remove(item);
+
+    auto it = m_live_entries.find(item);
+    if (it != m_live_entries.end()) {
+        Entry &entry = m_entries[it.value()];
+        entry.item = nullptr;
+        entry.text.clear();
+        ++m_dead_count;
+        m_live_entries.erase(it);
+    }
+}
+
+bool SearchIndex::contains(QGraphicsItem *item) const
+{
+    return m_live_entries.contains(item) || m_dirty_items.contains(item);
+}
+
+QString SearchIndex::searchableText(const QGraphicsItem *item)
+{
+    if (const EditableTextItem *text_item = dynamic_cast<const EditableTextItem*>(item)) {
+        return text_item->toPlainText();
+    }
+    if (const UrlItem *url_item = dynamic_cast<const UrlItem*>(item)) {
+        return url_item->getUrl().toString();
+    }
+    if (const DirectoryItem *dir_item = dynamic_cast<const DirectoryItem*>(item)) {
+        return dir_item->getDirPath();
+    }
+    if (const MediaItem *media_item = dynamic_cast<const MediaItem*>(item)) {
+        return media_item->getMediaPath();
+    }
+    if (const ShortcutItem *shortcut_item = dynamic_cast<const ShortcutItem*>(item)) {
+        return shortcut_item->getTargetPath();
+    }
+    return QString();
+}
+
+quint64 SearchIndex::trigramKey(const QChar *chars)
+{
+    return (quint64(chars[0].unicode()) << 32) | (quint64(chars[1].unicode()) << 16) |
+           chars[2].unicode();
+}
+
+void SearchIndex::flush()
+{
+    if (m_dirty_items.isEmpty()) {
+        return;
+    }
+    TRACE_SCOPE("SearchIndex::flush", "search");
+
+    // Edited items get a new entry, the old one dies
+    const QSet<QGraphicsItem*> dirty_items = std::move(m_dirty_items);
+    m_dirty_items.clear();
+    for (QGraphicsItem *item : dirty_items) {
+        removeItem(item);
+        addEntry(item);
+    }
+
+    if (m_dead_count >= kMinDeadForCompact && m_dead_count > m_live_entries.size()) {
+        compact();
+    }
+}
+
+void SearchIndex::addEntry(QGraphicsItem *item)
+{
+    QString text = searchableText(item).toCaseFolded();
+    if (text.isEmpty()) {
+        return;
+    }
+
+    int id = m_entries.size();
+    m_entries.append({item, text});
+    m_live_entries.insert(item, id);
+
+    // Ids only grow, so appending keeps every list sorted
+    const QChar *chars = text.constData();
+    for (int i = 0; i + 3 <= text.size(); ++i) {
+        QVector<int> &ids = m_trigrams[trigramKey(chars + i)];
+        if (ids.isEmpty() || ids.last() != id) {
+            ids.append(id);
+        }
+    }
+}
+
+void SearchIndex::compact()
+{
+    TRACE_SCOPE("SearchIndex::compact", "search");
+
+    QVector<Entry> entries = std::move(m_entries);
+    m_entries.clear();
+    m_entries.reserve(m_live_entries.size());
+    m_trigrams.clear();
+    m_live_entries.clear();
+    m_dead_count = 0;
+
+    for (const Entry &entry : entries) {
+        if (entry.item) {
+            addEntry(entry.item);
+        }
+    }
+}
+
+QList<QGraphicsItem*> SearchIndex::search(const QString &query, const QGraphicsScene *scene,
+                                          int max_results, int *total_matches)
+{
+    TRACE_SCOPE("SearchIndex::search", "search");
+    flush();
+
+    if (total_matches) {
+        *total_matches = 0;
+    }
+    const QString folded_query = query.toCaseFolded().simplified();
+    const QStringList words = folded_query.split(' ', Qt::SkipEmptyParts);
+    if (words.isEmpty()) {
+        return {};
+    }
+
+    // Only the entries sharing the rarest trigram can match; words shorter
+    // than a trigram are checked against every entry
+    const QVector<int> *candidates = nullptr;
+    for (const QString &word : words) {
+        for (int i = 0; i + 3 <= word.size(); ++i) {
+            auto it = m_trigrams.constFind(trigramKey(word.constData() + i));
+            if (it == m_trigrams.constEnd()) {
+                return {};
+            }
+            if (!candidates || it->size() < candidates->size()) {
+                candidates = &it.value();
+            }
+        }
+    }
+
+    struct Match {
+        int id;
+        int rank;
+    };
+    QVector<Match> matches;
+    int candidate_count = candidates ? candidates->size() : m_entries.size();
+    for (int i = 0; i < candidate_count; ++i) {
+        int id = candidates ? candidates->at(i) : i;
+        const Entry &entry = m_entries[id];
+        if (!entry.item || entry.item->scene() != scene) {
+            continue;
+        }
+
+        bool contains_all = true;
+        for (const QString &word : words) {
+            if (!entry.text.contains(word)) {
+                contains_all = false;
+                break;
+            }
+        }
+        if (contains_all) {
+            matches.append({id, matchRank(entry.text, folded_query, words)});
+        }
+    }
+
+    if (total_matches) {
+        *total_matches = matches.size();
+    }
+
+    // Better rank first, then shorter texts, then older items
+    int result_count = qMin(qMax(0, max_results), matches.size());
+    std::partial_sort(matches.begin(), matches.begin() + result_count, matches.end(),
+                      [this](const Match &a, const Match &b) {
+                          if (a.rank != b.rank) {
+                              return a.rank > b.rank;
+                          }
+                          int a_length = m_entries[a.id].text.size();
+                          int b_length = m_entries[b.id].text.size();
+                          if (a_length != b_length) {
+                              return a_length < b_length;
+                          }
+                          return a.id < b.id;
+                      });
+
+    QList<QGraphicsItem*> results;
+    results.reserve(result_count);
+    for (int i = 0; i < result_count; ++i) {
+        results.append(m_entries[matches[i].id].item);
+    }
+    return results;
+}
@@ -0,0 +1,70 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include "pch.h"
+
+// Full-text index over the searchable items of all scenes.
+//
+// Text nodes are indexed by their text, URL items by their URL and folder,
+// media and shortcut items by their path. Each indexed text is split into
+// trigrams of case-folded characters, and every trigram keeps the ids of
+// the texts containing it in ascending order. A query looks up the rarest
+// trigram of its words and only checks the texts in that list, so typing
+// stays responsive on maps with 100k nodes.
+//
+// Items only mark themselves dirty when they are created or edited; the
+// texts are read and indexed on the next search. Edits and removals leave
+// the old entry behind as a dead id that searches skip, and the index is
+// rebuilt from the live entries once they make up less than half of it.
+class SearchIndex
+{
+public:
+    static SearchIndex &instance();
+
+    // Most results returned by search() by default
+    static constexpr int kMaxResults = 50;
+
+    // (Re)index an item on the next search, e.g. after its text was edited
+    void markDirty(QGraphicsItem *item);
+
+    // Forget an item (e.g. when it is deleted)
+    void removeItem(QGraphicsItem *item);
+
+    // Whether the item is indexed or waiting to be; false once it was deleted
+    bool contains(QGraphicsItem *item) const;
+
+    // Items of the scene containing every word of the query, best match
+    // first. total_matches receives the number of matches before the limit.
+    QList<QGraphicsItem*> search(const QString &query, const QGraphicsScene *scene,
+                                 int max_results = kMaxResults, int *total_matches = nullptr);
+
+    // Text an item is found by, empty for items that are not searchable
+    static QString searchableText(const QGraphicsItem *item);
+
+private:
+    SearchIndex();
+
+    struct Entry {
+        QGraphicsItem *item; // Null once the entry is dead
+        QString text;        // Case folded
+    };
+
+    // Index the dirty items
+    void flush();
+
+    // Add an entry for the item's current text
+    void addEntry(QGraphicsItem *item);
+
+    // Rebuild the trigram lists from the live entries
+    void compact();
+
+    static quint64 trigramKey(const QChar *chars);
+
+    QVector<Entry> m_entries;
+    QHash<quint64, QVector<int>> m_trigrams;  // Trigram -> entry ids, ascending
+    QHash<QGraphicsItem*, int> m_live_entries; // Item -> its current entry id
+    QSet<QGraphicsItem*> m_dirty_items;
+    int m_dead_count;
+};
+
+#endif // SEARCHINDEX_H
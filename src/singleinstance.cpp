@@ -0,0 +1,69 @@
+#include "pch.h"
+
+#include "singleinstance.h"
+
+SingleInstance::SingleInstance(QObject *parent)
+    : QObject(parent), m_server(new QLocalServer(this))
+{
+    connect(m_server, &QLocalServer::newConnection, this, &SingleInstance::onNewConnection);
+}
+
+QString SingleInstance::serverName()
+{
+    // One instance per user
+    QString user = qEnvironmentVariable("USERNAME", qEnvironmentVariable("USER"));
+    return QStringLiteral("QtMindMap-") + user;
+}
+
+bool SingleInstance::listen()
+{
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    if (m_server->listen(serverName())) {
+        return true;
+    }
+
+    // A crashed instance may have left its socket behind
+    QLocalServer::removeServer(serverName());
+    if (!m_server->listen(serverName())) {
+        qWarning() << "Failed to listen for other instances:" << m_server->errorString();
+        return false;
+    }
+    return true;
+}
+
+bool SingleInstance::forward(const QString &file_path, int timeout_ms)
+{
+    QLocalSocket socket;
+    socket.connectToServer(serverName());
+    if (!socket.waitForConnected(timeout_ms)) {
+        return false;
+    }
+
+    socket.write(file_path.toUtf8() + '\n');
+    if (!socket.waitForBytesWritten(timeout_ms)) {
+        qWarning() << "Failed to forward to the running instance:" << socket.errorString();
+        return false;
+    }
+
+    socket.disconnectFromServer();
+    if (socket.state() != QLocalSocket::UnconnectedState) {
+        socket.waitForDisconnected(timeout_ms);
+    }
+    return true;
+}
+
+void SingleInstance::onNewConnection()
+{
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+
+        // Each request is a single line
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() {
+            while (socket->canReadLine()) {
+                QString file_path = QString::fromUtf8(socket->readLine()).trimmed();
+                qDebug() << "Open request from another instance:" << file_path;
+                emit openRequested(file_path);
+            }
+        });
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef SINGLEINSTANCE_H
+#define SINGLEINSTANCE_H
+
+#include "pch.h"
+
+// Lets later launches hand their file argument to the running instance.
+//
+// The running instance listens on a per-user local socket. A second
+// process connects, writes the (absolute) path of the map to open followed
+// by a newline and exits, so opening a map from the file manager only
+// costs loading the map instead of starting the application again.
+class SingleInstance : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SingleInstance(QObject *parent = nullptr);
+
+    // Start accepting requests from other instances
+    bool listen();
+
+    // Send a file path (empty to just activate the window) to the running
+    // instance; returns false if no instance answered
+    static bool forward(const QString &file_path, int timeout_ms = 1000);
+
+signals:
+    void openRequested(const QString &file_path);
+
+private:
+    void onNewConnection();
+
+    static QString serverName();
+
+    QLocalServer *m_server;
+};
+
+#endif // SINGLEINSTANCE_H
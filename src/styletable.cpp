@@ -0,0 +1,211 @@
+#include "pch.h"
+
+#include "styletable.h"
+
+namespace {
+// Look of the default style
+const char *const kDefaultFontFamily = "Arial";
+constexpr int kDefaultFontSize = 12;
+const QColor kDefaultTextColor(Qt::black);
+const QColor kDefaultBorderColor(100, 149, 237);     // Cornflower blue
+const QColor kDefaultBackgroundColor(240, 248, 255); // AliceBlue - very light blue
+}
+
+NodeStyle::NodeStyle(const QString &name, const QFont &font, const QColor &text_color,
+                     const QColor &border_color, const QColor &background_color)
+    : name(name),
+      font(font),
+      text_color(text_color),
+      border_pen(border_color, 1),
+      background_brush(background_color)
+{
+}
+
+QJsonObject NodeStyle::toJson() const
+{
+    QJsonObject json;
+    if (!name.isEmpty()) {
+        json["name"] = name;
+    }
+    json["font_family"] = font.family();
+    json["font_size"] = font.pointSize();
+    json["color"] = text_color.name();
+    json["border_color"] = border_pen.color().name();
+    json["background_color"] = background_brush.color().name();
+    return json;
+}
+
+NodeStyle NodeStyle::fromJson(const QJsonObject &json)
+{
+    QFont font(json["font_family"].toString(kDefaultFontFamily), json["font_size"].toInt(kDefaultFontSize));
+
+    // Colors that are missing or invalid take the defaults
+    auto color = [&json](const char *key, const QColor &fallback) {
+        QColor value(json[key].toString());
+        return value.isValid() ? value : fallback;
+    };
+    return NodeStyle(json["name"].toString(), font, color("color", kDefaultTextColor),
+                     color("border_color", kDefaultBorderColor),
+                     color("background_color", kDefaultBackgroundColor));
+}
+
+StyleTable &StyleTable::instance()
+{
+    static StyleTable table;
+    return table;
+}
+
+StyleTable::StyleTable()
+    : m_epoch(0), m_overflow_reported(false)
+{
+    intern(NodeStyle("default", QFont(kDefaultFontFamily, kDefaultFontSize), kDefaultTextColor,
+                     kDefaultBorderColor, kDefaultBackgroundColor));
+}
+
+StyleTable::~StyleTable()
+{
+    for (QAtomicPointer<NodeStyle> &style : m_styles) {
+        delete style.loadRelaxed();
+    }
+}
+
+bool StyleTable::contains(int index) const
+{
+    return index >= 0 && index < m_count.loadAcquire() && m_styles[index].loadAcquire();
+}
+
+const NodeStyle &StyleTable::style(int index) const
+{
+    NodeStyle *style = index >= 0 && index < m_count.loadAcquire() ? m_styles[index].loadAcquire()
+                                                                    : nullptr;
+    return style ? *style : *m_styles[0].loadAcquire();
+}
+
+int StyleTable::intern(const NodeStyle &style)
+{
+    QString key = keyOf(style);
+
+    QMutexLocker locker(&m_mutex);
+    auto it = m_indexes.constFind(key);
+    if (it != m_indexes.constEnd()) {
+        m_epochs[it.value()] = m_epoch;
+        return it.value();
+    }
+
+    // Reuse the index of a freed style, else take the next one
+    int index;
+    if (!m_free.isEmpty()) {
+        index = m_free.takeLast();
+    } else {
+        index = m_count.loadRelaxed();
+        if (index >= kMaxStyles) {
+            if (!m_overflow_reported) {
+                qWarning() << "More than" << kMaxStyles << "node styles, using the default style for the others";
+                m_overflow_reported = true;
+            }
+            return 0;
+        }
+    }
+
+    // Publish the style only once it is complete
+    m_styles[index].storeRelease(new NodeStyle(style));
+    m_indexes.insert(key, index);
+    m_epochs[index] = m_epoch;
+    if (index == m_count.loadRelaxed()) {
+        m_count.storeRelease(index + 1);
+    }
+    return index;
+}
+
+void StyleTable::beginDocument()
+{
+    QMutexLocker locker(&m_mutex);
+    ++m_epoch;
+}
+
+void StyleTable::reclaim()
+{
+    QMutexLocker locker(&m_mutex);
+
+    // The default style is always kept
+    int freed = 0;
+    int count = m_count.loadRelaxed();
+    for (int i = 1; i < count; ++i) {
+        NodeStyle *style = m_styles[i].loadRelaxed();
+        if (!style || m_epochs[i] == m_epoch) {
+            continue;
+        }
+        m_indexes.remove(keyOf(*style));
+        m_styles[i].storeRelease(nullptr);
+        delete style;
+        m_free.append(i);
+        ++freed;
+    }
+    if (freed > 0) {
+        qDebug() << "Freed" << freed << "node styles of closed maps";
+    }
+}
+
+int StyleTable::find(const QString &name) const
+{
+    int count = m_count.loadAcquire();
+    for (int i = 0; i < count; ++i) {
+        NodeStyle *style = m_styles[i].loadAcquire();
+        if (style && style->name == name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+QVector<int> StyleTable::intern(const QJsonArray &styles)
+{
+    QVector<int> style_map;
+    style_map.reserve(styles.size());
+    for (const QJsonValue &style : styles) {
+        style_map.append(intern(NodeStyle::fromJson(style.toObject())));
+    }
+    return style_map;
+}
+
+int StyleTable::resolve(const QJsonObject &record, const QVector<int> &style_map)
+{
+    if (!record.contains("style") && record.contains("font_family") && record.contains("font_size")) {
+        // Older maps stored the font and color of every node
+        const NodeStyle &base = style(0);
+        QFont font(record["font_family"].toString(), record["font_size"].toInt());
+        QColor text_color = record.contains("color") ? QColor(record["color"].toString()) : base.text_color;
+        return intern(NodeStyle(QString(), font, text_color, base.border_pen.color(),
+                                base.background_brush.color()));
+    }
+
+    int index = record["style"].toInt();
+    if (style_map.isEmpty()) {
+        return contains(index) ? index : 0;
+    }
+    return style_map.value(index);
+}
+
+QJsonArray StyleTable::toJson(const QVector<int> &indexes) const
+{
+    QJsonArray styles;
+    for (int index : indexes) {
+        styles.append(style(index).toJson());
+    }
+    return styles;
+}
+
+int StyleTable::depthStyle(int depth) const
+{
+    if (m_depth_styles.isEmpty()) {
+        return 0;
+    }
+    return m_depth_styles[qBound(0, depth, m_depth_styles.size() - 1)];
+}
+
+QString StyleTable::keyOf(const NodeStyle &style)
+{
+    return QStringList({style.name, style.font.toString(), style.text_color.name(QColor::HexArgb),
+                        style.border_pen.color().name(QColor::HexArgb),
+                        style.background_brush.color().name(QColor::HexArgb)}).join('\n');
+}
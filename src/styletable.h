@@ -0,0 +1,102 @@
+#ifndef STYLETABLE_H
+#define STYLETABLE_H
+
+#include "pch.h"
+
+// Look of a text node: its font and text color, and the pen and brush of
+// its frame, built once and shared by every node using the style
+struct NodeStyle
+{
+    NodeStyle(const QString &name, const QFont &font, const QColor &text_color,
+              const QColor &border_color, const QColor &background_color);
+
+    // Style in the map format, and back (missing fields take the defaults)
+    QJsonObject toJson() const;
+    static NodeStyle fromJson(const QJsonObject &json);
+
+    QString name; // Empty for unnamed styles
+    QFont font;
+    QColor text_color;
+    QPen border_pen;
+    QBrush background_brush;
+};
+
+// Styles of all text nodes, referenced by a small index.
+//
+// Nodes used to carry their own font and color, written out with every
+// node of a map, and built a pen and brush on every paint. Styles are now
+// interned here once and nodes keep only their index; index 0 is the
+// default style. Maps store the styles they use in a table of their own
+// ("styles") and nodes refer to it by position ("style", left out for the
+// first one); loading a map interns its table and maps the positions to
+// indexes here. Maps may also name the style of new nodes per depth
+// ("depth_styles"), which themes a map without touching its nodes.
+//
+// Styles can be interned from any thread; once interned a style never
+// changes or moves, so reading one needs no lock. Styles that only closed
+// maps used are freed when the next map replaces them (see reclaim()), and
+// their indexes are given to new styles. The depth styles belong to the
+// open map and are only used on the GUI thread.
+class StyleTable
+{
+public:
+    static StyleTable &instance();
+
+    // Most styles kept at a time; further ones fall back to the default style
+    static constexpr int kMaxStyles = 1024;
+
+    ~StyleTable();
+
+    // Style at an index; unknown indexes give the default style
+    const NodeStyle &style(int index) const;
+    bool contains(int index) const;
+
+    // Index of a style, adding it if there is no equal one
+    int intern(const NodeStyle &style);
+
+    // Index of the first style with a name, or -1
+    int find(const QString &name) const;
+
+    // Intern a map's style table; returns the index of each entry
+    QVector<int> intern(const QJsonArray &styles);
+
+    // Style index of a saved text node. Nodes of a map file are resolved
+    // through style_map (from its table); without one the record is taken
+    // to come from this table (e.g. undo snapshots). Records of older maps
+    // carry their font and color instead.
+    int resolve(const QJsonObject &record, const QVector<int> &style_map = QVector<int>());
+
+    // The styles at the given indexes as a map's style table
+    QJsonArray toJson(const QVector<int> &indexes) const;
+
+    // Style of new nodes at a depth (root = 0); the last one is used for
+    // deeper nodes, and the default style if none are set
+    int depthStyle(int depth) const;
+    QVector<int> depthStyles() const { return m_depth_styles; }
+    void setDepthStyles(const QVector<int> &indexes) { m_depth_styles = indexes; }
+
+    // Start interning the styles of another map, e.g. before it is parsed
+    void beginDocument();
+
+    // Free the styles not interned since beginDocument(), once the nodes of
+    // the maps that used them are deleted (GUI thread)
+    void reclaim();
+
+private:
+    StyleTable();
+
+    // Key of equal styles
+    static QString keyOf(const NodeStyle &style);
+
+    mutable QMutex m_mutex;
+    QAtomicPointer<NodeStyle> m_styles[kMaxStyles]; // Null once freed
+    QAtomicInt m_count;                // Indexes handed out so far
+    QHash<QString, int> m_indexes;     // By key, guarded by m_mutex
+    QVector<int> m_free;               // Freed indexes, guarded by m_mutex
+    int m_epochs[kMaxStyles];          // Document a style was last interned for
+    int m_epoch;
+    bool m_overflow_reported;
+    QVector<int> m_depth_styles;
+};
+
+#endif // STYLETABLE_H
@@ -0,0 +1,123 @@
+#include "pch.h"
+
+#include "trace.h"
+
+namespace Trace {
+
+namespace Detail {
+std::atomic<bool> g_enabled(false);
+}
+
+namespace {
+struct Event {
+    const char *name;
+    const char *category;
+    qint64 start_us;
+    qint64 duration_us;
+    int tid;
+};
+
+QMutex g_mutex;
+QVector<Event> g_events;
+QString g_file_path;
+QElapsedTimer g_clock;
+int g_main_tid = 0;
+
+// Small, stable id of the calling thread
+int currentTid() {
+    static std::atomic<int> next_tid(1);
+    thread_local int tid = next_tid++;
+    return tid;
+}
+
+// Escape a string for a JSON string literal
+QByteArray jsonEscape(const char *text) {
+    QByteArray escaped(text);
+    escaped.replace('\\', "\\\\");
+    escaped.replace('"', "\\\"");
+    return escaped;
+}
+}
+
+void start(const QString &file_path) {
+    QMutexLocker locker(&g_mutex);
+    g_file_path = file_path;
+    g_events.clear();
+    g_events.reserve(4096);
+    g_clock.start();
+    g_main_tid = currentTid();
+    Detail::g_enabled.store(true, std::memory_order_relaxed);
+}
+
+void startFromEnvironment(int argc, char *argv[]) {
+    QString file_path = qEnvironmentVariable("QTMINDMAP_TRACE");
+
+    // The command line flag takes precedence
+    for (int i = 1; i < argc; ++i) {
+        QString arg = QString::fromLocal8Bit(argv[i]);
+        if (arg == "--trace" && i + 1 < argc) {
+            file_path = QString::fromLocal8Bit(argv[i + 1]);
+        } else if (arg.startsWith("--trace=")) {
+            file_path = arg.mid(8);
+        }
+    }
+
+    if (!file_path.isEmpty()) {
+        start(file_path);
+    }
+}
+
+qint64 now() {
+    return isEnabled() ? g_clock.nsecsElapsed() / 1000 : 0;
+}
+
+void record(const char *name, const char *category, qint64 start_us, qint64 duration_us) {
+    if (!isEnabled()) {
+        return;
+    }
+
+    Event event = { name, category, start_us, duration_us, currentTid() };
+    QMutexLocker locker(&g_mutex);
+    g_events.append(event);
+}
+
+void stop() {
+    if (!isEnabled()) {
+        return;
+    }
+    Detail::g_enabled.store(false, std::memory_order_relaxed);
+
+    QMutexLocker locker(&g_mutex);
+    QSaveFile file(g_file_path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to write trace file:" << g_file_path << file.errorString();
+        return;
+    }
+
+    QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    QByteArray json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    // Name the GUI thread so it is easy to find
+    json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid +
+            ",\"tid\":" + QByteArray::number(g_main_tid) + ",\"args\":{\"name\":\"GUI\"}}";
+
+    for (const Event &event : qAsConst(g_events)) {
+        json += ",\n{\"name\":\"" + jsonEscape(event.name) +
+                "\",\"cat\":\"" + jsonEscape(event.category) +
+                "\",\"ph\":\"X\",\"ts\":" + QByteArray::number(event.start_us) +
+                ",\"dur\":" + QByteArray::number(event.duration_us) +
+                ",\"pid\":" + pid +
+                ",\"tid\":" + QByteArray::number(event.tid) + "}";
+    }
+    json += "\n]}\n";
+
+    file.write(json);
+    if (file.commit()) {
+        qDebug() << "Wrote" << g_events.size() << "trace events to" << g_file_path;
+    } else {
+        qWarning() << "Failed to write trace file:" << g_file_path << file.errorString();
+    }
+    g_events.clear();
+}
+
+} // namespace Trace
@@ -0,0 +1,71 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "pch.h"
+
+// Lightweight tracing of startup, loading and other hot paths.
+//
+// Tracing is enabled with the QTMINDMAP_TRACE environment variable or the
+// --trace command line flag, both naming the output file. Timed scopes are
+// collected in memory and written as Chrome trace-event JSON when tracing
+// stops, which chrome://tracing and Perfetto can open. While disabled a
+// scope costs a single relaxed atomic load.
+namespace Trace {
+
+// Start collecting events, to be written to file_path
+void start(const QString &file_path);
+
+// Write the collected events and stop tracing
+void stop();
+
+// Start tracing if requested by environment or command line (--trace <file>
+// or --trace=<file>); call before QApplication is created
+void startFromEnvironment(int argc, char *argv[]);
+
+namespace Detail {
+extern std::atomic<bool> g_enabled;
+}
+
+inline bool isEnabled() { return Detail::g_enabled.load(std::memory_order_relaxed); }
+
+// Microseconds since tracing started (0 while disabled)
+qint64 now();
+
+// Record a complete event (ignored while disabled); name and category must
+// be string literals
+void record(const char *name, const char *category, qint64 start_us, qint64 duration_us);
+
+} // namespace Trace
+
+// Records the lifetime of a scope as a trace event
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name, const char *category = "app")
+        : m_name(nullptr), m_category(category), m_start(0) {
+        if (Trace::isEnabled()) {
+            m_name = name;
+            m_start = Trace::now();
+        }
+    }
+    ~TraceScope() {
+        if (m_name) {
+            Trace::record(m_name, m_category, m_start, Trace::now() - m_start);
+        }
+    }
+
+private:
+    Q_DISABLE_COPY(TraceScope)
+
+    const char *m_name;
+    const char *m_category;
+    qint64 m_start;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+// Time the enclosing scope, e.g. TRACE_SCOPE("MapLoader::processChunk")
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(__VA_ARGS__)
+
+#endif // TRACE_H
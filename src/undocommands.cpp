@@ -0,0 +1,632 @@
+#include "pch.h"
+
+#include "undocommands.h"
+#include "infinitecanvas.h"
+#include "mapclipboard.h"
+#include "maploader.h"
+#include "mapwriter.h"
+#include "sceneindexsuspender.h"
+#include "searchindex.h"
+#include "trace.h"
+
+namespace {
+// Bytes held by a snapshot besides its text and image data
+constexpr qint64 kSnapshotCost = 256;
+
+// Update the lines of moved nodes: their lines to their children, and
+// their parents' lines to them
+void updateNodeConnections(const QVector<QGraphicsItem*> &items)
+{
+    QSet<EditableTextItem*> nodes;
+    for (QGraphicsItem *item : items) {
+        if (EditableTextItem *node = dynamic_cast<EditableTextItem*>(item)) {
+            nodes.insert(node);
+            if (node->parentNode()) {
+                nodes.insert(node->parentNode());
+            }
+        }
+    }
+    for (EditableTextItem *node : nodes) {
+        node->updateChildConnections();
+    }
+}
+
+// Items of the ids that are still in the scene
+QVector<QGraphicsItem*> itemsInScene(const QVector<quint64> &ids, const QGraphicsScene *scene)
+{
+    ItemRegistry &registry = ItemRegistry::instance();
+    QVector<QGraphicsItem*> items;
+    items.reserve(ids.size());
+    for (quint64 id : ids) {
+        QGraphicsItem *item = registry.item(id);
+        if (item && item->scene() == scene) {
+            items.append(item);
+        }
+    }
+    return items;
+}
+
+QVector<quint64> idsOf(const QList<QGraphicsItem*> &items)
+{
+    ItemRegistry &registry = ItemRegistry::instance();
+    QVector<quint64> ids;
+    ids.reserve(items.size());
+    for (QGraphicsItem *item : items) {
+        ids.append(registry.idOf(item));
+    }
+    return ids;
+}
+}
+
+// ItemRegistry implementation
+ItemRegistry &ItemRegistry::instance()
+{
+    static ItemRegistry registry;
+    return registry;
+}
+
+ItemRegistry::ItemRegistry()
+    : m_next_id(1)
+{
+}
+
+quint64 ItemRegistry::idOf(QGraphicsItem *item)
+{
+    auto it = m_ids.constFind(item);
+    if (it != m_ids.constEnd()) {
+        return it.value();
+    }
+
+    quint64 id = m_next_id++;
+    m_ids.insert(item, id);
+    m_items.insert(id, item);
+    return id;
+}
+
+void ItemRegistry::bind(quint64 id, QGraphicsItem *item)
+{
+    removeItem(m_items.value(id));
+    removeItem(item);
+    m_ids.insert(item, id);
+    m_items.insert(id, item);
+}
+
+void ItemRegistry::removeItem(QGraphicsItem *item)
+{
+    auto it = m_ids.find(item);
+    if (it != m_ids.end()) {
+        m_items.remove(it.value());
+        m_ids.erase(it);
+    }
+}
+
+void ItemRegistry::hideItems(EditableTextItem *node,
+                             const QHash<const EditableTextItem*, QString> &record_ids)
+{
+    QHash<QString, quint64> hidden_ids;
+    for (auto it = record_ids.constBegin(); it != record_ids.constEnd(); ++it) {
+        quint64 id = existingId(const_cast<EditableTextItem*>(it.key()));
+        if (id) {
+            hidden_ids.insert(it.value(), id);
+        }
+    }
+    if (!hidden_ids.isEmpty()) {
+        m_hidden_ids.insert(idOf(node), hidden_ids);
+    }
+}
+
+void ItemRegistry::restoreHidden(EditableTextItem *node, const QHash<QString, EditableTextItem*> &nodes)
+{
+    quint64 node_id = existingId(node);
+    if (!node_id) {
+        return;
+    }
+
+    const QHash<QString, quint64> hidden_ids = m_hidden_ids.take(node_id);
+    for (auto it = hidden_ids.constBegin(); it != hidden_ids.constEnd(); ++it) {
+        if (EditableTextItem *hidden_node = nodes.value(it.key())) {
+            bind(it.value(), hidden_node);
+        }
+    }
+}
+
+// MapCommand implementation
+MapCommand::MapCommand(QGraphicsScene *scene, const QString &text, bool applied)
+    : QUndoCommand(text), m_scene(scene), m_skip_redo(applied), m_released(false)
+{
+}
+
+void MapCommand::undo()
+{
+    if (m_scene && !m_released) {
+        undoChange();
+    }
+}
+
+void MapCommand::redo()
+{
+    // The change of an applied command already happened
+    if (m_skip_redo) {
+        m_skip_redo = false;
+        return;
+    }
+    if (m_scene && !m_released) {
+        redoChange();
+    }
+}
+
+void MapCommand::release()
+{
+    if (m_released) {
+        return;
+    }
+    releaseData();
+    m_released = true;
+    setObsolete(true);
+}
+
+// ItemSetCommand implementation
+ItemSetCommand::ItemSetCommand(QGraphicsScene *scene, const QList<QGraphicsItem*> &items,
+                               Change change, const QString &text)
+    : MapCommand(scene, text, change == Added), m_change(change), m_item_ids(idsOf(items)),
+      m_snapshot_cost(0)
+{
+}
+
+qint64 ItemSetCommand::cost() const
+{
+    return kCommandCost + m_item_ids.size() * qint64(sizeof(quint64)) + m_snapshot_cost;
+}
+
+void ItemSetCommand::undoChange()
+{
+    if (m_change == Added) {
+        removeItems();
+    } else {
+        restoreItems();
+    }
+}
+
+void ItemSetCommand::redoChange()
+{
+    if (m_change == Added) {
+        restoreItems();
+    } else {
+        removeItems();
+    }
+}
+
+void ItemSetCommand::releaseData()
+{
+    m_item_ids = QVector<quint64>();
+    m_snapshots = QVector<Snapshot>();
+    m_snapshot_cost = 0;
+}
+
+void ItemSetCommand::removeItems()
+{
+    TRACE_SCOPE("ItemSetCommand::removeItems", "undo");
+
+    // The items with the descendants of text nodes
+    QList<QGraphicsItem*> items;
+    QSet<QGraphicsItem*> seen;
+    QVector<QGraphicsItem*> pending;
+    for (QGraphicsItem *item : itemsInScene(m_item_ids, scene())) {
+        pending.append(item);
+        while (!pending.isEmpty()) {
+            QGraphicsItem *current = pending.takeLast();
+            if (seen.contains(current)) {
+                continue;
+            }
+            seen.insert(current);
+            items.append(current);
+
+            if (EditableTextItem *node = dynamic_cast<EditableTextItem*>(current)) {
+                const NodeLinks::Children children = node->childNodes();
+                for (int i = children.size() - 1; i >= 0; --i) {
+                    pending.append(children[i]);
+                }
+            }
+        }
+    }
+
+    m_item_ids.clear();
+    m_snapshots.clear();
+    m_snapshots.reserve(items.size());
+    m_snapshot_cost = 0;
+    for (QGraphicsItem *item : items) {
+        m_snapshots.append(takeSnapshot(item));
+        m_item_ids.append(m_snapshots.last().id);
+        m_snapshot_cost += snapshotCost(m_snapshots.last());
+    }
+
+    EditableTextItem::deleteItems(items);
+}
+
+void ItemSetCommand::restoreItems()
+{
+    TRACE_SCOPE("ItemSetCommand::restoreItems", "undo");
+
+    ItemRegistry &registry = ItemRegistry::instance();
+    QList<QGraphicsItem*> items;
+    items.reserve(m_snapshots.size());
+
+    struct Link {
+        EditableTextItem *node;
+        quint64 parent_id;
+        int child_index;
+    };
+    QVector<Link> links;
+
+    for (const Snapshot &snapshot : m_snapshots) {
+        QGraphicsItem *item = createItem(snapshot);
+        if (!item) {
+            continue;
+        }
+        registry.bind(snapshot.id, item);
+        items.append(item);
+
+        if (snapshot.parent_id) {
+            links.append({static_cast<EditableTextItem*>(item), snapshot.parent_id, snapshot.child_index});
+        }
+    }
+
+    {
+        // Nodes and their connection lines go in with the index suspended
+        SceneIndexSuspender suspend_index(scene(), items.size() * 2);
+        for (QGraphicsItem *item : items) {
+            scene()->addItem(item);
+        }
+
+        // Link once both ends are in the scene; inserting in child order
+        // puts every node back at its old place among its siblings
+        std::stable_sort(links.begin(), links.end(), [](const Link &a, const Link &b) {
+            return a.child_index < b.child_index;
+        });
+        for (const Link &link : links) {
+            EditableTextItem *parent = dynamic_cast<EditableTextItem*>(registry.item(link.parent_id));
+            if (parent && parent->scene() == scene()) {
+                parent->addChildNode(link.node, link.child_index);
+            }
+        }
+    }
+
+    m_snapshots.clear();
+    m_snapshots.squeeze();
+    m_snapshot_cost = 0;
+}
+
+ItemSetCommand::Snapshot ItemSetCommand::takeSnapshot(QGraphicsItem *item)
+{
+    Snapshot snapshot;
+    snapshot.id = ItemRegistry::instance().idOf(item);
+
+    if (ImageItem *image_item = dynamic_cast<ImageItem*>(item)) {
+        // Pasted images have no file, so the (encoded) source itself is kept
+        snapshot.data["type"] = "image";
+        snapshot.data["x"] = item->pos().x();
+        snapshot.data["y"] = item->pos().y();
+        snapshot.image_source = image_item->source();
+        snapshot.image_size = image_item->imageSize();
+        return snapshot;
+    }
+
+    snapshot.data = MapWriter::itemToJson(item, false, nullptr);
+
+    if (EditableTextItem *node = dynamic_cast<EditableTextItem*>(item)) {
+        if (node->collapsedSubtree()) {
+            snapshot.hidden = *node->collapsedSubtree();
+        }
+        if (EditableTextItem *parent = node->parentNode()) {
+            snapshot.parent_id = ItemRegistry::instance().idOf(parent);
+            snapshot.child_index = parent->childNodes().indexOf(node);
+        }
+    }
+    return snapshot;
+}
+
+QGraphicsItem *ItemSetCommand::createItem(const Snapshot &snapshot)
+{
+    if (!snapshot.image_source.isNull()) {
+        ImageItem *image_item = new ImageItem(snapshot.image_source, snapshot.image_size);
+        image_item->setPos(snapshot.data["x"].toDouble(), snapshot.data["y"].toDouble());
+        return image_item;
+    }
+
+    QGraphicsItem *item = MapLoader::itemFromJson(snapshot.data, nullptr);
+    EditableTextItem *node = dynamic_cast<EditableTextItem*>(item);
+    if (node && !snapshot.hidden.isEmpty()) {
+        node->setCollapsedSubtree(snapshot.hidden);
+    }
+    return item;
+}
+
+qint64 ItemSetCommand::snapshotCost(const Snapshot &snapshot)
+{
+    qint64 cost = kSnapshotCost + snapshot.data["content"].toString().size() * qint64(sizeof(QChar));
+    cost += snapshot.hidden.nodeCount() * kSnapshotCost;
+    cost += snapshot.image_source.data.size();
+    return cost;
+}
+
+// MoveItemsCommand implementation
+MoveItemsCommand::MoveItemsCommand(QGraphicsScene *scene, const QList<QGraphicsItem*> &items,
+                                   const QPointF &delta)
+    : MapCommand(scene, QObject::tr("Move"), true), m_item_ids(idsOf(items)), m_delta(delta)
+{
+    std::sort(m_item_ids.begin(), m_item_ids.end());
+}
+
+bool MoveItemsCommand::mergeWith(const QUndoCommand *other)
+{
+    const MoveItemsCommand *move = static_cast<const MoveItemsCommand*>(other);
+    if (isReleased() || move->m_item_ids != m_item_ids) {
+        return false;
+    }
+
+    // Moving back to the start leaves nothing to undo
+    m_delta += move->m_delta;
+    setObsolete(m_delta.isNull());
+    return true;
+}
+
+qint64 MoveItemsCommand::cost() const
+{
+    return kCommandCost + m_item_ids.size() * qint64(sizeof(quint64));
+}
+
+void MoveItemsCommand::undoChange()
+{
+    moveItems(-m_delta);
+}
+
+void MoveItemsCommand::redoChange()
+{
+    moveItems(m_delta);
+}
+
+void MoveItemsCommand::releaseData()
+{
+    m_item_ids = QVector<quint64>();
+}
+
+void MoveItemsCommand::moveItems(const QPointF &delta)
+{
+    QVector<QGraphicsItem*> items = itemsInScene(m_item_ids, scene());
+    MapClipboard::aboutToChangeItems(items.toList());
+
+    SceneIndexSuspender suspend_index(scene(), items.size());
+    for (QGraphicsItem *item : items) {
+        item->setPos(item->pos() + delta);
+    }
+    updateNodeConnections(items);
+}
+
+// PositionsCommand implementation
+PositionsCommand::PositionsCommand(QGraphicsScene *scene, const QList<QGraphicsItem*> &items,
+                                   const QVector<QPointF> &old_positions, const QString &text)
+    : MapCommand(scene, text, true), m_item_ids(idsOf(items)), m_positions(old_positions)
+{
+}
+
+qint64 PositionsCommand::cost() const
+{
+    return kCommandCost + m_item_ids.size() * qint64(sizeof(quint64) + sizeof(QPointF));
+}
+
+void PositionsCommand::releaseData()
+{
+    m_item_ids = QVector<quint64>();
+    m_positions = QVector<QPointF>();
+}
+
+void PositionsCommand::swapPositions()
+{
+    TRACE_SCOPE("PositionsCommand::swapPositions", "undo");
+
+    ItemRegistry &registry = ItemRegistry::instance();
+    QVector<QGraphicsItem*> items;
+    items.reserve(m_item_ids.size());
+
+    SceneIndexSuspender suspend_index(scene(), m_item_ids.size());
+    for (int i = 0; i < m_item_ids.size(); ++i) {
+        QGraphicsItem *item = registry.item(m_item_ids[i]);
+        if (!item || item->scene() != scene()) {
+            continue;
+        }
+        MapClipboard::aboutToChangeItem(item);
+        QPointF current = item->pos();
+        item->setPos(m_positions[i]);
+        m_positions[i] = current;
+        items.append(item);
+    }
+    updateNodeConnections(items);
+}
+
+// ReparentCommand implementation
+ReparentCommand::ReparentCommand(EditableTextItem *node, EditableTextItem *new_parent, int index,
+                                 const QString &text)
+    : MapCommand(node->scene(), text, false), m_node_id(ItemRegistry::instance().idOf(node)),
+      m_old_parent_id(0), m_new_parent_id(new_parent ? ItemRegistry::instance().idOf(new_parent) : 0),
+      m_old_index(-1), m_new_index(index)
+{
+    if (EditableTextItem *old_parent = node->parentNode()) {
+        m_old_parent_id = ItemRegistry::instance().idOf(old_parent);
+        m_old_index = old_parent->childNodes().indexOf(node);
+    }
+}
+
+void ReparentCommand::moveNode(quint64 parent_id, int index)
+{
+    ItemRegistry &registry = ItemRegistry::instance();
+    EditableTextItem *node = dynamic_cast<EditableTextItem*>(registry.item(m_node_id));
+    EditableTextItem *parent = parent_id ? dynamic_cast<EditableTextItem*>(registry.item(parent_id)) : nullptr;
+    if (!node || (parent_id && !parent)) {
+        return;
+    }
+
+    if (node->parentNode()) {
+        node->parentNode()->removeChildNode(node);
+    }
+    if (parent) {
+        parent->addChildNode(node, index);
+    }
+}
+
+// TextEditCommand implementation
+TextEditCommand::TextEditCommand(EditableTextItem *node, const QString &old_text)
+    : MapCommand(node->scene(), QObject::tr("Edit Text"), true),
+      m_node_id(ItemRegistry::instance().idOf(node))
+{
+    // Keep only the span between the common prefix and suffix
+    const QString new_text = node->toPlainText();
+    int common_length = qMin(old_text.size(), new_text.size());
+    int prefix = 0;
+    while (prefix < common_length && old_text[prefix] == new_text[prefix]) {
+        ++prefix;
+    }
+    int suffix = 0;
+    while (suffix < common_length - prefix &&
+           old_text[old_text.size() - 1 - suffix] == new_text[new_text.size() - 1 - suffix]) {
+        ++suffix;
+    }
+
+    m_start = prefix;
+    m_removed = old_text.mid(prefix, old_text.size() - prefix - suffix);
+    m_inserted = new_text.mid(prefix, new_text.size() - prefix - suffix);
+}
+
+qint64 TextEditCommand::cost() const
+{
+    return kCommandCost + (m_removed.size() + m_inserted.size()) * qint64(sizeof(QChar));
+}
+
+void TextEditCommand::releaseData()
+{
+    m_removed.clear();
+    m_inserted.clear();
+}
+
+void TextEditCommand::replaceSpan(int length, const QString &text)
+{
+    EditableTextItem *node = dynamic_cast<EditableTextItem*>(ItemRegistry::instance().item(m_node_id));
+    if (!node) {
+        return;
+    }
+    MapClipboard::aboutToChangeItem(node);
+
+    QString content = node->toPlainText();
+    content.replace(m_start, length, text);
+    node->setPlainText(content);
+
+    // The node changed size and text
+    SearchIndex::instance().markDirty(node);
+    updateNodeConnections({node});
+}
+
+// CollapseCommand implementation
+CollapseCommand::CollapseCommand(EditableTextItem *node, Action action)
+    : MapCommand(node->scene(), action == Collapse ? QObject::tr("Collapse") : QObject::tr("Expand"), false),
+      m_node_id(ItemRegistry::instance().idOf(node)), m_action(action)
+{
+}
+
+void CollapseCommand::apply(Action action)
+{
+    EditableTextItem *node = dynamic_cast<EditableTextItem*>(ItemRegistry::instance().item(m_node_id));
+    if (!node) {
+        return;
+    }
+
+    if (action == Collapse) {
+        node->collapse();
+    } else {
+        node->expand();
+    }
+}
+
+// UndoHistory implementation
+UndoHistory &UndoHistory::instance()
+{
+    static UndoHistory history;
+    return history;
+}
+
+UndoHistory::UndoHistory()
+    : m_memory_limit(qint64(kDefaultMemoryLimitMB) * 1024 * 1024)
+{
+}
+
+void UndoHistory::attach(QGraphicsScene *scene, QUndoStack *stack)
+{
+    // The step limit can only be set while the stack is empty
+    if (stack->count() == 0) {
+        stack->setUndoLimit(kUndoLimit);
+    }
+    m_stacks.insert(scene, stack);
+
+    QObject::connect(scene, &QObject::destroyed, [this, scene]() {
+        m_stacks.remove(scene);
+    });
+}
+
+void UndoHistory::push(QGraphicsScene *scene, MapCommand *command)
+{
+    QUndoStack *stack = m_stacks.value(scene);
+    if (!stack) {
+        command->redo();
+        delete command;
+        return;
+    }
+
+    stack->push(command);
+    trim(stack);
+}
+
+void UndoHistory::setMemoryLimit(qint64 bytes)
+{
+    m_memory_limit = bytes;
+    for (const QPointer<QUndoStack> &stack : qAsConst(m_stacks)) {
+        if (stack) {
+            trim(stack);
+        }
+    }
+}
+
+qint64 UndoHistory::memoryUsage(const QUndoStack *stack)
+{
+    qint64 usage = 0;
+    for (int i = 0; i < stack->count(); ++i) {
+        if (const MapCommand *command = dynamic_cast<const MapCommand*>(stack->command(i))) {
+            usage += command->cost();
+        }
+    }
+    return usage;
+}
+
+void UndoHistory::trim(QUndoStack *stack)
+{
+    qint64 usage = memoryUsage(stack);
+    if (usage <= m_memory_limit) {
+        return;
+    }
+
+    // Released commands no longer change the scene, so they must all be
+    // older than the ones that still do; the newest step is always kept
+    int released = 0;
+    for (int i = 0; i < stack->count() - 1 && usage > m_memory_limit; ++i) {
+        MapCommand *command = dynamic_cast<MapCommand*>(const_cast<QUndoCommand*>(stack->command(i)));
+        if (!command) {
+            break;
+        }
+        qint64 cost = command->cost();
+        command->release();
+        if (command->cost() != cost) {
+            usage += command->cost() - cost;
+            ++released;
+        }
+    }
+    if (released > 0) {
+        qDebug() << "Undo history trimmed to" << usage / 1024 << "KB, released" << released << "steps";
+    }
+}
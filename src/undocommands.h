@@ -0,0 +1,295 @@
+#ifndef UNDOCOMMANDS_H
+#define UNDOCOMMANDS_H
+
+#include "pch.h"
+#include "collapsedsubtree.h"
+#include "imagedecoder.h"
+
+class EditableTextItem;
+
+// Stable ids for scene items.
+//
+// Undo commands refer to items by id instead of by pointer. An item that is
+// deleted and recreated by undo gets its old id back, so older commands
+// keep working on the new item. Ids are only handed out to items that a
+// command refers to, so items that are never edited cost nothing.
+class ItemRegistry
+{
+public:
+    static ItemRegistry &instance();
+
+    // Id of an item, assigned on first use
+    quint64 idOf(QGraphicsItem *item);
+
+    // Id of an item, or 0 if it has none
+    quint64 existingId(QGraphicsItem *item) const { return m_ids.value(item); }
+
+    // Item with an id, or null while it is deleted
+    QGraphicsItem *item(quint64 id) const { return m_items.value(id); }
+
+    // Give a recreated item its old id
+    void bind(quint64 id, QGraphicsItem *item);
+
+    // Forget an item (called when it is deleted)
+    void removeItem(QGraphicsItem *item);
+
+    // Keep the ids of a collapsing node's descendants by their record id,
+    // and hand them to the nodes recreated when it is expanded
+    void hideItems(EditableTextItem *node, const QHash<const EditableTextItem*, QString> &record_ids);
+    void restoreHidden(EditableTextItem *node, const QHash<QString, EditableTextItem*> &nodes);
+
+private:
+    ItemRegistry();
+
+    QHash<QGraphicsItem*, quint64> m_ids;
+    QHash<quint64, QGraphicsItem*> m_items;
+    QHash<quint64, QHash<QString, quint64>> m_hidden_ids; // Collapsed node -> ids by record id
+    quint64 m_next_id;
+};
+
+// Base of the map's undo commands.
+//
+// A command is created either for a change that already happened, in which
+// case the first redo() is skipped, or for one that redo() performs. Each
+// command reports roughly how much memory it holds, so UndoHistory can keep
+// the history within its budget.
+class MapCommand : public QUndoCommand
+{
+public:
+    void undo() override;
+    void redo() override;
+
+    // Approximate memory held by the command in bytes
+    virtual qint64 cost() const = 0;
+
+    // Drop the command's data. It no longer changes the scene and leaves
+    // the history when it is undone.
+    void release();
+    bool isReleased() const { return m_released; }
+
+protected:
+    MapCommand(QGraphicsScene *scene, const QString &text, bool applied);
+
+    virtual void undoChange() = 0;
+    virtual void redoChange() = 0;
+    virtual void releaseData() = 0;
+
+    QGraphicsScene *scene() const { return m_scene; }
+
+    // Bytes held by every command besides its data
+    static constexpr qint64 kCommandCost = 128;
+
+private:
+    QPointer<QGraphicsScene> m_scene;
+    bool m_skip_redo;
+    bool m_released;
+};
+
+// Items added to or removed from the scene (creating, pasting, deleting).
+//
+// Removing takes the descendants of text nodes along. Removed items are
+// kept as snapshots in the map format, with their place under their parent
+// node; items in the scene are only referred to by id.
+class ItemSetCommand : public MapCommand
+{
+public:
+    enum Change { Added, Removed };
+
+    // Added: the items were just added to the scene. Removed: redo()
+    // removes them.
+    ItemSetCommand(QGraphicsScene *scene, const QList<QGraphicsItem*> &items, Change change,
+                   const QString &text);
+
+    qint64 cost() const override;
+
+protected:
+    void undoChange() override;
+    void redoChange() override;
+    void releaseData() override;
+
+private:
+    struct Snapshot {
+        quint64 id = 0;
+        QJsonObject data;          // Item in the map format
+        ImageSource image_source;  // Images keep their data, which may not be in a file
+        QSize image_size;
+        CollapsedSubtree hidden;   // Descendants of a collapsed node
+        quint64 parent_id = 0;     // Parent node, for text nodes
+        int child_index = -1;
+    };
+
+    void removeItems();
+    void restoreItems();
+
+    static Snapshot takeSnapshot(QGraphicsItem *item);
+    static QGraphicsItem *createItem(const Snapshot &snapshot);
+    static qint64 snapshotCost(const Snapshot &snapshot);
+
+    Change m_change;
+    QVector<quint64> m_item_ids;
+    QVector<Snapshot> m_snapshots; // Only while the items are removed
+    qint64 m_snapshot_cost;
+};
+
+// Items moved by one offset (dragging). Consecutive moves of the same items
+// merge into one step.
+class MoveItemsCommand : public MapCommand
+{
+public:
+    // The items were just moved by delta
+    MoveItemsCommand(QGraphicsScene *scene, const QList<QGraphicsItem*> &items, const QPointF &delta);
+
+    int id() const override { return kMoveCommandId; }
+    bool mergeWith(const QUndoCommand *other) override;
+    qint64 cost() const override;
+
+protected:
+    void undoChange() override;
+    void redoChange() override;
+    void releaseData() override;
+
+private:
+    static constexpr int kMoveCommandId = 1;
+
+    void moveItems(const QPointF &delta);
+
+    QVector<quint64> m_item_ids; // Sorted, so equal selections compare equal
+    QPointF m_delta;
+};
+
+// Items moved to positions of their own (e.g. by Organize Layout). Undo and
+// redo swap the stored positions with the current ones in one batch.
+class PositionsCommand : public MapCommand
+{
+public:
+    // The items were just moved away from old_positions
+    PositionsCommand(QGraphicsScene *scene, const QList<QGraphicsItem*> &items,
+                     const QVector<QPointF> &old_positions, const QString &text);
+
+    qint64 cost() const override;
+
+protected:
+    void undoChange() override { swapPositions(); }
+    void redoChange() override { swapPositions(); }
+    void releaseData() override;
+
+private:
+    void swapPositions();
+
+    QVector<quint64> m_item_ids;
+    QVector<QPointF> m_positions; // Positions to swap in next
+};
+
+// A node moved under another parent, or made a root, with its subtree
+class ReparentCommand : public MapCommand
+{
+public:
+    // redo() moves the node to index under new_parent (null for a root)
+    ReparentCommand(EditableTextItem *node, EditableTextItem *new_parent, int index,
+                    const QString &text);
+
+    qint64 cost() const override { return kCommandCost; }
+
+protected:
+    void undoChange() override { moveNode(m_old_parent_id, m_old_index); }
+    void redoChange() override { moveNode(m_new_parent_id, m_new_index); }
+    void releaseData() override {}
+
+private:
+    void moveNode(quint64 parent_id, int index);
+
+    quint64 m_node_id;
+    quint64 m_old_parent_id;
+    quint64 m_new_parent_id;
+    int m_old_index;
+    int m_new_index;
+};
+
+// Edited node text, stored as the replaced span only
+class TextEditCommand : public MapCommand
+{
+public:
+    // The node's text was just changed from old_text
+    TextEditCommand(EditableTextItem *node, const QString &old_text);
+
+    qint64 cost() const override;
+
+protected:
+    void undoChange() override { replaceSpan(m_inserted.size(), m_removed); }
+    void redoChange() override { replaceSpan(m_removed.size(), m_inserted); }
+    void releaseData() override;
+
+private:
+    void replaceSpan(int length, const QString &text);
+
+    quint64 m_node_id;
+    int m_start;
+    QString m_removed;
+    QString m_inserted;
+};
+
+// A node collapsed or expanded
+class CollapseCommand : public MapCommand
+{
+public:
+    enum Action { Collapse, Expand };
+
+    // redo() performs the action
+    CollapseCommand(EditableTextItem *node, Action action);
+
+    qint64 cost() const override { return kCommandCost; }
+
+protected:
+    void undoChange() override { apply(m_action == Collapse ? Expand : Collapse); }
+    void redoChange() override { apply(m_action); }
+    void releaseData() override {}
+
+private:
+    void apply(Action action);
+
+    quint64 m_node_id;
+    Action m_action;
+};
+
+// Undo stacks of the scenes and the memory budget of their history.
+//
+// Commands are pushed for a scene; scenes without a stack (e.g. in the
+// command line tool) only apply them. After each push the oldest commands
+// are released until the history fits the budget again, so a few huge
+// deletions cannot pin their snapshots forever.
+class UndoHistory
+{
+public:
+    static UndoHistory &instance();
+
+    // Default history budget, and the most steps kept per stack
+    static constexpr int kDefaultMemoryLimitMB = 64;
+    static constexpr int kUndoLimit = 1000;
+
+    // Record the commands of a scene on a (new, empty) stack
+    void attach(QGraphicsScene *scene, QUndoStack *stack);
+
+    // Whether commands of the scene are recorded
+    bool isTracking(const QGraphicsScene *scene) const { return !m_stacks.value(scene).isNull(); }
+
+    // Record a command, or only apply it if the scene has no stack.
+    // The command may be merged into the previous one and deleted.
+    void push(QGraphicsScene *scene, MapCommand *command);
+
+    void setMemoryLimit(qint64 bytes);
+    qint64 memoryLimit() const { return m_memory_limit; }
+
+    // Memory held by the commands of a stack
+    static qint64 memoryUsage(const QUndoStack *stack);
+
+private:
+    UndoHistory();
+
+    // Release the oldest commands while the stack is over the budget
+    void trim(QUndoStack *stack);
+
+    QHash<const QGraphicsScene*, QPointer<QUndoStack>> m_stacks;
+    qint64 m_memory_limit;
+};
+
+#endif // UNDOCOMMANDS_H